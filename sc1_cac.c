@@ -211,6 +211,7 @@ else switch (off) {
 
     case CAC_SLSEL_OFF:
         ctx->cac_slow_mask = v32 & CAC_SLSEL_RW;
+        eval_intr (ctx);
         break;
 
     case CAC_SLSTA_OFF:
@@ -294,17 +295,35 @@ return TRUE;
 
 /* CAC API's */
 
+/* Cores whose slow interrupt select includes any of bits */
+
+static uint32 cac_slow_cores (uint32 bits)
+{
+uint32 i, cores = 0;
+
+for (i = 0; i < NUM_CORES; i++) {
+    if (cpu_ctx[i]->cac_slow_mask & bits) cores |= (1u << i);
+    }
+return cores;
+}
+
 void cac_set_slow (uint32 slow)
 {
-cac_slow_int |= (slow & SLOW_GLOBAL);
-eval_intr_all ();
+uint32 chg = slow & SLOW_GLOBAL & ~cac_slow_int;
+
+if (chg == 0) return;                                   /* no change? */
+cac_slow_int |= chg;
+eval_intr_set (cac_slow_cores (chg));
 return;
 }
 
 void cac_clr_slow (uint32 slow)
 {
-cac_slow_int &= ~(slow & SLOW_GLOBAL);
-eval_intr_all ();
+uint32 chg = slow & SLOW_GLOBAL & cac_slow_int;
+
+if (chg == 0) return;                                   /* no change? */
+cac_slow_int &= ~chg;
+eval_intr_set (cac_slow_cores (chg));
 return;
 }
 
@@ -323,7 +342,7 @@ if (ctx->cac_icr[idx] & CAC_ICR_ACT) ctx->cac_icr[idx] |= CAC_ICR_OVF;
 else {
     ctx->cac_icr[idx] = (ctx->cac_icr[idx] & ~CAC_ICR_CAUSE) |
     (val & CAC_ICR_CAUSE) | CAC_ICR_ACT;
-    eval_intr_all ();
+    eval_intr (ctx);                                    /* only target sees it */
     }
 return SCPE_OK;
 }
@@ -370,6 +389,7 @@ switch (sect) {
     case ECCS_C0: case ECCS_C1: case ECCS_C2:
     case ECCS_C3: case ECCS_C4: case ECCS_C5:
         ctx = cpu_ctx[sect];
+        INTR_MARK (sect);                               /* slow_local may change */
         if ((event & ECC_CE_L1) &&
             (get_cp0_errctl() & CP0_ERRCTL_ECCE)) {
             set_cp0_errctl (get_cp0_errctl() & ~CP0_ERRCTL_ECCE);
@@ -0,0 +1,896 @@
+/* sc1_cmod.c: SiCortex 1 cache and coherence timing model
+
+   Copyright (c) 2006, SiCortex, Inc.  All rights reserved.
+
+   Permission is hereby granted, free of charge, to any person obtaining a
+   copy of this software and associated documentation files (the "Software"),
+   to deal in the Software without restriction, including without limitation
+   the rights to use, copy, modify, merge, publish, distribute, sublicense,
+   and/or sell copies of the Software, and to permit persons to whom the
+   Software is furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+   ROBERT M SUPNIK BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+   IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+   CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+   Except as contained in this notice, the name of Robert M Supnik shall not
+   be used in advertising or otherwise to promote the sale, use or other dealings
+   in this Software without prior written authorization from Robert M Supnik.
+
+   CMOD         cache and coherence timing model
+
+   Memory in the simulator is always coherent; this model only keeps tags,
+   to estimate what the caches would have done.  It is fed from the ReadP*
+   and WriteP* reference hooks (sc1_stats.h), prefetch and CACHE.  Each
+   core has a 32KB 4-way L1 I and D cache with 32 byte lines.  The shared
+   1.5MB 12-way L2 has 64 byte lines and is split by line address between
+   the even (COHE) and odd (COHO) coherence controllers.  Each L2 line has
+   a directory entry with the cores that may hold it in L1 D and the core,
+   if any, that holds it modified (MSI).  The directory is not told about
+   clean L1 evictions, so it can send invalidates to cores that no longer
+   hold the line, as the hardware does.  L1 I is not kept coherent.
+
+   Stall cycles are charged per reference at the L2, memory and coherence
+   latencies in the L2LAT, MEMLAT and COHLAT registers, plus one cycle per
+   instruction.  The numbers are estimates, not a pipeline model.
+
+   The model is disabled by default and costs one test per reference when
+   disabled.  To keep it cheap enough to leave on:
+
+   SET CMOD SAMPLE=w/p  model only w counts out of every p
+   SET CMOD SETS=n      model only 1 in n L1/L2 sets; counts are scaled up
+
+   Set sampling uses PA<12:7>, which index sets in both the L1 and the L2,
+   so a sampled line always maps to whole sampled sets in every cache.
+
+   SET CMOD FORK=n      run each sample window in a worker process
+
+   With FORK, the simulator itself never models; it runs at functional
+   speed and forks a worker every p counts.  The fork is the checkpoint:
+   the worker shares the machine state copy-on-write, models WARMUP
+   counts to fill the caches, then w counts, sends its counts back
+   through a pipe and exits.  Up to n workers run at once.  The CPI of
+   each window, in process or forked, is kept to estimate the CPI of the
+   whole run and how far it can be trusted.
+*/
+
+#include "sc1_defs.h"
+#include "sc1_cmod.h"
+#include "sc1_jrnl.h"
+#include "sc1_disk.h"
+#include <math.h>
+
+#if !defined (_WIN32)
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#endif
+
+#define CM_L1_V_LINE    5                               /* L1: 32B lines */
+#define CM_L1_SETS      256                             /* 32KB, 4 way */
+#define CM_L1_WAYS      4
+#define CM_L2_V_LINE    6                               /* L2: 64B lines */
+#define CM_L2_SETS      1024                            /* per COH: 768KB, 12 way */
+#define CM_L2_WAYS      12
+#define CM_V_SSET       7                               /* set sampling bits */
+#define CM_N_SSET       6                               /* max 1 in 64 */
+#define CM_MAXJOB       64                              /* max workers */
+#define CM_MAXFD        1024                            /* fds closed in worker */
+
+#define CM_I            0                               /* L1 line states */
+#define CM_S            1
+#define CM_M            2
+
+typedef struct {
+    uint32              tag;                            /* line address */
+    uint32              st;                             /* state */
+    } CML1;
+
+typedef struct {
+    uint32              tag;                            /* line address */
+    uint32              shr;                            /* L1 D sharers */
+    uint32              own;                            /* modified owner + 1 */
+    uint32              fl;                             /* valid, dirty */
+    } CML2;
+
+#define CM_L2_V         1
+#define CM_L2_D         2
+
+typedef struct {
+    t_uint64            inst;                           /* instructions */
+    t_uint64            iref;                           /* L1 I refs, misses */
+    t_uint64            imiss;
+    t_uint64            dref;                           /* L1 D refs, misses */
+    t_uint64            dmiss;
+    t_uint64            l2ref;                          /* L2 refs, misses */
+    t_uint64            l2miss;
+    t_uint64            upg;                            /* S to M upgrades */
+    t_uint64            inv;                            /* copies invalidated */
+    t_uint64            itv;                            /* interventions */
+    t_uint64            wb;                             /* L1 writebacks */
+    t_uint64            unc;                            /* uncached refs */
+    t_uint64            stall;                          /* stall cycles */
+    } CMCNT;
+
+typedef struct {
+    t_uint64            req;                            /* requests */
+    t_uint64            miss;                           /* L2 misses */
+    t_uint64            inv;                            /* invalidates sent */
+    t_uint64            itv;                            /* interventions */
+    t_uint64            binv;                           /* back-invalidates */
+    t_uint64            wb;                             /* memory writebacks */
+    } CMCOH;
+
+typedef struct {
+    CMCNT               cnt[NUM_CORES];                 /* window counts */
+    CMCOH               coh[2];
+    } CMRES;
+
+typedef struct {
+    int                 pid;
+    int                 fd;                             /* result pipe */
+    } CMJOB;
+
+uint32 cmod_on = 0;                                     /* enabled, in sample */
+static int32 cm_l2lat = 20;                             /* L2 hit latency */
+static int32 cm_memlat = 120;                           /* memory latency */
+static int32 cm_cohlat = 40;                            /* coherence latency */
+static int32 cm_swin = 0;                               /* sample window */
+static int32 cm_sper = 0;                               /* sample period, 0 = all */
+static uint32 cm_sshift = 0;                            /* log2 set ratio */
+static uint32 cm_smask = 0;
+static t_uint64 cm_nsamp = 0;                           /* windows sampled */
+static int32 cm_fork = 0;                               /* workers, 0 = in process */
+static int32 cm_warm = 1000000;                         /* worker warmup */
+uint32 cmod_wrk = 0;                                    /* worker: 1 warm, 2 window */
+void (*cmod_fork_hook) (void) = NULL;                   /* worker drops links */
+static int cm_wfd = -1;                                 /* worker result pipe */
+static CMJOB cm_job[CM_MAXJOB];                         /* running workers */
+static uint32 cm_njob = 0;
+static t_uint64 cm_nlost = 0;                           /* workers lost */
+static t_uint64 cm_nwin = 0;                            /* windows done */
+static double cm_cpis = 0.0;                            /* sum of window CPI */
+static double cm_cpiss = 0.0;                           /* sum of squares */
+static t_uint64 cm_winst = 0;                           /* window start: insts */
+static t_uint64 cm_wcyc = 0;                            /*   and cycles */
+static t_uint64 cm_t0 = 0;                              /* count at reset */
+static CML1 cm_l1[NUM_CORES][2][CM_L1_SETS * CM_L1_WAYS];
+static CML2 cm_l2[2][CM_L2_SETS * CM_L2_WAYS];
+static CMCNT cm_cnt[NUM_CORES];
+static CMCOH cm_coh[2];
+
+t_stat cmod_svc (UNIT *uptr);
+t_stat cmod_reset (DEVICE *dptr);
+t_stat cmod_set_sample (UNIT *uptr, int32 val, char *cptr, void *desc);
+t_stat cmod_show_sample (FILE *st, UNIT *uptr, int32 val, void *desc);
+t_stat cmod_set_sets (UNIT *uptr, int32 val, char *cptr, void *desc);
+t_stat cmod_set_fork (UNIT *uptr, int32 val, char *cptr, void *desc);
+t_stat cmod_show_fork (FILE *st, UNIT *uptr, int32 val, void *desc);
+t_stat cmod_show_sets (FILE *st, UNIT *uptr, int32 val, void *desc);
+t_stat cmod_show_stats (FILE *st, UNIT *uptr, int32 val, void *desc);
+
+/* CMOD data structures
+
+   cmod_dev     CMOD device descriptor
+   cmod_unit    CMOD unit descriptor (sample timer)
+   cmod_reg     CMOD register list
+   cmod_mod     CMOD modifier list
+*/
+
+UNIT cmod_unit = { UDATA (&cmod_svc, 0, 0) };
+
+REG cmod_reg[] = {
+    { DRDATA (L2LAT, cm_l2lat, 16), PV_LEFT },
+    { DRDATA (MEMLAT, cm_memlat, 16), PV_LEFT },
+    { DRDATA (COHLAT, cm_cohlat, 16), PV_LEFT },
+    { DRDATA (WARMUP, cm_warm, 31), PV_LEFT },
+    { DRDATA (SAMPLES, cm_nsamp, 64), REG_RO + PV_LEFT },
+    { DRDATA (WINDOWS, cm_nwin, 64), REG_RO + PV_LEFT },
+    { DRDATA (LOST, cm_nlost, 64), REG_RO + PV_LEFT },
+    { FLDATA (ON, cmod_on, 0), REG_HRO },
+    { NULL }
+    };
+
+MTAB cmod_mod[] = {
+    { MTAB_XTD|MTAB_VDV, 0, "SAMPLE", "SAMPLE",
+      &cmod_set_sample, &cmod_show_sample },
+    { MTAB_XTD|MTAB_VDV, 0, "SETS", "SETS",
+      &cmod_set_sets, &cmod_show_sets },
+    { MTAB_XTD|MTAB_VDV, 0, "FORK", "FORK",
+      &cmod_set_fork, &cmod_show_fork },
+    { MTAB_XTD|MTAB_VDV|MTAB_NMO, 0, "STATS", NULL,
+      NULL, &cmod_show_stats },
+    { 0 }
+    };
+
+DEVICE cmod_dev = {
+    "CMOD", &cmod_unit, cmod_reg, cmod_mod,
+    1, 10, 31, 1, 8, 8,
+    NULL, NULL, &cmod_reset,
+    NULL, NULL, NULL,
+    NULL, DEV_DISABLE|DEV_DIS
+    };
+
+/* Move way w of a set to the front (most recently used) */
+
+static void cm_l1_touch (CML1 *set, uint32 w)
+{
+CML1 t = set[w];
+
+for ( ; w > 0; w--) set[w] = set[w - 1];
+set[0] = t;
+return;
+}
+
+static void cm_l2_touch (CML2 *set, uint32 w)
+{
+CML2 t = set[w];
+
+for ( ; w > 0; w--) set[w] = set[w - 1];
+set[0] = t;
+return;
+}
+
+/* Find an L1 or L2 line, NULL if not present */
+
+static CML1 *cm_l1_find (uint32 c, uint32 d, uint32 line)
+{
+CML1 *set = &cm_l1[c][d][(line & (CM_L1_SETS - 1)) * CM_L1_WAYS];
+uint32 w;
+
+for (w = 0; w < CM_L1_WAYS; w++) {
+    if ((set[w].st != CM_I) && (set[w].tag == line)) return &set[w];
+    }
+return NULL;
+}
+
+static CML2 *cm_l2_find (uint32 tag)
+{
+CML2 *set = &cm_l2[tag & 1][((tag >> 1) & (CM_L2_SETS - 1)) * CM_L2_WAYS];
+uint32 w;
+
+for (w = 0; w < CM_L2_WAYS; w++) {
+    if ((set[w].fl & CM_L2_V) && (set[w].tag == tag)) return &set[w];
+    }
+return NULL;
+}
+
+/* Invalidate or downgrade core c's L1 D copies of an L2 line */
+
+static void cm_l1_kill (uint32 c, uint32 tag, t_bool down)
+{
+CML1 *lp;
+uint32 i;
+
+for (i = 0; i < 2; i++) {                               /* two L1 lines */
+    if ((lp = cm_l1_find (c, 1, (tag << 1) | i)) == NULL) continue;
+    if (!down) lp->st = CM_I;
+    else if (lp->st == CM_M) lp->st = CM_S;
+    }
+return;
+}
+
+/* Evict an L2 line; L1 D copies are back-invalidated (inclusive) */
+
+static void cm_l2_evict (CML2 *ep)
+{
+CMCOH *hp = &cm_coh[ep->tag & 1];
+uint32 k;
+
+for (k = 0; k < NUM_CORES; k++) {
+    if (ep->shr & (1u << k)) {
+        cm_l1_kill (k, ep->tag, FALSE);
+        hp->binv++;
+        }
+    }
+if ((ep->fl & CM_L2_D) || ep->own) hp->wb++;
+ep->fl = 0;
+return;
+}
+
+/* Write back a modified L1 D line of core c to the L2 */
+
+static void cm_l2_wb (uint32 c, uint32 line)
+{
+CML2 *ep;
+
+if ((ep = cm_l2_find (line >> 1)) == NULL) return;
+ep->fl |= CM_L2_D;
+if ((ep->own == (c + 1)) &&                             /* other half clean? */
+    (cm_l1_find (c, 1, line ^ 1) == NULL))
+    ep->own = 0;
+return;
+}
+
+/* L2 and directory reference from core c; returns latency */
+
+static uint32 cm_l2_ref (uint32 c, t_uint64 pa, t_bool wr, t_bool dside)
+{
+uint32 tag = (uint32) (pa >> CM_L2_V_LINE);
+CMCOH *hp = &cm_coh[tag & 1];
+CMCNT *cp = &cm_cnt[c];
+CML2 *set = &cm_l2[tag & 1][((tag >> 1) & (CM_L2_SETS - 1)) * CM_L2_WAYS];
+CML2 *ep;
+uint32 w, k, lat, coh, others;
+
+cp->l2ref++;
+hp->req++;
+for (w = 0; w < CM_L2_WAYS; w++) {
+    if ((set[w].fl & CM_L2_V) && (set[w].tag == tag)) break;
+    }
+if (w < CM_L2_WAYS) {                                   /* hit */
+    if (w) cm_l2_touch (set, w);
+    lat = cm_l2lat;
+    }
+else {                                                  /* miss */
+    cp->l2miss++;
+    hp->miss++;
+    w = CM_L2_WAYS - 1;
+    if (set[w].fl & CM_L2_V) cm_l2_evict (&set[w]);
+    cm_l2_touch (set, w);
+    set[0].tag = tag;
+    set[0].shr = 0;
+    set[0].own = 0;
+    set[0].fl = CM_L2_V;
+    lat = cm_l2lat + cm_memlat;
+    }
+if (!dside) return lat;                                 /* L1 I not coherent */
+ep = &set[0];
+coh = 0;
+if (ep->own && (ep->own != (c + 1))) {                  /* modified elsewhere? */
+    k = ep->own - 1;
+    cm_l1_kill (k, tag, !wr);                           /* recall it */
+    if (wr) ep->shr &= ~(1u << k);
+    ep->own = 0;
+    ep->fl |= CM_L2_D;
+    cp->itv++;
+    hp->itv++;
+    coh = cm_cohlat;
+    }
+if (wr) {
+    others = ep->shr & ~(1u << c);
+    for (k = 0; others != 0; k++, others = others >> 1) {
+        if (others & 1) {
+            cm_l1_kill (k, tag, FALSE);
+            cp->inv++;
+            hp->inv++;
+            coh = cm_cohlat;
+            }
+        }
+    ep->shr = 1u << c;
+    ep->own = c + 1;
+    }
+else ep->shr |= (1u << c);
+return lat + coh;
+}
+
+/* Memory reference from a ReadP*, WriteP* or prefetch hook */
+
+void cmod_ref (CORECTX *ctx, t_uint64 pa, uint32 catr, uint32 kind)
+{
+uint32 c = ctx->cpu_num;
+CMCNT *cp = &cm_cnt[c];
+CML1 *set;
+uint32 line, d, w, lat;
+
+if (kind == CMOD_IFETCH) cp->inst++;
+if (CA_UNCACHED (catr)) {                               /* uncached? */
+    if (kind != CMOD_PREF) cp->unc++;
+    return;
+    }
+if (((uint32) (pa >> CM_V_SSET)) & cm_smask) return;   /* set not sampled */
+line = (uint32) (pa >> CM_L1_V_LINE);
+d = (kind != CMOD_IFETCH);
+set = &cm_l1[c][d][(line & (CM_L1_SETS - 1)) * CM_L1_WAYS];
+for (w = 0; w < CM_L1_WAYS; w++) {
+    if ((set[w].st != CM_I) && (set[w].tag == line)) break;
+    }
+if (kind != CMOD_PREF) {
+    if (d) cp->dref++;
+    else cp->iref++;
+    }
+if (w < CM_L1_WAYS) {                                   /* hit */
+    if (w) cm_l1_touch (set, w);
+    if ((kind == CMOD_WRITE) && (set[0].st != CM_M)) {  /* upgrade */
+        cp->upg++;
+        cp->stall += cm_l2_ref (c, pa, TRUE, TRUE);
+        set[0].st = CM_M;
+        }
+    return;
+    }
+if (kind != CMOD_PREF) {                                /* miss */
+    if (d) cp->dmiss++;
+    else cp->imiss++;
+    }
+w = CM_L1_WAYS - 1;
+if (set[w].st == CM_M) {                                /* dirty victim? */
+    cp->wb++;
+    set[w].st = CM_I;
+    cm_l2_wb (c, set[w].tag);
+    }
+lat = cm_l2_ref (c, pa, kind == CMOD_WRITE, d);
+cm_l1_touch (set, w);
+set[0].tag = line;
+set[0].st = (kind == CMOD_WRITE)? CM_M: CM_S;
+if (kind != CMOD_PREF) cp->stall += lat;
+return;
+}
+
+/* CACHE instruction: hit operations only, index operations are ignored */
+
+void cmod_cache (CORECTX *ctx, t_uint64 pa, uint32 op)
+{
+uint32 c = ctx->cpu_num;
+uint32 line = (uint32) (pa >> CM_L1_V_LINE);
+uint32 fnc = (op >> 2) & 7;
+CML1 *lp;
+CML2 *ep;
+
+if (((uint32) (pa >> CM_V_SSET)) & cm_smask) return;   /* set not sampled */
+if ((fnc < 4) || (fnc > 6)) return;                     /* hit inv, wbinv, wb */
+switch (op & 3) {
+
+    case 0:                                             /* L1 I */
+        if ((fnc == 4) && ((lp = cm_l1_find (c, 0, line)) != NULL))
+            lp->st = CM_I;
+        break;
+
+    case 1:                                             /* L1 D */
+        if ((lp = cm_l1_find (c, 1, line)) == NULL) break;
+        if ((lp->st == CM_M) && (fnc != 4)) {           /* write back */
+            cm_cnt[c].wb++;
+            lp->st = (fnc == 6)? CM_S: CM_I;
+            cm_l2_wb (c, line);
+            }
+        else if (fnc != 6) lp->st = CM_I;
+        break;
+
+    case 3:                                             /* L2 */
+        if ((fnc != 6) && ((ep = cm_l2_find (line >> 1)) != NULL))
+            cm_l2_evict (ep);
+        break;
+        }
+return;
+}
+
+/* Window totals: instructions and estimated cycles, all cores */
+
+static t_uint64 cm_cycles (CMCNT *cp)
+{
+return cp->inst + (cp->stall << cm_sshift) + (cp->unc * cm_memlat);
+}
+
+static void cm_totals (CMCNT *cnt, t_uint64 *inst, t_uint64 *cyc)
+{
+uint32 c;
+
+for (c = 0, *inst = *cyc = 0; c < NUM_CORES; c++) {
+    *inst = *inst + cnt[c].inst;
+    *cyc = *cyc + cm_cycles (&cnt[c]);
+    }
+return;
+}
+
+/* Record the CPI of a finished window */
+
+static void cm_win_add (t_uint64 inst, t_uint64 cyc)
+{
+double cpi;
+
+if (inst == 0) return;
+cpi = (double) cyc / (double) inst;
+cm_nwin++;
+cm_cpis = cm_cpis + cpi;
+cm_cpiss = cm_cpiss + (cpi * cpi);
+return;
+}
+
+#if !defined (_WIN32)
+
+/* Collect finished workers until no more than keep are running */
+
+static void cm_reap (uint32 keep)
+{
+CMRES res;
+t_uint64 inst, cyc;
+uint32 i, c;
+int st, r;
+
+for (i = 0; i < cm_njob; ) {
+    r = waitpid (cm_job[i].pid, &st, (cm_njob > keep)? 0: WNOHANG);
+    if (r == 0) {                                       /* still running */
+        i++;
+        continue;
+        }
+    if ((r > 0) &&
+        (read (cm_job[i].fd, &res, sizeof (res)) == sizeof (res))) {
+        for (c = 0; c < NUM_CORES; c++) {               /* add to totals */
+            t_uint64 *dp = (t_uint64 *) &cm_cnt[c];
+            t_uint64 *sp = (t_uint64 *) &res.cnt[c];
+            uint32 k;
+            for (k = 0; k < (sizeof (CMCNT) / sizeof (t_uint64)); k++)
+                dp[k] = dp[k] + sp[k];
+            }
+        for (c = 0; c < 2; c++) {
+            cm_coh[c].req += res.coh[c].req;
+            cm_coh[c].miss += res.coh[c].miss;
+            cm_coh[c].inv += res.coh[c].inv;
+            cm_coh[c].itv += res.coh[c].itv;
+            cm_coh[c].binv += res.coh[c].binv;
+            cm_coh[c].wb += res.coh[c].wb;
+            }
+        cm_totals (res.cnt, &inst, &cyc);
+        cm_win_add (inst, cyc);
+        }
+    else cm_nlost++;                                    /* stopped early */
+    close (cm_job[i].fd);
+    cm_job[i] = cm_job[--cm_njob];
+    }
+return;
+}
+
+/* Stop all workers, discarding their results */
+
+static void cm_kill (void)
+{
+int st;
+
+while (cm_njob) {
+    cm_njob--;
+    kill (cm_job[cm_njob].pid, SIGKILL);
+    waitpid (cm_job[cm_njob].pid, &st, 0);
+    close (cm_job[cm_njob].fd);
+    }
+return;
+}
+
+/* Cut the worker off from everything the simulator shares with the
+   outside.  The console and logs go to /dev/null.  Attached files are
+   reopened read-only on the same descriptors, at the same offsets, so
+   the worker's seeks and reads don't move the parent's file positions
+   and its writes can't reach them; disks accept the worker's writes
+   and drop them (disk_discard), so the guest sees them succeed as it
+   would in the parent.  Other read-only files stay open (disk
+   overlay bases are only read positionally); every other descriptor
+   (sockets, journal) is closed.  Shared-memory links to other nodes
+   (the SCDMA fabric) are unmapped through cmod_fork_hook without
+   telling the other nodes, which go on seeing the parent.  The worker
+   never returns to SCP.
+*/
+
+static t_bool cm_fd_ro (int fd)
+{
+struct stat sb;
+int fl = fcntl (fd, F_GETFL);
+
+return (fl >= 0) && ((fl & O_ACCMODE) == O_RDONLY) &&
+    (fstat (fd, &sb) == 0) && S_ISREG (sb.st_mode);
+}
+
+static void cm_wrk_isolate (int pfd)
+{
+DEVICE *dptr;
+UNIT *uptr;
+uint8 keep[CM_MAXFD];
+uint32 i, j;
+off_t off;
+int fd, nfd;
+
+memset (keep, 0, sizeof (keep));
+if ((nfd = open ("/dev/null", O_RDWR)) >= 0) {
+    dup2 (nfd, 0);
+    dup2 (nfd, 1);
+    dup2 (nfd, 2);
+    close (nfd);
+    }
+sim_log = NULL;
+sim_deb = NULL;
+if (cmod_fork_hook) cmod_fork_hook ();                  /* off the fabric */
+disk_discard = 1;                                       /* writes succeed, lost */
+jrnl_mode = JRNL_OFF;                                   /* no journal */
+jrnl_ckpt_due = 0;
+for (i = 0; (dptr = sim_devices[i]) != NULL; i++) {
+    for (j = 0; j < dptr->numunits; j++) {
+        uptr = dptr->units + j;
+        if (!(uptr->flags & UNIT_ATT) || (uptr->fileref == NULL) ||
+            (uptr->filename == NULL))
+            continue;
+        fd = fileno (uptr->fileref);
+        off = lseek (fd, 0, SEEK_CUR);
+        if ((nfd = open (uptr->filename, O_RDONLY)) < 0)
+            nfd = open ("/dev/null", O_RDONLY);
+        if (nfd >= 0) {
+            dup2 (nfd, fd);
+            close (nfd);
+            }
+        if (off >= 0) lseek (fd, off, SEEK_SET);
+        if ((fd >= 0) && (fd < CM_MAXFD)) keep[fd] = 1;
+        }
+    }
+for (fd = 3; fd < CM_MAXFD; fd++) {
+    if (!keep[fd] && (fd != pfd) && !cm_fd_ro (fd)) close (fd);
+    }
+return;
+}
+
+/* Fork a worker; returns TRUE in the worker */
+
+static t_bool cm_fork_wrk (void)
+{
+int pid, pfd[2];
+
+cm_reap ((uint32) cm_fork - 1);                         /* wait for a slot */
+fflush (NULL);                                          /* nothing to share */
+if (pipe (pfd) != 0) {
+    cm_nlost++;
+    return FALSE;
+    }
+if ((pid = fork ()) == 0) {                             /* worker */
+    cm_wfd = pfd[1];
+    cm_njob = 0;
+    cm_wrk_isolate (pfd[1]);
+    memset (cm_cnt, 0, sizeof (cm_cnt));
+    memset (cm_coh, 0, sizeof (cm_coh));
+    cmod_on = 1;
+    cmod_wrk = cm_warm? 1: 2;
+    sim_activate (&cmod_unit, cm_warm? cm_warm: cm_swin);
+    return TRUE;
+    }
+close (pfd[1]);
+if (pid < 0) {
+    close (pfd[0]);
+    cm_nlost++;
+    return FALSE;
+    }
+cm_job[cm_njob].pid = pid;
+cm_job[cm_njob].fd = pfd[0];
+cm_njob++;
+return FALSE;
+}
+
+/* Worker done: window complete or simulation stopped.  A worker that
+   stops before its window is complete sends nothing.
+*/
+
+void cmod_wrk_done (void)
+{
+CMRES res;
+
+if (cmod_wrk == 2) {
+    memcpy (res.cnt, cm_cnt, sizeof (cm_cnt));
+    memcpy (res.coh, cm_coh, sizeof (cm_coh));
+    if (write (cm_wfd, &res, sizeof (res)) != sizeof (res)) _exit (1);
+    }
+_exit (0);
+}
+
+#else
+
+static void cm_reap (uint32 keep)
+{
+return;
+}
+
+static void cm_kill (void)
+{
+return;
+}
+
+static t_bool cm_fork_wrk (void)
+{
+return FALSE;
+}
+
+void cmod_wrk_done (void)
+{
+exit (0);
+}
+
+#endif
+
+/* Sample timer: alternate between modelled and skipped windows, or
+   start a worker every period, or end a worker's warmup or window
+*/
+
+t_stat cmod_svc (UNIT *uptr)
+{
+if (cm_sper == 0) return SCPE_OK;
+if (cmod_wrk == 1) {                                    /* warm, start window */
+    memset (cm_cnt, 0, sizeof (cm_cnt));
+    memset (cm_coh, 0, sizeof (cm_coh));
+    cmod_wrk = 2;
+    sim_activate (uptr, cm_swin);
+    return SCPE_OK;
+    }
+if (cmod_wrk) cmod_wrk_done ();                         /* window done */
+if (cm_fork) {
+    cm_nsamp++;
+    if (cm_fork_wrk ()) return SCPE_OK;                 /* worker? */
+    sim_activate (uptr, cm_sper);
+    return SCPE_OK;
+    }
+cmod_on = cmod_on ^ 1;
+if (cmod_on) {
+    cm_nsamp++;
+    cm_totals (cm_cnt, &cm_winst, &cm_wcyc);            /* window start */
+    }
+else {
+    t_uint64 inst, cyc;
+    cm_totals (cm_cnt, &inst, &cyc);
+    cm_win_add (inst - cm_winst, cyc - cm_wcyc);
+    }
+sim_activate (uptr, cmod_on? cm_swin: cm_sper - cm_swin);
+return SCPE_OK;
+}
+
+/* Reset - empty the caches and clear the counts */
+
+t_stat cmod_reset (DEVICE *dptr)
+{
+cm_kill ();
+memset (cm_l1, 0, sizeof (cm_l1));
+memset (cm_l2, 0, sizeof (cm_l2));
+memset (cm_cnt, 0, sizeof (cm_cnt));
+memset (cm_coh, 0, sizeof (cm_coh));
+cm_nsamp = 0;
+cm_nlost = 0;
+cm_nwin = 0;
+cm_cpis = cm_cpiss = 0.0;
+cm_winst = cm_wcyc = 0;
+cm_t0 = total_count;
+sim_cancel (&cmod_unit);
+cmod_on = (dptr->flags & DEV_DIS)? 0: 1;
+if (cmod_on && cm_sper) {
+    if (cm_fork) {                                      /* functional here */
+        cmod_on = 0;
+        sim_activate (&cmod_unit, cm_sper);
+        }
+    else {
+        cm_nsamp = 1;
+        sim_activate (&cmod_unit, cm_swin);
+        }
+    }
+return SCPE_OK;
+}
+
+/* Set/show time sampling: SAMPLE=w/p, or SAMPLE=0 for continuous */
+
+t_stat cmod_set_sample (UNIT *uptr, int32 val, char *cptr, void *desc)
+{
+char *sl;
+uint32 w, p;
+t_stat r;
+
+if (cptr == NULL) return SCPE_ARG;
+if ((sl = strchr (cptr, '/')) != NULL) *sl++ = 0;
+w = (uint32) get_uint (cptr, 10, 0x7FFFFFFF, &r);
+if (r != SCPE_OK) return r;
+if (w == 0) p = 0;
+else {
+    if (sl == NULL) return SCPE_ARG;
+    p = (uint32) get_uint (sl, 10, 0x7FFFFFFF, &r);
+    if ((r != SCPE_OK) || (p <= w)) return SCPE_ARG;
+    }
+cm_swin = w;
+cm_sper = p;
+return cmod_reset (&cmod_dev);
+}
+
+t_stat cmod_show_sample (FILE *st, UNIT *uptr, int32 val, void *desc)
+{
+if (cm_sper) fprintf (st, "sample=%d/%d", cm_swin, cm_sper);
+else fprintf (st, "continuous");
+return SCPE_OK;
+}
+
+/* Set/show set sampling: SETS=n, n = 1, 2, 4, ... 64 */
+
+t_stat cmod_set_sets (UNIT *uptr, int32 val, char *cptr, void *desc)
+{
+uint32 n, sh;
+t_stat r;
+
+if (cptr == NULL) return SCPE_ARG;
+n = (uint32) get_uint (cptr, 10, 1u << CM_N_SSET, &r);
+if ((r != SCPE_OK) || (n == 0) || (n & (n - 1))) return SCPE_ARG;
+for (sh = 0; (1u << sh) < n; sh++) ;
+cm_sshift = sh;
+cm_smask = n - 1;
+return cmod_reset (&cmod_dev);
+}
+
+t_stat cmod_show_sets (FILE *st, UNIT *uptr, int32 val, void *desc)
+{
+fprintf (st, "sets=1/%d", 1 << cm_sshift);
+return SCPE_OK;
+}
+
+/* Set/show worker processes: FORK=n, or FORK=0 to sample in process */
+
+t_stat cmod_set_fork (UNIT *uptr, int32 val, char *cptr, void *desc)
+{
+uint32 n;
+t_stat r;
+
+if (cptr == NULL) return SCPE_ARG;
+n = (uint32) get_uint (cptr, 10, CM_MAXJOB, &r);
+if (r != SCPE_OK) return r;
+#if defined (_WIN32) || defined (SIMH_CPUSIMH) || defined (SIMH_EMULATION_LIBRARY)
+if (n) return SCPE_NOFNC;                               /* can't fork */
+#endif
+cm_fork = n;
+return cmod_reset (&cmod_dev);
+}
+
+t_stat cmod_show_fork (FILE *st, UNIT *uptr, int32 val, void *desc)
+{
+if (cm_fork) fprintf (st, "fork=%d", cm_fork);
+else fprintf (st, "in process");
+return SCPE_OK;
+}
+
+/* Show statistics; set-sampled counts are scaled to the whole cache */
+
+static double cm_pct (t_uint64 n, t_uint64 d)
+{
+return d? (100.0 * (double) n) / (double) d: 0.0;
+}
+
+t_stat cmod_show_stats (FILE *st, UNIT *uptr, int32 val, void *desc)
+{
+CMCNT *cp;
+CMCOH *hp;
+t_uint64 cyc;
+double mean, var;
+uint32 c, h;
+uint32 sh = cm_sshift;
+
+if (cmod_dev.flags & DEV_DIS) {
+    fprintf (st, "cache model disabled\n");
+    return SCPE_OK;
+    }
+cm_reap (0);                                            /* wait for workers */
+if (cm_sper) fprintf (st, "%lld windows of %d out of every %d counts%s\n",
+    cm_nsamp, cm_swin, cm_sper, cm_fork? ", in workers": "");
+if (cm_nlost) fprintf (st, "%lld windows lost (stopped or failed)\n", cm_nlost);
+for (c = 0; c < NUM_CORES; c++) {
+    cp = &cm_cnt[c];
+    if ((cp->inst == 0) && (cp->dref == 0) && (cp->unc == 0)) continue;
+    cyc = cm_cycles (cp);
+    fprintf (st, "CPU%d: %lld instructions, %lld cycles, CPI %.2f\n",
+        c, cp->inst, cyc, cp->inst? (double) cyc / (double) cp->inst: 0.0);
+    fprintf (st, "  L1I %lld refs %.2f%% miss, L1D %lld refs %.2f%% miss, "
+        "L2 %lld refs %.2f%% miss\n",
+        cp->iref << sh, cm_pct (cp->imiss, cp->iref),
+        cp->dref << sh, cm_pct (cp->dmiss, cp->dref),
+        cp->l2ref << sh, cm_pct (cp->l2miss, cp->l2ref));
+    fprintf (st, "  %lld upgrades, %lld invalidates, %lld interventions, "
+        "%lld writebacks, %lld uncached\n",
+        cp->upg << sh, cp->inv << sh, cp->itv << sh, cp->wb << sh, cp->unc);
+    }
+for (h = 0; h < 2; h++) {
+    hp = &cm_coh[h];
+    fprintf (st, "%s: %lld requests, %.2f%% miss, %lld invalidates, "
+        "%lld interventions, %lld back-invalidates, %lld writebacks\n",
+        h? "COHO": "COHE", hp->req << sh, cm_pct (hp->miss, hp->req),
+        hp->inv << sh, hp->itv << sh, hp->binv << sh, hp->wb << sh);
+    }
+if (cm_nwin) {                                          /* extrapolate */
+    mean = cm_cpis / (double) cm_nwin;
+    var = (cm_nwin > 1)?
+        (cm_cpiss - (mean * cm_cpis)) / (double) (cm_nwin - 1): 0.0;
+    fprintf (st, "Window CPI %.3f +/- %.3f (95%%, %lld windows); "
+        "%lld counts, about %.0f cycles per core\n",
+        mean, 1.96 * sqrt ((var > 0.0)? var / (double) cm_nwin: 0.0),
+        cm_nwin, total_count - cm_t0, mean * (double) (total_count - cm_t0));
+    }
+return SCPE_OK;
+}
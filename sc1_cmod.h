@@ -0,0 +1,28 @@
+/* sc1_cmod.h: SiCortex 1 cache and coherence timing model
+
+   Copyright (c) 2006, SiCortex, Inc.  All rights reserved.
+
+   The model is fed from the physical memory reference hooks in
+   sc1_stats.h.  See sc1_cmod.c.
+*/
+
+#ifndef _SC1_CMOD_H_
+#define _SC1_CMOD_H_    0
+
+#define CMOD_IFETCH     0                               /* reference kinds */
+#define CMOD_READ       1
+#define CMOD_WRITE      2
+#define CMOD_PREF       3                               /* prefetch, no stall */
+
+extern uint32 cmod_on;                                  /* enabled, in sample */
+extern uint32 cmod_wrk;                                 /* sample worker process */
+extern void (*cmod_fork_hook) (void);                   /* worker drops links */
+
+void cmod_ref (CORECTX *ctx, t_uint64 pa, uint32 catr, uint32 kind);
+void cmod_cache (CORECTX *ctx, t_uint64 pa, uint32 op);
+void cmod_wrk_done (void);
+
+#define CMOD_REF(ctx,pa,catr,k) \
+                        do { if (cmod_on) cmod_ref (ctx, pa, catr, k); } while (0)
+
+#endif
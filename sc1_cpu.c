@@ -161,6 +161,8 @@ t_stat cpu_ex (t_value *vptr, t_addr addr, UNIT *uptr, int32 sw);
 t_stat cpu_dep (t_value vptr, t_addr addr, UNIT *uptr, int32 sw);
 t_stat cpu_set_hist (UNIT *uptr, int32 val, char *cptr, void *desc);
 t_stat cpu_show_hist (FILE *st, UNIT *uptr, int32 val, void *desc);
+t_stat cpu_set_refill (UNIT *uptr, int32 val, char *cptr, void *desc);
+t_stat cpu_show_refill (FILE *st, UNIT *uptr, int32 val, void *desc);
 t_stat cpu_show_virt (FILE *st, UNIT *uptr, int32 val, void *desc);
 t_stat cpu_show_tlb (FILE *st, UNIT *uptr, int32 val, void *desc);
 void cpu_fprint_one_inst (FILE *st, uint32 ir, t_uint64 pc,
@@ -186,6 +188,7 @@ extern t_stat op_cop1x_alnv (CORECTX *ctx, uint32 ir);
 extern t_stat op_cop2 (CORECTX *ctx, uint32 ir);
 extern void mem_pref (CORECTX *ctx, t_uint64 pa, uint32 catr, uint32 hint);
 extern t_bool mem_cache (CORECTX *ctx, uint32 ir, t_uint64 va, uint32 hint);
+extern uint32 tlb_refill_enb;
 extern void mem_sync (CORECTX *ctx);
 extern t_bool tlb_set_aer (CORECTX *ctx, t_uint64 va, uint32 mode);
 extern void tlb_init (CORECTX *ctx);
@@ -460,6 +463,8 @@ REG cpu0_reg[] = {
 #endif
     { BRDATA (PCQ, cpu0_ctx.pcq, 16, 64, PCQ_SIZE), REG_RO+REG_CIRC },
     { HRDATA (PCQP, cpu0_ctx.pcq_p, 6), REG_HRO },
+    { DRDATA (REFILLS, cpu0_ctx.rfl_n, 64), PV_LEFT },
+    { DRDATA (REFILLFB, cpu0_ctx.rfl_fb, 64), PV_LEFT },
     { NULL }
     };
 
@@ -472,6 +477,10 @@ MTAB cpu0_mod[] = {
       NULL, &cpu_show_tlb },
     { MTAB_XTD|MTAB_VDV|MTAB_NMO|MTAB_SHP, 1, "FTLB", NULL,
       NULL, &cpu_show_tlb },
+    { MTAB_XTD|MTAB_VDV, 1, "REFILL", "REFILL",
+      &cpu_set_refill, &cpu_show_refill },
+    { MTAB_XTD|MTAB_VDV, 0, NULL, "NOREFILL",
+      &cpu_set_refill, NULL },
     { 0 }
     };
 
@@ -529,7 +538,17 @@ if (Q_MD_U) {                                           /* user mode? */
 
 if (!(ctx->events & (EVT_STALL|EVT_STALL_EPOCH))) {     /* not waiting for a stalled ld/sd */
 
-if (ctx->events & (EVT_TSTOP|EVT_INT|EVT_WAIT|EVT_BKPT|EVT_CCHE|EVT_DINT)) { /* event pending? */
+if (ctx->events & (EVT_TSTOP|EVT_INT|EVT_WAIT|EVT_BKPT|EVT_CCHE|EVT_DINT|EVT_WATCH|EVT_GDB|EVT_SPIN)) { /* event pending? */
+    if (ctx->events & EVT_WATCH) {                      /* watchpoint hit? */
+        ctx->events &= ~EVT_WATCH;
+        return STOP_WATCH;
+        }
+
+    if (ctx->events & EVT_GDB) {                        /* held by gdb? */
+        global_sleep++;                                 /* idle like WAIT */
+        return SCPE_OK;
+        }
+
     if (ctx->events & EVT_TSTOP) {                      /* stop on trap? */
         ctx->events &= ~EVT_TSTOP;
         for (i = 0; !((ctx->trapbit >> i) & 1); i++) ;
@@ -566,7 +585,7 @@ if (ctx->events & (EVT_TSTOP|EVT_INT|EVT_WAIT|EVT_BKPT|EVT_CCHE|EVT_DINT)) { /*
 	    set_cp0_sr (get_cp0_sr() | CP0_SR_ERL);
         ctx->delay = 0;
         ctx->taken = 0;
-        ctx->events &= ~(EVT_NLFY|EVT_CCHE|EVT_INT|EVT_WAIT);
+        ctx->events &= ~(EVT_NLFY|EVT_CCHE|EVT_INT|EVT_WAIT|EVT_SPIN|EVT_SARM);
         ctx->traps = 0;
         }
 
@@ -602,13 +621,30 @@ if (ctx->events & (EVT_TSTOP|EVT_INT|EVT_WAIT|EVT_BKPT|EVT_CCHE|EVT_DINT)) { /*
         set_cp0_sr (get_cp0_sr() | CP0_SR_EXL);
         ctx->delay = 0;
         ctx->taken = 0;
-        ctx->events &= ~(EVT_NLFY|EVT_INT|EVT_WAIT);
+        ctx->events &= ~(EVT_NLFY|EVT_INT|EVT_WAIT|EVT_SPIN|EVT_SARM);
         ctx->traps = 0;
         }
 
-    if ((ctx->events & EVT_BKPT) &&                     /* breakpoint? */
-         sim_brk_test (ctx->PC, SWMASK ('E') | (ctx->cpu_num << SIM_BKPT_V_SPC)))
-        return STOP_IBKPT;                              /* stop simulation */
+    if (ctx->events & EVT_BKPT) {                       /* breakpoint? */
+        if (BRK_PAGE_HIT (ctx->cpu_num, ctx->PC)) {     /* page has one? */
+            ctx->brk_pend = 1;
+            if (sim_brk_test (ctx->PC, BRK_TYPES (ctx->cpu_num)))
+                return STOP_IBKPT;                      /* stop simulation */
+            }
+        else if (ctx->brk_pend) {                       /* clear scp's pending */
+            ctx->brk_pend = 0;
+            sim_brk_test (ctx->PC, BRK_TYPES (ctx->cpu_num));
+            }
+        }
+
+    if (ctx->events & EVT_SPIN) {                       /* parked in spin loop? */
+        if (!(ctx->spin_fl & SPIN_IO) ||                /* device poll not due? */
+            ((get_cp0_time () - ctx->spin_t0) < SPIN_IOPOLL)) {
+            STATS_TICK (ctx, 1);                        /* not asleep, no SNOOZE */
+            return SCPE_OK;
+            }
+        ctx->events &= ~EVT_SPIN;                       /* run it again */
+        }
 
     if (ctx->events & EVT_WAIT) {                       /* WAIT instruction? */
         global_sleep++;                                 /* count sheep */
@@ -1574,6 +1610,13 @@ if (ReadI (ctx, ctx->PC, &t64)) {                       /* fetch instr */
                 /* else */ if ((sa == I_GETSA (ICE9_E_MipsMagicInstrs_ECCINJ)) && (rd == 0)) {
                     extern void cac_ecc_event (t_uint64 val);
                     cac_ecc_event (gpr(rs));
+                    }
+                else if (((sa == MAGIC_MEMSET) ||       /* bulk memory op? */
+                    (sa == MAGIC_MEMCPY) || (sa == MAGIC_CSUM)) &&
+                    ((rt != 0) || (sa == MAGIC_MEMSET)) &&
+                    (rt != rs) && (rt != rd) &&
+                    (rs != 0) && (rd != 0) && (rs != rd)) {
+                    (void) mem_bulk (ctx, sa, rs, rt, rd);
                     }
 		        else {
 		            /* unknown magic instruction, ignore sa */
@@ -2469,6 +2512,17 @@ if (ctx->traps) {                                       /* traps? */
                 ((rgn == 3) && !(get_cp0_sr() & CP0_SR_KX)))
                 vec += OFF_TLB;
             else vec += OFF_XTLB;
+            if (tlb_refill_enb && !ctx->trapbit &&      /* native refill? */
+                !(get_cp0_sr() & (CP0_SR_BEV|CP0_SR_ERL)) &&
+                !(ctx->events & (EVT_BKPT|EVT_HIST)) &&
+                tlb_refill (ctx, vec)) {                /* done, as if ERET */
+                ctx->delay = 0;
+                ctx->taken = 0;
+                ctx->events &= ~EVT_NLFY;
+                ctx->traps = 0;
+                eval_intr (ctx);
+                return SCPE_OK;
+                }
             }
         }
 #ifndef _WIN32
@@ -2511,6 +2565,8 @@ if (ctx->events & EVT_STALL) {                          /* ld/sd stalled */
 if (ctx->delay) {                                       /* delay countdown? */
     if ((--ctx->delay == 0) && ctx->taken) {            /* countdown done? */
         PCQ_ENTRY;                                      /* yes, branch */
+        if (spin_enb && ((ctx->PC - ctx->delay_PC - 1) < SPIN_MAXB))
+            spin_loop (ctx);                            /* short loop back? */
         set_pc (ctx->delay_PC);
         ctx->taken = 0;
         }
@@ -2695,7 +2751,8 @@ t_stat cpu_show_virt (FILE *of, UNIT *uptr, int32 val, void *desc)
 {
 t_stat r;
 char *cptr = (char *) desc;
-t_uint64 va, pa;
+char *sym;
+t_uint64 va, pa, off;
 uint32 temp;
 
 if (cptr) {
@@ -2711,6 +2768,8 @@ if (cptr) {
         fprint_val (of, va, 16, 64, PV_LEFT);
         fputs (" = physical ", of);
         fprint_val (of, pa, 16, 64, PV_LEFT);
+        if ((sym = sim_sym_lookup (va, &off)) != NULL)
+            fprintf (of, " <%s+%llX>", sym, off);
         fputc ('\n', of);
         return SCPE_OK;
         }
@@ -2767,6 +2826,31 @@ do {
 return SCPE_OK;
 }
 
+/* Set/show native TLB refill (all cores) */
+
+t_stat cpu_set_refill (UNIT *uptr, int32 val, char *cptr, void *desc)
+{
+if (cptr != NULL) return SCPE_ARG;
+#if defined (SIMH_CPUSIMH) || defined (SIMH_EMULATION_LIBRARY)
+if (val) return SCPE_NOFNC;                             /* memory isn't in M */
+#endif
+tlb_refill_enb = val;
+return SCPE_OK;
+}
+
+t_stat cpu_show_refill (FILE *st, UNIT *uptr, int32 val, void *desc)
+{
+DEVICE *dptr;
+CORECTX *ctx;
+
+dptr = find_dev_from_unit (uptr);
+if (dptr == NULL) return SCPE_IERR;
+ctx = (CORECTX *) dptr->ctxt;
+fprintf (st, "%s, %lld native refills, %lld by guest handler",
+    tlb_refill_enb? "native refill": "no native refill", ctx->rfl_n, ctx->rfl_fb);
+return SCPE_OK;
+}
+
 /* Set history */
 
 t_stat cpu_set_hist (UNIT *uptr, int32 val, char *cptr, void *desc)
@@ -2929,7 +3013,12 @@ t_uint64 offset;
 
 dptr = (DEVICE*)malloc (sz_d = sizeof (cpu0_dev));
 uptr = (UNIT*)malloc (sz_u = sizeof (cpu0_unit));
-ctx = (CORECTX*)malloc (sz_c = sizeof (cpu0_ctx));
+sz_c = sizeof (cpu0_ctx);
+#if defined (__GNUC__) && !defined (_WIN32)
+if (posix_memalign ((void **) &ctx, CACHE_LINE, sz_c)) ctx = NULL;
+#else
+ctx = (CORECTX*)malloc (sz_c);
+#endif
 rptr = (REG*)malloc (sz_r = sizeof (cpu0_reg));
 nam = (char*)malloc (8);
 if (!dptr || !uptr || !ctx || !rptr || !nam) {
@@ -60,10 +60,14 @@
 #include "sicortex/ice9/ice9_addr_spec_sw.h"
 #endif
 
+#define CACHE_LINE      64                              /* host cache line */
+
 #ifdef __GNUC__
 #define __WEAK __attribute__ ((weak))
+#define __ALIGN_LINE __attribute__ ((aligned (CACHE_LINE)))
 #else
 #define __WEAK
+#define __ALIGN_LINE
 #endif
 
 /* Simulation parameters */
@@ -132,6 +136,15 @@
 #define SLTIU_HOOKAB  	0xAB00	                        /* MIPS assigned magic */
 #define SLTIU_HOOKAD  	0xAD00                          /* SiCortex assigned magic */
 
+/* Paravirtual bulk memory: AND rd,rs,rt with SA set to one of these.
+   rs is the address, rt the source, fill byte or running sum, and rd
+   the length; rs, rt (except for fill) and rd advance as bytes are done */
+
+#define MAGIC_MEMSET    26                              /* fill rd bytes at rs */
+#define MAGIC_MEMCPY    27                              /* copy rd bytes rt to rs */
+#define MAGIC_CSUM      28                              /* rt += csum of rd at rs */
+#define BULK_MAX        (64 * 1024)                     /* bytes per execution */
+
 /* Bit patterns */
 
 #define M8              0xFF
@@ -154,6 +167,7 @@
 #define STOP_PASS       6                               /* test done, pass */
 #define STOP_TRAP       7                               /* stop on trap */
 #define STOP_HOOK	    8				                /* simulator hooks */
+#define STOP_WATCH      9                               /* watchpoint */
 
 /* Vector bases and offsets */
 
@@ -761,25 +775,62 @@ struct Hist {
     t_uint64            rd;
     };
 
-/* Processor core context */
+/* Spin loop detection: a short backward loop whose passes change no
+   register and store nothing is parked until a line it loads is written,
+   an event is serviced or an interrupt is taken */
+
+#define SPIN_MAXB       (16 * 4)                        /* max loop length */
+#define SPIN_MAXT       64                              /* max counts per pass */
+#define SPIN_NLD        4                               /* max lines loaded */
+#define SPIN_LINE       64                              /* watch granularity */
+#define SPIN_IOPOLL     256                             /* device re-poll */
+#define SPIN_SKIP       16                              /* passes to back off */
+#define SPIN_IO         1                               /* pass read a device */
+#define SPIN_HASH       2                               /* spin_hash valid */
+
+/* Processor core context
+
+   Fields are grouped by how often cpu_one_inst touches them.  The first
+   two cache lines hold what every instruction uses (PC, events, the
+   counters, status and the mini-TLBs), followed by the integer registers.
+   CP0 state used only by exceptions and MTC0/MFC0, the CAC ECC state and
+   the PC queue and TLB arrays come after, starting on a new line, so they
+   stay out of the way.  The context is cache line aligned, so the cores'
+   hot lines are never shared when cores run on separate host threads.
+   The fields stay in one structure so that REGs, SAVE and cpu_create can
+   locate them by offset.
+*/
 
 struct core_ctx {
     t_uint64            PC;                             /* prog counter */
     t_uint64            delay_PC;                       /* delay slot PC */
     t_uint64            last_PC;                        /* previous PC */
-    t_uint64            pcq[PCQ_SIZE];
-    t_uint64            R[32];                          /* integer reg */
+    t_uint64            cp0_time;                       /* TWC9 - CP0 time */
+    t_uint64	        i_mtlb_tag;                     /* i mini-TLB */
+    t_uint64	        i_mtlb_pfn;
+    uint32              events;                         /* fetch events */
+    uint32              delay;                          /* delay slot flag */
+    uint32              taken;                          /* branch taken flag */
+    uint32              traps;                          /* traps */
+    t_uint64	        d_mtlb_tag;                     /* d mini-TLB */
+    t_uint64	        d_mtlb_pfn;
+    uint32              i_mtlb_fl;
+    uint32              d_mtlb_fl;
+    uint32              cp0_count;                      /* CP0 counter */
+    uint32              cp0_compr;                      /* CP0 compare */
+    uint32              cp0_sr;                         /* CP0 status reg */
+    uint32              irq_count;                      /* counter interrupt */
+    uint32              cpu_num;                        /* core number */
+    uint32              debug;                          /* debug flags */
+    uint32              brk_pend;                       /* scp bkpt state live */
+    uint32              trapbit;                        /* trap on trap bit */
+    uint32              fpcr;                           /* FP control reg */
+    uint32              pcq_p;                          /* PC queue ptr */
+    t_uint64            R[32] __ALIGN_LINE;             /* integer reg */
     t_uint64            F[32];                          /* floating reg */
     t_uint64            mhi;                            /* mhi */
     t_uint64            mlo;                            /* mlo */
-    REG                 *pcq_r;                         /* addr of PC queue reg */
-    struct Hist         *hist;                          /* instruction history */
-    TLBENT              tlb[TLB_LNT];                   /* TLB */
-#if (FTLB_LNT)
-    TLBENT              ftlb[FTLB_LNT*FTLB_SETS];       /* TWC9 - FTLB */
-    uint8               ftlb_lru[FTLB_LNT];             /* TWC9 - FTLB LRU */
-#endif
-    t_uint64            cp0_mask;                       /* CP0 mask */
+    t_uint64            cp0_mask __ALIGN_LINE;          /* CP0 mask */
     t_uint64            cp0_ctxt;                       /* CP0 context */
     t_uint64            cp0_xctxt;                      /* CP0 ext context */
     t_uint64            cp0_badva;                      /* CP0 bad VA */
@@ -794,25 +845,17 @@ struct core_ctx {
     t_uint64            cp0_datlo;                      /* CP0 data low */
     t_uint64            cp0_dathi;                      /* CP0 data high */
     t_uint64            cp0_desave;                     /* CP0 debug save */
-    t_uint64            cp0_time;                       /* TWC9 - CP0 time */
     t_uint64            cp0_scr0;                       /* TWC9 - CP0 scratch 0 */
     t_uint64            cp0_scr1;                       /* TWC9 - CP0 scratch 1 */
     t_uint64            cp0_perf_ad[NUM_PERF * 2];      /* TWC9 - CP0 perf addr */
     t_uint64            cac_L2EccAddr;                  /* CAC L2 error addr */
     t_uint64            cac_CSWEccAddr;                 /* CAC CSW error addr */
     t_uint64            cac_TagEccAddr;                 /* CAC tag error addr */
-    t_uint64	        d_mtlb_tag;                     /* d mini-TLB */
-    t_uint64	        d_mtlb_pfn;
-    t_uint64	        i_mtlb_tag;                     /* i mini-TLB */
-    t_uint64	        i_mtlb_pfn;
-    uint32              i_mtlb_fl;
-    uint32              d_mtlb_fl;
-    uint32              cp0_count;                      /* CP0 counter */
-    uint32              cp0_compr;                      /* CP0 compare */
+    REG                 *pcq_r;                         /* addr of PC queue reg */
+    struct Hist         *hist;                          /* instruction history */
     uint32              cp0_tlbi;                       /* CP0 TLB index */
     uint32              cp0_tlbr;                       /* CP0 TLB random */
     uint32              cp0_wired;                      /* CP0 wired */
-    uint32              cp0_sr;                         /* CP0 status reg */
     uint32              cp0_cause;                      /* CP0 cause reg */
     uint32              cp0_cnf;                        /* CP0 configuration */
     uint32              cp0_watchhi;                    /* CP0 watch high */
@@ -825,18 +868,8 @@ struct core_ctx {
     uint32              cp0_intctl;                     /* TWC9 - CP0 int ctl */
     uint32              cp0_cnf6;                       /* TWC9 - CP0 config6 */
     uint32              cp0_cnf7;                       /* TWC9 - CP0 config7 */
-    uint32              cpu_num;                        /* core number */
-    uint32              fpcr;                           /* FP control reg */
-    uint32              events;                         /* fetch events */
-    uint32              delay;                          /* delay slot flag */
-    uint32              taken;                          /* branch taken flag */
-    uint32              traps;                          /* traps */
-    uint32              trapbit;                        /* trap on trap bit */
-    uint32              debug;                          /* debug flags */
-    uint32              pcq_p;                          /* PC queue ptr */
     uint32              hst_p;                          /* history pointer */
     uint32              hst_lnt;                        /* history length */
-    uint32              irq_count;                      /* counter interrupt */
     uint32              irq_pins;                       /* core intr req pins */
     uint32              cac_slow_mask;                  /* slow interrupt mask */
     uint32              cac_slow_local;                 /* slow local interrupts */
@@ -844,7 +877,22 @@ struct core_ctx {
     uint32              cac_EccStat;                    /* CAC ECC status */
     uint32              cac_EccSynd;                    /* CAC ECC syndrome */
     uint16              cac_icr[2 * INT_N_HLVLS];       /* int req registers */
-    };
+    t_uint64            spin_pc;                        /* spin: loop head */
+    t_uint64            spin_t0;                        /* spin: pass start */
+    t_uint64            spin_hash;                      /* spin: register hash */
+    t_uint64            spin_ld[SPIN_NLD];              /* spin: lines loaded */
+    uint32              spin_nld;                       /* spin: # lines */
+    uint32              spin_fl;                        /* spin: SPIN_x flags */
+    uint32              spin_skip;                      /* spin: passes to skip */
+    t_uint64            rfl_n;                          /* native refills */
+    t_uint64            rfl_fb;                         /* refills not done */
+    t_uint64            pcq[PCQ_SIZE] __ALIGN_LINE;     /* PC queue */
+    TLBENT              tlb[TLB_LNT];                   /* TLB */
+#if (FTLB_LNT)
+    TLBENT              ftlb[FTLB_LNT*FTLB_SETS];       /* TWC9 - FTLB */
+    uint8               ftlb_lru[FTLB_LNT];             /* TWC9 - FTLB LRU */
+#endif
+    } __ALIGN_LINE;
 
 typedef struct core_ctx CORECTX;
 
@@ -987,6 +1035,48 @@ typedef struct core_ctx CORECTX;
 
 #endif /* end of if RAVEN_INTERFACE is defined */
 
+/* Breakpoint filter
+
+   Execution breakpoints are hashed by page into a per-core bitmap when
+   the simulator starts (brk_map_build); sim_brk_test is only called for
+   a PC whose bit is set.  BREAK -E stops any core; the core-scoped types
+   -Q, -R, ... stop only core 0, 1, ...
+*/
+
+#define BRK_V_PAGE      12                              /* filter page */
+#define BRK_MAP_BITS    4096                            /* bits per core */
+#define BRK_IDX(pc)     (((uint32) (((pc) >> BRK_V_PAGE) ^ ((pc) >> (BRK_V_PAGE + 12)))) & \
+                         (BRK_MAP_BITS - 1))
+#define BRK_CORE(n)     SWMASK ('Q' + (n))              /* core-scoped type */
+#define BRK_ALL_CORES   (((1u << NUM_CORES) - 1) << ('Q' - 'A'))
+#define BRK_TYPES(n)    (SWMASK ('E') | BRK_CORE (n) | ((n) << SIM_BKPT_V_SPC))
+#define BRK_MAP_HIT(m,a) (((m)[BRK_IDX (a) >> 5] >> (BRK_IDX (a) & 31)) & 1)
+#define BRK_PAGE_HIT(n,pc) BRK_MAP_HIT (brk_map[n], pc)
+
+extern uint32 brk_map[NUM_CORES][BRK_MAP_BITS / 32];
+
+/* Data watchpoints
+
+   Watched pages are marked in the same kind of page filter, one for
+   physical and one for virtual ranges; only data accesses to a marked
+   page call watch_test for the range check.
+*/
+
+#define WATCH_R         1                               /* loads */
+#define WATCH_W         2                               /* stores */
+#define WATCH_V         4                               /* range is virtual */
+#define WATCH_C         8                               /* count, don't stop */
+
+#define WATCH_CHECK(ctx,va,pa,lnt,acc) \
+    do { \
+        if (watch_n && (BRK_MAP_HIT (watch_map[0], pa) || BRK_MAP_HIT (watch_map[1], va))) \
+            watch_test (ctx, va, pa, lnt, acc); \
+        } while (0)
+
+extern uint32 watch_n;
+extern uint32 watch_map[2][BRK_MAP_BITS / 32];
+void watch_test (CORECTX *ctx, t_uint64 va, t_uint64 pa, uint32 lnt, uint32 acc);
+
 /* Register blocks */
 
 #define SC1_REG_MASK    0x3FFFFF
@@ -1026,7 +1116,8 @@ enum exceptions {
 enum events {
     EVT_V_INT,  EVT_V_WAIT,     EVT_V_BKPT,     EVT_V_HIST,
     EVT_V_NLFY, EVT_V_TSTOP,    EVT_V_STALL,    EVT_V_STALL_EPOCH,
-    EVT_V_CCHE, EVT_V_DINT,	EVT_V_DBBP
+    EVT_V_CCHE, EVT_V_DINT,	EVT_V_DBBP,     EVT_V_WATCH,
+    EVT_V_GDB,  EVT_V_SPIN,     EVT_V_SARM
     };
 
 #define TRAP_SIER       (1u << TR_V_SIER)
@@ -1061,6 +1152,22 @@ enum events {
 #define EVT_CCHE        (1u << EVT_V_CCHE)
 #define EVT_DINT        (1u << EVT_V_DINT)  		    /* external DINT asserted */
 #define EVT_DBBP        (1u << EVT_V_DBBP)  		    /* debug breakpoint executed */
+#define EVT_WATCH       (1u << EVT_V_WATCH)             /* watchpoint hit */
+#define EVT_GDB         (1u << EVT_V_GDB)               /* held by gdb (non-stop) */
+#define EVT_SPIN        (1u << EVT_V_SPIN)              /* parked in a spin loop */
+#define EVT_SARM        (1u << EVT_V_SARM)              /* watching a loop */
+
+extern uint32 spin_enb;                                 /* detection enabled */
+extern uint32 spin_watch;                               /* cores armed/parked */
+
+/* Interrupt re-evaluation: event service routines mark the cores whose
+   interrupt inputs they changed; sim_instr evaluates only those */
+
+#define INTR_ALL        ((1u << NUM_CORES) - 1)
+#define INTR_MARK(n)    intr_dirty |= (1u << (n))
+
+extern uint32 intr_dirty;
+extern void (*mem_run_hook) (t_bool run);               /* sim_instr start/stop */
 
 #define TRAP_SIMH       (TRAP_SIER)
 #define TRAP_REFILL     (TRAP_LTLBM|TRAP_STLBM)
@@ -1219,10 +1326,32 @@ t_bool lock_test (uint32 num);
 t_bool lock_clear (uint32 num);
 t_bool lock_reset (uint32 num);
 t_bool lock_set (uint32 num, t_uint64 addr, uint32 catr);
+t_bool lock_write_range (t_uint64 pa, t_uint64 len);
+void spin_loop (CORECTX *ctx);
+void spin_read (CORECTX *ctx, t_uint64 pa);
+void spin_write (CORECTX *ctx, t_uint64 pa);
+void spin_write_range (t_uint64 pa, t_uint64 len);
+void spin_event (void);
+t_bool mem_map_direct (t_uint64 low, t_uint64 size, t_uint64 *buf, t_bool wr);
+void mem_unmap_direct (t_uint64 low);
+unsigned char *mem_dir_buf (t_uint64 pa, t_uint64 len);
+void cpu_sync_scp (void);
+t_bool mem_dma_read (t_uint64 pa, void *buf, t_uint64 len);
+t_bool mem_dma_write (t_uint64 pa, const void *buf, t_uint64 len);
+void *mem_dma_pin (t_uint64 pa, t_uint64 len);
+void mem_dma_sync (t_uint64 pa, t_uint64 len);
+void mem_dma_unpin (t_uint64 pa, t_uint64 len, t_bool written);
+t_bool mem_dma_fill (t_uint64 pa, uint32 val, t_uint64 len);
+t_bool mem_dma_move (t_uint64 dst, t_uint64 src, t_uint64 len);
+t_bool mem_bulk (CORECTX *ctx, uint32 op, uint32 rs, uint32 rt, uint32 rd);
 t_bool xlate_va (CORECTX *ctx, t_uint64 va, uint32 mode, t_uint64 *pa, uint32 *catr);
+t_bool tlb_refill (CORECTX *ctx, t_uint64 pc);
 void eval_intr (CORECTX *ctx);
+void eval_intr_set (uint32 cores);
 void eval_intr_all (void);
+void eval_intr_dirty (void);
 uint32 sprint_sym_m (char *cptr, t_addr addr, uint32 inst);
+char *sim_sym_lookup (t_uint64 va, t_uint64 *off);
 __WEAK t_bool mem_cache (CORECTX *ctx, uint32 ir, t_uint64 va, uint32 hint);
 __WEAK void mem_sync (CORECTX *ctx);
 __WEAK uint32 cac_eval_intr (CORECTX *ctx);
@@ -1242,14 +1371,14 @@ __WEAK uint32 cac_eval_intr (CORECTX *ctx);
 #if defined(SIMH_EMBEDDED) && defined(CPUSIMH0_IS_1)
 #define SIMH_CPUSIMH
 
-#define CALL_READIO	ScxReadIO
+#define CALL_READIO	ScxTReadIO
 #define CALL_READPB	ScxReadPB
 #define CALL_READPH	ScxReadPH
 #define CALL_READPW	ScxReadPW
 #define CALL_READPD	ScxReadPD
 #define CALL_READPI	ScxReadPI
 
-#define CALL_WRITEIO	ScxWriteIO
+#define CALL_WRITEIO	ScxTWriteIO
 #define CALL_WRITEPB	ScxWritePB
 #define CALL_WRITEPH	ScxWritePH
 #define CALL_WRITEPW	ScxWritePW
@@ -1257,7 +1386,7 @@ __WEAK uint32 cac_eval_intr (CORECTX *ctx);
 
 #define CALL_LOAD_WRITEPB ScxWritePB
 #define CALL_LOAD_WRITEPW ScxWritePW
-#define CALL_LOAD_WRITEIO ScxWriteIO
+#define CALL_LOAD_WRITEIO ScxTWriteIO
 
 t_bool ScxReadIO (CORECTX *ctx, t_uint64 pa, t_uint64 *val, uint32 lnt);
 t_bool ScxReadPB (CORECTX *ctx, t_uint64 pa, t_uint64 *val, uint32 catr);
@@ -1274,6 +1403,11 @@ t_bool ScxWritePD (CORECTX *ctx, t_uint64 pa, t_uint64 dat, uint32 catr);
 
 t_bool ScxLockTest(uint32 num);
 
+/* I/O front ends to the above that count for the autotune (sc1_scx.c) */
+
+t_bool ScxTReadIO (CORECTX *ctx, t_uint64 pa, t_uint64 *val, uint32 lnt);
+t_bool ScxTWriteIO (CORECTX *ctx, t_uint64 pa, t_uint64 dat, uint32 lnt);
+
 #define LOCK_TEST ScxLockTest
 
 #elif defined(SIMH_EMULATION_LIBRARY)
@@ -30,6 +30,15 @@
 
 #include "sc1_defs.h"
 #include "sc1_disk.h"
+#include <sys/stat.h>
+
+#if !defined (_WIN32)
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#if defined (HAVE_ZLIB)
+#include <zlib.h>
+#endif
 
 extern t_uint64 *M;
 extern int32 sim_switches;
@@ -43,6 +52,13 @@ t_bool disk_rd (t_uint64 pa, t_uint64 *val, uint32 lnt);
 t_bool disk_wr (t_uint64 pa, t_uint64 val, uint32 lnt);
 t_stat disk_reset (DEVICE *dptr);
 t_stat disk_attach (UNIT *uptr, char *cptr);
+t_stat disk_detach (UNIT *uptr);
+t_stat disk_set_ovl (UNIT *uptr, int32 val, char *cptr, void *desc);
+t_stat disk_set_commit (UNIT *uptr, int32 val, char *cptr, void *desc);
+t_stat disk_show_ovl (FILE *st, UNIT *uptr, int32 val, void *desc);
+t_stat disk_set_compress (UNIT *uptr, int32 val, char *cptr, void *desc);
+t_stat disk_set_cache (UNIT *uptr, int32 val, char *cptr, void *desc);
+t_stat disk_show_cache (FILE *st, UNIT *uptr, int32 val, void *desc);
 
 /* DISK data structures
 
@@ -67,6 +83,9 @@ UNIT disk_unit[NDISK] =
 };
 
 DiskRegs disk_ctl;
+t_uint64 disk_chits = 0;                                /* chunk cache hits */
+t_uint64 disk_cmiss = 0;                                /* misses */
+t_uint64 disk_cra = 0;                                  /* chunks read ahead */
 
 REG disk_reg[] =
 {
@@ -80,15 +99,33 @@ REG disk_reg[] =
     { HRDATA(read_bytes, disk_ctl.read_bytes, 64) },
     { HRDATA(write_cmds, disk_ctl.write_cmds, 64) },
     { HRDATA(write_bytes, disk_ctl.write_bytes, 64) },
+    { DRDATA(cache_hits, disk_chits, 64), PV_LEFT },
+    { DRDATA(cache_misses, disk_cmiss, 64), PV_LEFT },
+    { DRDATA(read_ahead, disk_cra, 64), PV_LEFT },
     { NULL }
 };
 
+MTAB disk_mod[] =
+{
+    { MTAB_XTD|MTAB_VUN|MTAB_NMO, 0, "OVERLAY", "OVERLAY",
+      &disk_set_ovl, &disk_show_ovl },
+    { MTAB_XTD|MTAB_VUN|MTAB_NMO, 1, NULL, "COMMIT",
+      &disk_set_commit, NULL },
+    { MTAB_XTD|MTAB_VUN|MTAB_NMO, 0, NULL, "DISCARD",
+      &disk_set_commit, NULL },
+    { MTAB_XTD|MTAB_VUN|MTAB_NMO, 0, NULL, "COMPRESS",
+      &disk_set_compress, NULL },
+    { MTAB_XTD|MTAB_VDV, 0, "CACHE", "CACHE",
+      &disk_set_cache, &disk_show_cache },
+    { 0 }
+};
+
 DEVICE disk_dev =
 {
     "DISK",                         /* name */
     disk_unit,                      /* units */
     disk_reg,                       /* registers */
-    NULL,                           /* modifiers */
+    disk_mod,                       /* modifiers */
     NDISK,                          /* #units */
     16,                             /* address radix */
     64,                             /* address width */
@@ -100,7 +137,7 @@ DEVICE disk_dev =
     &disk_reset,                    /* reset routine */
     NULL,                           /* boot routine */
     &disk_attach,                   /* attach routine */
-    NULL,                           /* detach routine */
+    &disk_detach,                   /* detach routine */
     (void *) &disk_dib,             /* context */
     DEV_DIB,                        /* flags */
 #if 0
@@ -112,6 +149,902 @@ DEVICE disk_dev =
 };
 
 
+/* Overlay images
+
+   An overlay holds the blocks written since it was created and reads
+   everything else from its base, a raw image or another overlay.  The
+   base is only read, so any number of nodes can share one root image,
+   each with an overlay that grows only by the blocks it writes:
+
+        ATTACH -R DISK0 root.img
+        SET DISK0 OVERLAY=node1.ovl     create node1.ovl over root.img
+
+   Attaching an overlay file reopens its chain of bases.  SET OVERLAY on
+   an overlay adds another layer.  SET DISKn COMMIT writes the top
+   layer's blocks into its base and empties it; SET DISKn DISCARD only
+   empties it.
+
+   Format: a header of OVL_HDR bytes, little-endian
+        0       "SC1OVL" 0 1
+        8       block size (4 bytes), 4 bytes reserved
+        16      disk size (8 bytes)
+        24      base size and base modification time (8 bytes each)
+        40      base file name, zero terminated
+   then records of an 8 byte tag (OVL_TAG | block number) and the block.
+   A block written again is rewritten in place.  The block map is built
+   in memory when the overlay is attached.  All access is positional
+   (pread, pwrite), so layers never depend on file positions.
+
+   Compressed images are read-only layers, normally the base of an
+   overlay.  SET DISKn COMPRESS=file writes the attached disk, as seen
+   through any overlays, as a compressed image.  The disk is cut into
+   chunks of CMP_CHUNK bytes, each deflated (zlib, if built with
+   HAVE_ZLIB), stored as is if that doesn't help, or left out if zero.
+
+   Format: a header of CMP_HDR bytes, little-endian
+        0       "SC1CMP" 0 1
+        8       chunk size (4 bytes), 4 bytes reserved
+        16      disk size (8 bytes)
+        24      number of chunks (8 bytes)
+        32      index position (8 bytes)
+   then the chunks, then the index: the file position of each chunk and
+   of the end, with CMP_STORED set for a chunk that isn't deflated.  A
+   chunk's length is the difference between its position and the next.
+
+   Decompressed chunks are kept in one LRU cache for all units, of
+   SET DISK CACHE=n megabytes.  A miss that follows on from the last
+   chunks read is taken as sequential access, and the following chunks
+   are read with it in one transfer, twice as many each time, up to
+   CMP_RAMAX chunks in all.
+*/
+
+#define OVL_HDR         512                             /* header size */
+#define OVL_BLK         4096                            /* block size */
+#define OVL_TAG         SIM_ULL(0x5C10000000000000)     /* record tag */
+#define OVL_TAGM        SIM_ULL(0xFFFF000000000000)
+#define OVL_NAME        40                              /* base name offset */
+
+#define CMP_HDR         512                             /* header size */
+#define CMP_CHUNK       65536                           /* chunk size */
+#define CMP_MAXCS       (1u << 22)                      /* max chunk size */
+#define CMP_RAMAX       16                              /* max read ahead */
+#define CMP_STORED      SIM_ULL(0x8000000000000000)     /* not deflated */
+#define CMP_POS         SIM_ULL(0x7FFFFFFFFFFFFFFF)
+#define DC_HASH         4096                            /* cache hash size */
+
+static const uint8 ovl_magic[8] = { 'S', 'C', '1', 'O', 'V', 'L', 0, 1 };
+static const uint8 cmp_magic[8] = { 'S', 'C', '1', 'C', 'M', 'P', 0, 1 };
+
+typedef struct dsk_lyr {
+    int                 fd;                             /* file */
+    t_bool              own;                            /* fd is ours */
+    char                *path;                          /* file name */
+    t_uint64            size;                           /* disk size */
+    uint32              bs;                             /* overlay block size */
+    uint32              nblk;                           /* blocks in disk */
+    uint32              *map;                           /* record + 1, NULL = raw */
+    uint32              nrec;                           /* records */
+    uint32              cs;                             /* compressed: chunk size */
+    uint32              nchk;                           /* chunks */
+    t_uint64            *cidx;                          /* chunk index */
+    uint32              ra_next;                        /* next sequential chunk */
+    uint32              ra_win;                         /* read ahead */
+    struct dsk_lyr      *base;                          /* base layer */
+    } DSKLYR;
+
+typedef struct dsk_ce {
+    DSKLYR              *lp;                            /* image */
+    uint32              chk;                            /* chunk */
+    struct dsk_ce       *hnext;                         /* hash chain */
+    struct dsk_ce       *prev;                          /* LRU list */
+    struct dsk_ce       *next;
+    uint8               *data;                          /* chunk */
+    } DSKCE;
+
+static DSKLYR *disk_lyr[NDISK];                         /* overlay chains */
+static DSKCE *dc_hash[DC_HASH];                         /* chunk cache */
+static DSKCE *dc_mru = NULL;                            /* LRU list ends */
+static DSKCE *dc_lru = NULL;
+static t_uint64 dc_used = 0;                            /* bytes cached */
+static uint32 dc_mb = 16;                               /* cache size, MB */
+uint32 disk_discard = 0;                                /* drop writes, report ok */
+
+/* Chunk cache */
+
+static uint32 dc_hashf (DSKLYR *lp, uint32 chk)
+{
+return (uint32) ((((size_t) lp) >> 4) ^ (chk * 2654435761u)) & (DC_HASH - 1);
+}
+
+static void dc_unlink (DSKCE *ep)
+{
+DSKCE **hp;
+
+for (hp = &dc_hash[dc_hashf (ep->lp, ep->chk)]; *hp != ep; hp = &(*hp)->hnext) ;
+*hp = ep->hnext;
+if (ep->prev) ep->prev->next = ep->next;
+else dc_mru = ep->next;
+if (ep->next) ep->next->prev = ep->prev;
+else dc_lru = ep->prev;
+dc_used = dc_used - ep->lp->cs;
+free (ep->data);
+free (ep);
+return;
+}
+
+static DSKCE *dc_find (DSKLYR *lp, uint32 chk)
+{
+DSKCE *ep;
+
+for (ep = dc_hash[dc_hashf (lp, chk)]; ep != NULL; ep = ep->hnext) {
+    if ((ep->lp == lp) && (ep->chk == chk)) {
+        if (ep->prev) {                                 /* make it MRU */
+            ep->prev->next = ep->next;
+            if (ep->next) ep->next->prev = ep->prev;
+            else dc_lru = ep->prev;
+            ep->prev = NULL;
+            ep->next = dc_mru;
+            dc_mru->prev = ep;
+            dc_mru = ep;
+            }
+        return ep;
+        }
+    }
+return NULL;
+}
+
+/* New entry, most recently used; LRU entries are dropped to make room */
+
+static DSKCE *dc_insert (DSKLYR *lp, uint32 chk)
+{
+DSKCE *ep;
+uint32 h = dc_hashf (lp, chk);
+
+while (dc_lru && ((dc_used + lp->cs) > (((t_uint64) dc_mb) << 20)))
+    dc_unlink (dc_lru);
+if ((ep = (DSKCE *) calloc (1, sizeof (DSKCE))) == NULL) return NULL;
+if ((ep->data = (uint8 *) malloc (lp->cs)) == NULL) {
+    free (ep);
+    return NULL;
+    }
+ep->lp = lp;
+ep->chk = chk;
+ep->hnext = dc_hash[h];
+dc_hash[h] = ep;
+ep->next = dc_mru;
+if (dc_mru) dc_mru->prev = ep;
+else dc_lru = ep;
+dc_mru = ep;
+dc_used = dc_used + lp->cs;
+return ep;
+}
+
+/* Drop one image's chunks, or all (lp = NULL) */
+
+static void dc_drop (DSKLYR *lp)
+{
+DSKCE *ep, *np;
+
+for (ep = dc_mru; ep != NULL; ep = np) {
+    np = ep->next;
+    if ((lp == NULL) || (ep->lp == lp)) dc_unlink (ep);
+    }
+return;
+}
+
+t_stat disk_set_cache (UNIT *uptr, int32 val, char *cptr, void *desc)
+{
+uint32 n;
+t_stat r;
+
+if (cptr == NULL) return SCPE_ARG;
+n = (uint32) get_uint (cptr, 10, 65536, &r);
+if (r != SCPE_OK) return r;
+dc_mb = n;
+dc_drop (NULL);
+return SCPE_OK;
+}
+
+t_stat disk_show_cache (FILE *st, UNIT *uptr, int32 val, void *desc)
+{
+fprintf (st, "cache=%dMB, %lldKB used", dc_mb, dc_used >> 10);
+if (disk_chits + disk_cmiss) fprintf (st, ", %.1f%% hits",
+    (100.0 * (double) disk_chits) / (double) (disk_chits + disk_cmiss));
+return SCPE_OK;
+}
+
+#if defined (_WIN32)
+
+static t_stat disk_lyr_attach (UNIT *uptr)
+{
+return SCPE_OK;
+}
+
+static void dsk_close (DSKLYR *lp)
+{
+return;
+}
+
+static t_bool dsk_read (DSKLYR *lp, t_uint64 off, uint8 *buf, t_uint64 len)
+{
+return FALSE;
+}
+
+static t_bool dsk_write (DSKLYR *lp, t_uint64 off, const uint8 *buf, t_uint64 len)
+{
+return FALSE;
+}
+
+t_stat disk_set_ovl (UNIT *uptr, int32 val, char *cptr, void *desc)
+{
+return SCPE_NOFNC;
+}
+
+t_stat disk_set_commit (UNIT *uptr, int32 val, char *cptr, void *desc)
+{
+return SCPE_NOFNC;
+}
+
+t_stat disk_show_ovl (FILE *st, UNIT *uptr, int32 val, void *desc)
+{
+fprintf (st, "no overlay");
+return SCPE_OK;
+}
+
+t_stat disk_set_compress (UNIT *uptr, int32 val, char *cptr, void *desc)
+{
+return SCPE_NOFNC;
+}
+
+#else
+
+static t_uint64 ovl_get (const uint8 *p, uint32 n)
+{
+t_uint64 v = 0;
+
+while (n--) v = (v << 8) | p[n];
+return v;
+}
+
+static void ovl_put (uint8 *p, t_uint64 v, uint32 n)
+{
+uint32 i;
+
+for (i = 0; i < n; i++) p[i] = (uint8) (v >> (i * 8));
+return;
+}
+
+static t_bool dsk_pread (int fd, void *buf, size_t len, t_uint64 off)
+{
+ssize_t n;
+
+while (len) {
+    if ((n = pread (fd, buf, len, (off_t) off)) <= 0) return FALSE;
+    buf = (uint8 *) buf + n;
+    len = len - n;
+    off = off + n;
+    }
+return TRUE;
+}
+
+static t_bool dsk_pwrite (int fd, const void *buf, size_t len, t_uint64 off)
+{
+ssize_t n;
+
+while (len) {
+    if ((n = pwrite (fd, buf, len, (off_t) off)) <= 0) return FALSE;
+    buf = (const uint8 *) buf + n;
+    len = len - n;
+    off = off + n;
+    }
+return TRUE;
+}
+
+static t_uint64 ovl_rec (DSKLYR *lp, uint32 r)          /* record r position */
+{
+return OVL_HDR + ((t_uint64) r * (8 + lp->bs));
+}
+
+static void dsk_close (DSKLYR *lp)
+{
+DSKLYR *bp;
+
+for ( ; lp != NULL; lp = bp) {
+    bp = lp->base;
+    if (lp->cidx) dc_drop (lp);
+    if (lp->own) close (lp->fd);
+    free (lp->path);
+    free (lp->map);
+    free (lp->cidx);
+    free (lp);
+    }
+return;
+}
+
+/* Compressed image: check the header, load the index */
+
+static DSKLYR *cmp_open (DSKLYR *lp, const uint8 *hdr, t_uint64 len)
+{
+t_uint64 n, ipos, *ip;
+uint8 *ib;
+uint32 i;
+
+lp->cs = (uint32) ovl_get (hdr + 8, 4);
+lp->size = ovl_get (hdr + 16, 8);
+n = ovl_get (hdr + 24, 8);
+ipos = ovl_get (hdr + 32, 8);
+if ((lp->cs < 512) || (lp->cs > CMP_MAXCS) ||
+    (n != ((lp->size + lp->cs - 1) / lp->cs)) || (n > 0x7FFFFFFFu) ||
+    ((ipos + ((n + 1) * 8)) > len) ||
+    ((ib = (uint8 *) malloc ((size_t) (n + 1) * 8)) == NULL)) {
+    dsk_close (lp);
+    return NULL;
+    }
+lp->nchk = (uint32) n;
+if (((ip = (t_uint64 *) malloc ((size_t) (n + 1) * sizeof (t_uint64))) == NULL) ||
+    !dsk_pread (lp->fd, ib, (size_t) (n + 1) * 8, ipos)) {
+    free (ip);
+    free (ib);
+    dsk_close (lp);
+    return NULL;
+    }
+for (i = 0; i <= lp->nchk; i++) ip[i] = ovl_get (ib + (i * 8), 8);
+free (ib);
+lp->cidx = ip;
+for (i = 0; i < lp->nchk; i++) {                        /* sane positions? */
+    if (((ip[i] & CMP_POS) > (ip[i + 1] & CMP_POS)) ||
+        ((ip[i + 1] & CMP_POS) > ipos)) {
+        dsk_close (lp);
+        return NULL;
+        }
+    }
+return lp;
+}
+
+/* Expand chunk c of a compressed image from src into dst */
+
+static t_bool cmp_expand (DSKLYR *lp, uint32 c, const uint8 *src, uint8 *dst)
+{
+t_uint64 len = (lp->cidx[c + 1] & CMP_POS) - (lp->cidx[c] & CMP_POS);
+t_uint64 dl = lp->size - ((t_uint64) c * lp->cs);
+
+if (dl > lp->cs) dl = lp->cs;
+memset (dst, 0, lp->cs);
+if (len == 0) return TRUE;                              /* zero chunk */
+if (lp->cidx[c] & CMP_STORED) {
+    if (len != dl) return FALSE;
+    memcpy (dst, src, (size_t) len);
+    return TRUE;
+    }
+#if defined (HAVE_ZLIB)
+    {
+    uLongf zl = (uLongf) dl;
+    return (uncompress (dst, &zl, src, (uLong) len) == Z_OK) && (zl == dl);
+    }
+#else
+return FALSE;                                           /* no zlib */
+#endif
+}
+
+/* Get chunk c through the cache.  On a miss, sequential access reads
+   ahead: the following chunks not yet cached come in the same read.
+   They are inserted last first, so chunk c is never the one evicted.
+*/
+
+static uint8 *cmp_chunk (DSKLYR *lp, uint32 c)
+{
+DSKCE *ep;
+uint8 *raw;
+t_uint64 p0, p1;
+uint32 n, i;
+t_bool ok;
+
+if ((ep = dc_find (lp, c)) != NULL) {
+    disk_chits++;
+    return ep->data;
+    }
+disk_cmiss++;
+if ((c == lp->ra_next) && (lp->ra_win < CMP_RAMAX))    /* sequential? */
+    lp->ra_win = lp->ra_win? lp->ra_win << 1: 1;
+else if (c != lp->ra_next) lp->ra_win = 0;
+for (n = 1; (n <= lp->ra_win) && (n < CMP_RAMAX) &&    /* at most CMP_RAMAX */
+    ((c + n) < lp->nchk) && (dc_find (lp, c + n) == NULL); n++) ;
+if ((((t_uint64) n * lp->cs) >> 20) >= dc_mb) n = 1;    /* wouldn't fit */
+p0 = lp->cidx[c] & CMP_POS;
+p1 = lp->cidx[c + n] & CMP_POS;
+if ((raw = (uint8 *) malloc ((size_t) (p1 - p0) + 1)) == NULL) return NULL;
+if ((p1 > p0) && !dsk_pread (lp->fd, raw, (size_t) (p1 - p0), p0)) {
+    free (raw);
+    return NULL;
+    }
+for (i = n, ep = NULL, ok = TRUE; ok && (i-- > 0); ) {
+    if ((ep = dc_insert (lp, c + i)) == NULL) ok = FALSE;
+    else if (!cmp_expand (lp, c + i, raw + ((lp->cidx[c + i] & CMP_POS) - p0),
+        ep->data)) {
+        dc_unlink (ep);
+        ok = FALSE;
+        }
+    else if (i) disk_cra++;
+    }
+free (raw);
+lp->ra_next = c + n;
+return ok? ep->data: NULL;
+}
+
+/* Open a layer and its bases; fd < 0 opens path read-only.  A base that
+   isn't found where it was is looked for next to the overlay.
+*/
+
+static DSKLYR *dsk_open (const char *path, int fd)
+{
+DSKLYR *lp;
+uint8 hdr[OVL_HDR];
+char bname[OVL_HDR + CBUFSIZE];
+const char *sl, *bn;
+struct stat sb;
+t_uint64 tag, len;
+uint32 r, nr;
+
+if ((lp = (DSKLYR *) calloc (1, sizeof (DSKLYR))) == NULL) return NULL;
+if ((lp->path = (char *) malloc (strlen (path) + 1)) == NULL) {
+    free (lp);
+    return NULL;
+    }
+strcpy (lp->path, path);
+if (fd < 0) {
+    if ((fd = open (path, O_RDONLY)) < 0) {
+        dsk_close (lp);
+        return NULL;
+        }
+    lp->own = TRUE;
+    }
+lp->fd = fd;
+if (fstat (fd, &sb) != 0) {
+    dsk_close (lp);
+    return NULL;
+    }
+len = (t_uint64) sb.st_size;
+if ((len >= CMP_HDR) && dsk_pread (fd, hdr, CMP_HDR, 0) &&
+    (memcmp (hdr, cmp_magic, sizeof (cmp_magic)) == 0))
+    return cmp_open (lp, hdr, len);
+if ((len < OVL_HDR) || !dsk_pread (fd, hdr, OVL_HDR, 0) ||
+    (memcmp (hdr, ovl_magic, sizeof (ovl_magic)) != 0)) {
+    lp->size = len;                                     /* raw image */
+    return lp;
+    }
+lp->bs = (uint32) ovl_get (hdr + 8, 4);
+lp->size = ovl_get (hdr + 16, 8);
+if ((lp->bs < 512) || (lp->bs & (lp->bs - 1)) ||
+    (((lp->size + lp->bs - 1) / lp->bs) > 0xFFFFFFFEu)) {
+    dsk_close (lp);
+    return NULL;
+    }
+lp->nblk = (uint32) ((lp->size + lp->bs - 1) / lp->bs);
+if ((lp->map = (uint32 *) calloc (lp->nblk + 1, sizeof (uint32))) == NULL) {
+    dsk_close (lp);
+    return NULL;
+    }
+nr = (uint32) ((len - OVL_HDR) / (8 + lp->bs));         /* whole records */
+for (r = 0; r < nr; r++) {                              /* build the map */
+    uint8 tb[8];
+    if (!dsk_pread (fd, tb, 8, ovl_rec (lp, r))) break;
+    tag = ovl_get (tb, 8);
+    if (((tag & OVL_TAGM) != OVL_TAG) || ((tag & ~OVL_TAGM) >= lp->nblk))
+        break;
+    lp->map[tag & ~OVL_TAGM] = r + 1;
+    }
+lp->nrec = r;
+hdr[OVL_HDR - 1] = 0;
+bn = (const char *) hdr + OVL_NAME;
+lp->base = dsk_open (bn, -1);
+if ((lp->base == NULL) && (bn[0] != 0)) {               /* try overlay's dir */
+    for (sl = bn + strlen (bn); (sl > bn) && (sl[-1] != '/'); sl--) ;
+    strcpy (bname, path);
+    for (r = (uint32) strlen (bname); (r > 0) && (bname[r - 1] != '/'); r--) ;
+    strcpy (bname + r, sl);
+    lp->base = dsk_open (bname, -1);
+    }
+if (lp->base == NULL) {
+    fprintf (stderr, "%%Error: DISK: overlay %s: can't open base %s\n", path, bn);
+    dsk_close (lp);
+    return NULL;
+    }
+if ((stat (lp->base->path, &sb) != 0) ||
+    ((t_uint64) sb.st_size != ovl_get (hdr + 24, 8)) ||
+    ((t_uint64) sb.st_mtime != ovl_get (hdr + 32, 8)))
+    fprintf (stderr, "%%Warning: DISK: base %s has changed since overlay %s "
+        "was made\n", lp->base->path, path);
+return lp;
+}
+
+/* Write an overlay header for base file bpath */
+
+static t_bool ovl_header (int fd, const char *bpath, t_uint64 size, uint32 bs)
+{
+uint8 hdr[OVL_HDR];
+struct stat sb;
+
+if ((strlen (bpath) >= (OVL_HDR - OVL_NAME)) || (stat (bpath, &sb) != 0))
+    return FALSE;
+memset (hdr, 0, sizeof (hdr));
+memcpy (hdr, ovl_magic, sizeof (ovl_magic));
+ovl_put (hdr + 8, bs, 4);
+ovl_put (hdr + 16, size, 8);
+ovl_put (hdr + 24, (t_uint64) sb.st_size, 8);
+ovl_put (hdr + 32, (t_uint64) sb.st_mtime, 8);
+strcpy ((char *) hdr + OVL_NAME, bpath);
+return dsk_pwrite (fd, hdr, OVL_HDR, 0);
+}
+
+/* Read len bytes at off; beyond the end of a raw image reads zero */
+
+static t_bool dsk_read (DSKLYR *lp, t_uint64 off, uint8 *buf, t_uint64 len)
+{
+t_uint64 n, bo;
+uint32 b;
+
+if (lp->cidx) {                                         /* compressed */
+    uint8 *cp;
+    while (len) {
+        b = (uint32) (off / lp->cs);
+        bo = off % lp->cs;
+        n = lp->cs - bo;
+        if (n > len) n = len;
+        if (b >= lp->nchk) memset (buf, 0, (size_t) n);
+        else if ((cp = cmp_chunk (lp, b)) == NULL) return FALSE;
+        else memcpy (buf, cp + bo, (size_t) n);
+        off = off + n;
+        buf = buf + n;
+        len = len - n;
+        }
+    return TRUE;
+    }
+if (lp->map == NULL) {                                  /* raw */
+    n = (off < lp->size)? lp->size - off: 0;
+    if (n > len) n = len;
+    if (n && !dsk_pread (lp->fd, buf, (size_t) n, off)) return FALSE;
+    if (n < len) memset (buf + n, 0, (size_t) (len - n));
+    return TRUE;
+    }
+while (len) {
+    b = (uint32) (off / lp->bs);
+    bo = off % lp->bs;
+    n = lp->bs - bo;
+    if (n > len) n = len;
+    if ((b < lp->nblk) && lp->map[b]) {                 /* in this layer */
+        if (!dsk_pread (lp->fd, buf, (size_t) n,
+            ovl_rec (lp, lp->map[b] - 1) + 8 + bo))
+            return FALSE;
+        }
+    else if (!dsk_read (lp->base, off, buf, n)) return FALSE;
+    off = off + n;
+    buf = buf + n;
+    len = len - n;
+    }
+return TRUE;
+}
+
+/* Write len bytes at off.  A block not yet in the overlay is read from
+   the base, updated and appended as a new record.
+*/
+
+static t_bool dsk_write (DSKLYR *lp, t_uint64 off, const uint8 *buf, t_uint64 len)
+{
+uint8 *blk;
+t_uint64 n, bo;
+uint32 b;
+
+if (lp->cidx) return FALSE;                             /* compressed */
+if (lp->map == NULL)                                    /* raw */
+    return dsk_pwrite (lp->fd, buf, (size_t) len, off);
+if ((blk = (uint8 *) malloc (8 + lp->bs)) == NULL) return FALSE;
+while (len) {
+    b = (uint32) (off / lp->bs);
+    bo = off % lp->bs;
+    n = lp->bs - bo;
+    if (n > len) n = len;
+    if (b >= lp->nblk) break;
+    if (lp->map[b]) {                                   /* in place */
+        if (!dsk_pwrite (lp->fd, buf, (size_t) n,
+            ovl_rec (lp, lp->map[b] - 1) + 8 + bo))
+            break;
+        }
+    else {                                              /* new record */
+        ovl_put (blk, OVL_TAG | b, 8);
+        if ((n < lp->bs) &&
+            !dsk_read (lp->base, (t_uint64) b * lp->bs, blk + 8, lp->bs))
+            break;
+        memcpy (blk + 8 + bo, buf, (size_t) n);
+        if (!dsk_pwrite (lp->fd, blk, 8 + lp->bs, ovl_rec (lp, lp->nrec)))
+            break;
+        lp->map[b] = ++lp->nrec;
+        }
+    off = off + n;
+    buf = buf + n;
+    len = len - n;
+    }
+free (blk);
+return (len == 0);
+}
+
+/* Empty an overlay */
+
+static t_bool ovl_discard (DSKLYR *lp)
+{
+if (ftruncate (lp->fd, OVL_HDR) != 0) return FALSE;
+memset (lp->map, 0, lp->nblk * sizeof (uint32));
+lp->nrec = 0;
+return TRUE;
+}
+
+/* Attach: if the file is an overlay or compressed, open its layers */
+
+static t_stat disk_lyr_attach (UNIT *uptr)
+{
+uint32 u = (uint32) (uptr - disk_unit);
+uint8 mg[sizeof (ovl_magic)];
+int fd = fileno (uptr->fileref);
+
+if (!dsk_pread (fd, mg, sizeof (mg), 0) ||
+    ((memcmp (mg, ovl_magic, sizeof (ovl_magic)) != 0) &&
+    (memcmp (mg, cmp_magic, sizeof (cmp_magic)) != 0)))
+    return SCPE_OK;                                     /* raw image */
+if ((disk_lyr[u] = dsk_open (uptr->filename, fd)) == NULL)
+    return SCPE_OPENERR;
+uptr->capac = disk_lyr[u]->size;
+if (disk_lyr[u]->cidx) uptr->flags |= UNIT_RO;          /* compressed is read only */
+return SCPE_OK;
+}
+
+/* SET DISKn OVERLAY=file: make the attached image the base of a new
+   overlay and attach the overlay instead
+*/
+
+t_stat disk_set_ovl (UNIT *uptr, int32 val, char *cptr, void *desc)
+{
+char bpath[CBUFSIZE], *rp;
+t_uint64 size = uptr->capac;
+t_stat r;
+int fd;
+
+if ((cptr == NULL) || (*cptr == 0)) return SCPE_ARG;
+if (!(uptr->flags & UNIT_ATT)) return SCPE_UNATT;
+if ((rp = realpath (uptr->filename, NULL)) == NULL) return SCPE_OPENERR;
+strncpy (bpath, rp, CBUFSIZE - 1);
+bpath[CBUFSIZE - 1] = 0;
+free (rp);
+if ((fd = open (cptr, O_RDWR | O_CREAT | O_EXCL, 0666)) < 0) {
+    fprintf (stderr, "%%Error: DISK: can't create overlay %s\n", cptr);
+    return SCPE_OPENERR;
+    }
+if (!ovl_header (fd, bpath, size, OVL_BLK)) {
+    close (fd);
+    unlink (cptr);
+    return SCPE_IOERR;
+    }
+close (fd);
+if ((r = disk_detach (uptr)) != SCPE_OK) return r;
+sim_switches &= ~SWMASK ('R');                          /* base only is read only */
+return disk_attach (uptr, cptr);
+}
+
+/* SET DISKn COMMIT (val = 1) or DISCARD (val = 0) */
+
+t_stat disk_set_commit (UNIT *uptr, int32 val, char *cptr, void *desc)
+{
+DSKLYR *lp = disk_lyr[uptr - disk_unit], *bp;
+uint8 *blk;
+t_uint64 off, n;
+uint32 b;
+int fd, rfd;
+t_bool ok = TRUE;
+
+if (cptr) return SCPE_ARG;
+if ((lp == NULL) || (lp->map == NULL)) return SCPE_NOFNC; /* not an overlay */
+if (uptr->flags & UNIT_RO) return SCPE_RO;
+if (val) {
+    bp = lp->base;
+    if (bp->cidx) return SCPE_RO;                       /* compressed base */
+    if ((blk = (uint8 *) malloc (lp->bs)) == NULL) return SCPE_MEM;
+    if ((fd = open (bp->path, O_RDWR)) < 0) {
+        free (blk);
+        return SCPE_RO;
+        }
+    rfd = bp->fd;                                       /* writable for the */
+    bp->fd = fd;                                        /* copy only */
+    for (b = 0; ok && (b < lp->nblk); b++) {
+        if (lp->map[b] == 0) continue;
+        off = (t_uint64) b * lp->bs;
+        n = ((lp->size - off) < lp->bs)? lp->size - off: lp->bs;
+        ok = dsk_pread (lp->fd, blk, (size_t) n, ovl_rec (lp, lp->map[b] - 1) + 8) &&
+            dsk_write (bp, off, blk, n);
+        }
+    free (blk);
+    bp->fd = rfd;                                       /* base read only again */
+    if (close (fd) != 0) ok = FALSE;
+    if (!ok) return SCPE_IOERR;                         /* overlay kept */
+    if (!ovl_header (lp->fd, bp->path, lp->size, lp->bs)) return SCPE_IOERR;
+    }
+return ovl_discard (lp)? SCPE_OK: SCPE_IOERR;
+}
+
+t_stat disk_show_ovl (FILE *st, UNIT *uptr, int32 val, void *desc)
+{
+DSKLYR *lp = disk_lyr[uptr - disk_unit];
+uint32 n;
+
+if (lp == NULL) {
+    fprintf (st, "no overlay");
+    return SCPE_OK;
+    }
+for (n = 0; lp != NULL; lp = lp->base, n++) {
+    if (n) fprintf (st, "\n  over ");
+    if (lp->map) fprintf (st, "%s, %d blocks of %d (%lldKB)", lp->path,
+        lp->nrec, lp->bs, ((t_uint64) lp->nrec * lp->bs) >> 10);
+    else if (lp->cidx) fprintf (st, "%s, compressed, %lldKB in %lldKB",
+        lp->path, lp->size >> 10, (lp->cidx[lp->nchk] & CMP_POS) >> 10);
+    else fprintf (st, "%s", lp->path);
+    }
+return SCPE_OK;
+}
+
+/* SET DISKn COMPRESS=file: write the attached disk as a compressed image */
+
+t_stat disk_set_compress (UNIT *uptr, int32 val, char *cptr, void *desc)
+{
+uint8 hdr[CMP_HDR], *src, *dst, *ib;
+t_uint64 pos = CMP_HDR, off, zlen = 0;
+uint32 c, i, n, nchk, dl;
+int fd;
+t_bool ok = TRUE;
+
+if ((cptr == NULL) || (*cptr == 0)) return SCPE_ARG;
+if (!(uptr->flags & UNIT_ATT)) return SCPE_UNATT;
+nchk = (uint32) ((uptr->capac + CMP_CHUNK - 1) / CMP_CHUNK);
+#if defined (HAVE_ZLIB)
+zlen = compressBound (CMP_CHUNK);
+#endif
+src = (uint8 *) malloc (CMP_CHUNK);
+dst = (uint8 *) malloc ((size_t) zlen + 1);
+ib = (uint8 *) malloc (((size_t) nchk + 1) * 8);
+if ((src == NULL) || (dst == NULL) || (ib == NULL)) {
+    free (src);
+    free (dst);
+    free (ib);
+    return SCPE_MEM;
+    }
+if ((fd = open (cptr, O_RDWR | O_CREAT | O_EXCL, 0666)) < 0) {
+    fprintf (stderr, "%%Error: DISK: can't create %s\n", cptr);
+    free (src);
+    free (dst);
+    free (ib);
+    return SCPE_OPENERR;
+    }
+for (c = 0; ok && (c < nchk); c++) {
+    off = (t_uint64) c * CMP_CHUNK;
+    dl = ((uptr->capac - off) < CMP_CHUNK)? (uint32) (uptr->capac - off): CMP_CHUNK;
+    ok = (disk_pread (uptr, off, src, dl) == (int32) dl);
+    for (i = 0; ok && (i < dl) && (src[i] == 0); i++) ;
+    if (!ok || (i == dl)) {                             /* zero chunk */
+        ovl_put (ib + (c * 8), pos, 8);
+        continue;
+        }
+    n = dl;
+#if defined (HAVE_ZLIB)
+        {
+        uLongf zl = (uLongf) zlen;
+        if ((compress2 (dst, &zl, src, dl, 6) == Z_OK) && (zl < dl))
+            n = (uint32) zl;
+        }
+#endif
+    ovl_put (ib + (c * 8), (n == dl)? pos | CMP_STORED: pos, 8);
+    ok = dsk_pwrite (fd, (n == dl)? src: dst, n, pos);
+    pos = pos + n;
+    }
+ovl_put (ib + (nchk * 8), pos, 8);
+memset (hdr, 0, sizeof (hdr));
+memcpy (hdr, cmp_magic, sizeof (cmp_magic));
+ovl_put (hdr + 8, CMP_CHUNK, 4);
+ovl_put (hdr + 16, uptr->capac, 8);
+ovl_put (hdr + 24, nchk, 8);
+ovl_put (hdr + 32, pos, 8);
+ok = ok && dsk_pwrite (fd, ib, ((size_t) nchk + 1) * 8, pos) &&
+    dsk_pwrite (fd, hdr, CMP_HDR, 0);
+close (fd);
+free (src);
+free (dst);
+free (ib);
+if (!ok) {
+    unlink (cptr);
+    return SCPE_IOERR;
+    }
+printf ("DISK: %s, %lldKB in %lldKB\n", cptr, uptr->capac >> 10,
+    (pos + ((t_uint64) nchk + 1) * 8) >> 10);
+return SCPE_OK;
+}
+
+#endif
+
+/* Positional read of an attached image, overlay or raw; returns bytes
+   read, 0 at the end.  Used to identify images (sc1_jrnl.c).
+*/
+
+int32 disk_pread (UNIT *uptr, t_uint64 off, void *buf, uint32 len)
+{
+DSKLYR *lp = disk_lyr[uptr - disk_unit];
+
+if (!(uptr->flags & UNIT_ATT) || (off >= uptr->capac)) return 0;
+if (len > (uptr->capac - off)) len = (uint32) (uptr->capac - off);
+if (lp) return dsk_read (lp, off, (uint8 *) buf, len)? (int32) len: 0;
+if (fseek (uptr->fileref, (long) off, SEEK_SET) != 0) return 0;
+return (int32) fread (buf, 1, len, uptr->fileref);
+}
+
+/* DISK command on an overlay: as disk_docmd, through the layers */
+
+static void disk_ovl_cmd(DSKLYR *lp, DiskRegs *regs)
+{
+    t_uint64 pos = regs->diskaddress;
+    t_bool ok;
+    void *p;
+
+    if ((regs->command & (CMD_READ | CMD_WRITE))
+	&& (!PA_IS_MEM(regs->memaddress) ||
+	    !PA_IS_MEM(regs->memaddress + regs->count - 1)))
+    {
+	    regs->status = STATUS_SEEKERROR;
+	    return;
+    }
+    if (regs->command & CMD_READ)
+	{
+	    regs->read_cmds += 1;
+	    regs->read_bytes += regs->count;
+	    if ((p = mem_dma_pin(regs->memaddress, regs->count)) != NULL) {
+		ok = dsk_read(lp, pos, (uint8 *) p, regs->count);
+		mem_dma_unpin(regs->memaddress, regs->count, TRUE);
+	    } else {
+		ok = dsk_read(lp, pos, (uint8 *) &M[regs->memaddress >> 3],
+			      regs->count);
+		mem_dma_sync(regs->memaddress, regs->count);
+	    }
+	    regs->status = ok? STATUS_GOOD: STATUS_READERROR;
+	    pos += regs->count;
+	}
+    if (regs->command & CMD_WRITE)
+	{
+	    regs->write_cmds += 1;
+	    regs->write_bytes += regs->count;
+	    if (disk_discard) ok = TRUE;			/* sample worker */
+	    else if ((p = mem_dma_pin(regs->memaddress, regs->count)) != NULL) {
+		ok = dsk_write(lp, pos, (const uint8 *) p, regs->count);
+		mem_dma_unpin(regs->memaddress, regs->count, FALSE);
+	    } else
+		ok = dsk_write(lp, pos, (const uint8 *) &M[regs->memaddress >> 3],
+			       regs->count);
+	    regs->status = ok? STATUS_GOOD: STATUS_WRITEERROR;
+	    pos += regs->count;
+	}
+    if (regs->command & CMD_READBUFFER)
+	{
+	    if (regs->count > DISKBUFSIZE) regs->count = DISKBUFSIZE;
+	    regs->read_cmds += 1;
+	    regs->read_bytes += regs->count;
+	    ok = dsk_read(lp, pos, (uint8 *) &disk_ctl.buffer[0], regs->count);
+	    regs->status = ok? STATUS_GOOD: STATUS_READERROR;
+	    pos += regs->count;
+	}
+    if (regs->command & CMD_WRITEBUFFER)
+	{
+	    if (regs->count > DISKBUFSIZE) regs->count = DISKBUFSIZE;
+	    regs->write_cmds += 1;
+	    regs->write_bytes += regs->count;
+	    ok = disk_discard ||
+		dsk_write(lp, pos, (const uint8 *) &disk_ctl.buffer[0], regs->count);
+	    regs->status = ok? STATUS_GOOD: STATUS_WRITEERROR;
+	}
+    return;
+}
+
 /* DISK: stored in a file */
 
 void disk_docmd()
@@ -120,6 +1053,7 @@ void disk_docmd()
     UNIT *uptr = &disk_unit[unit];
     DiskRegs *regs = &disk_ctl;
     int32 err;
+    void *p;
 
     if (!(uptr->flags & UNIT_ATT))
     {
@@ -142,6 +1076,11 @@ void disk_docmd()
 	    regs->status = STATUS_SEEKERROR;
 	    return;
 	}
+    if (disk_lyr[unit] != NULL)
+    {
+	    disk_ovl_cmd(disk_lyr[unit], regs);
+	    return;
+    }
     err = fseek(uptr->fileref, regs->diskaddress, SEEK_SET);
     if (err < 0)
 	{
@@ -158,10 +1097,16 @@ void disk_docmd()
 	    }
 	    regs->read_cmds += 1;
 	    regs->read_bytes+=regs->count;
-	    err = sim_fread(&M[regs->memaddress >> 3], 
-			    sizeof (t_uint64), 
-			    (uint32) (regs->count >> 3),
-			    uptr->fileref);
+	    if ((p = mem_dma_pin(regs->memaddress, regs->count)) != NULL) {
+		err = sim_fread(p, 1, (uint32) regs->count, uptr->fileref);
+		mem_dma_unpin(regs->memaddress, regs->count, TRUE);
+	    } else {
+		err = sim_fread(&M[regs->memaddress >> 3], 
+				sizeof (t_uint64), 
+				(uint32) (regs->count >> 3),
+				uptr->fileref);
+		mem_dma_sync(regs->memaddress, regs->count);
+	    }
 	    if (err < 0) regs->status = STATUS_READERROR;
 	    else regs->status = STATUS_GOOD;
 	}
@@ -175,10 +1120,15 @@ void disk_docmd()
 	    }
 	    regs->write_cmds += 1;
 	    regs->write_bytes+=regs->count;
-	    err = sim_fwrite(&M[regs->memaddress >> 3], 
-			     sizeof (t_uint64), 
-			     (uint32) (regs->count >> 3),
-			     uptr->fileref);
+	    if (disk_discard) err = 0;				/* sample worker */
+	    else if ((p = mem_dma_pin(regs->memaddress, regs->count)) != NULL) {
+		err = sim_fwrite(p, 1, (uint32) regs->count, uptr->fileref);
+		mem_dma_unpin(regs->memaddress, regs->count, FALSE);
+	    } else
+		err = sim_fwrite(&M[regs->memaddress >> 3], 
+				 sizeof (t_uint64), 
+				 (uint32) (regs->count >> 3),
+				 uptr->fileref);
 	    if (err < 0) regs->status = STATUS_WRITEERROR;
 	    else regs->status = STATUS_GOOD;
 	}
@@ -198,8 +1148,9 @@ void disk_docmd()
 	    if (regs->count > DISKBUFSIZE) regs->count = DISKBUFSIZE;
 	    regs->write_cmds += 1;
 	    regs->write_bytes+=regs->count;
-	    err = sim_fwrite(&disk_ctl.buffer[0], sizeof (t_uint64), (uint32) regs->count >> 3,
-			    uptr->fileref);
+	    err = disk_discard? 0:
+		sim_fwrite(&disk_ctl.buffer[0], sizeof (t_uint64), (uint32) regs->count >> 3,
+			   uptr->fileref);
 	    if (err < 0) regs->status = STATUS_WRITEERROR;
 	    else regs->status = STATUS_GOOD;
 	}
@@ -325,7 +1276,20 @@ t_stat disk_attach (UNIT *uptr, char *cptr)
     {
 	    fseek(uptr->fileref, 0, SEEK_END);
 	    uptr->capac = ftell(uptr->fileref);
+	    if ((r = disk_lyr_attach (uptr)) != SCPE_OK)
+		detach_unit (uptr);
     }
 
     return r;
 }
+
+/* DISK detach */
+
+t_stat disk_detach (UNIT *uptr)
+{
+    uint32 u = (uint32) (uptr - disk_unit);
+
+    dsk_close (disk_lyr[u]);
+    disk_lyr[u] = NULL;
+    return detach_unit (uptr);
+}
@@ -36,3 +36,7 @@ typedef struct {
 #define DISKBASE    SIM_ULL(0xEB0000000)                     /* Disk base */
 #define DISKSIZE	(sizeof(DiskRegs))
 #define DISKAMASK 63
+
+extern uint32 disk_discard;                             /* sample worker: drop writes */
+
+int32 disk_pread (UNIT *uptr, t_uint64 off, void *buf, uint32 len);
@@ -40,6 +40,7 @@
 #include "sc1_stats.h"
 
 t_uint64 *rom = NULL;                                   /* boot ROM */
+uint32 intr_dirty = 0;                                  /* cores to re-evaluate */
 
 extern uint32 global_int;
 extern CORECTX *cpu_ctx[NUM_CORES];
@@ -165,14 +166,42 @@ else ctx->events &= ~EVT_INT;
 return;
 }
 
+/* eval_intr_set - evaluate outstanding interrupts for a set of cores
+
+   Interrupt sources call this with just the cores that can see the
+   change, so a busy device does not cost every core a full evaluation.
+*/
+
+void eval_intr_set (uint32 cores)
+{
+uint32 i;
+
+for (i = 0; cores != 0; i++, cores = cores >> 1) {
+    if (cores & 1) eval_intr (cpu_ctx[i]);
+    }
+return;
+}
+
 /* eval_intr_all - evaluate outstanding interrupts for all cores */
 
 void eval_intr_all (void)
 {
-uint32 i;
+eval_intr_set (INTR_ALL);
+return;
+}
+
+/* eval_intr_dirty - evaluate the cores marked by INTR_MARK
+
+   Event service routines mark the cores whose interrupt inputs they
+   changed; sim_instr evaluates them once after sim_process_event.
+*/
+
+void eval_intr_dirty (void)
+{
+uint32 cores = intr_dirty;
 
-for (i = 0; i < NUM_CORES; i++)
-    eval_intr (cpu_ctx[i]);
+intr_dirty = 0;
+eval_intr_set (cores);
 return;
 }
 
@@ -258,6 +287,7 @@ t_stat rom_reset (DEVICE *dptr)
 {
 if (rom == NULL) rom = (t_uint64 *) calloc (ROMSIZE >> 3, sizeof (t_uint64));
 if (rom == NULL) return SCPE_MEM;
+mem_map_direct (ROMBASE_29, ROMSIZE, rom, FALSE);       /* fetch in place */
 return SCPE_OK;
 }
 
@@ -0,0 +1,456 @@
+/* sc1_jrnl.c: SiCortex 1 input journal (record/replay)
+
+   Copyright (c) 2005, SiCortex, Inc.  All rights reserved.
+
+   Permission is hereby granted, free of charge, to any person obtaining a
+   copy of this software and associated documentation files (the "Software"),
+   to deal in the Software without restriction, including without limitation
+   the rights to use, copy, modify, merge, publish, distribute, sublicense,
+   and/or sell copies of the Software, and to permit persons to whom the
+   Software is furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+   ROBERT M SUPNIK BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+   IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+   CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+   Except as contained in this notice, the name of Robert M Supnik shall not
+   be used in advertising or otherwise to promote the sale, use or other dealings
+   in this Software without prior written authorization from Robert M Supnik.
+
+   The interleaving of the cores in sim_instr is a function of total_count
+   alone, so a run is repeatable if every input from outside the simulator
+   arrives at the same count.  Those inputs are console characters (keyboard
+   or UART socket), ethernet frames, and the contents of the disk images;
+   SNOOZE only yields the host and does not change simulated time.
+
+   SET JRNL RECORD=file logs each input with its total_count in file, and
+   writes SIMH SAVE checkpoints file.0, file.1, ... at the start and every
+   CHECKPOINT=n counts.  SET JRNL REPLAY=file feeds the logged inputs back
+   at the same counts and ignores live ones; replay starts wherever the
+   machine is, so RESTORE the nearest checkpoint first.  Disk images are
+   identified (size and hash) at record time and checked at replay time;
+   checkpoints do not include them, so attach disks read-only when a run
+   is to be replayed from a later checkpoint.
+
+   Journal format: "SC1J", version byte, starting total_count (8 bytes,
+   little-endian), then records of
+        count delta     varint
+        type            byte
+        length          varint
+        payload         length bytes
+*/
+
+#include "sc1_defs.h"
+#include "sc1_jrnl.h"
+#include "sc1_disk.h"
+
+#define JRNL_VER        1
+#define JRNL_HASHBUF    65536
+#define JRNL_HOLD       8                               /* same-count look-ahead */
+
+extern t_uint64 total_count;
+extern DEVICE disk_dev;
+t_stat sim_save (FILE *sfile);
+
+uint32 jrnl_mode = JRNL_OFF;                            /* off, rec, play */
+uint32 jrnl_ckpt_due = 0;                               /* checkpoint wanted */
+static FILE *jrnl_file = NULL;
+static char jrnl_path[CBUFSIZE];
+static t_uint64 jrnl_last = 0;                          /* last record's count */
+static int32 jrnl_intvl = 0;                            /* checkpoint interval */
+static uint32 jrnl_nckpt = 0;                           /* checkpoints taken */
+static t_uint64 jrnl_nrec = 0;                          /* records done */
+static uint32 jrnl_ntype = 0;                           /* replay: next type, 0 = eof */
+static t_uint64 jrnl_nstamp = 0;                        /* replay: next count */
+static uint32 jrnl_nlen = 0;                            /* replay: next length */
+static uint8 jrnl_nbuf[JRNL_MAXREC];                    /* replay: next payload */
+
+typedef struct {
+    uint32              type;
+    uint32              len;
+    uint8               buf[JRNL_MAXREC];
+    } JRNLREC;
+
+static JRNLREC jrnl_hold[JRNL_HOLD];                    /* replay: passed over */
+static uint32 jrnl_nhold = 0;                           /* at jrnl_hstamp */
+static t_uint64 jrnl_hstamp = 0;
+
+t_stat jrnl_svc (UNIT *uptr);
+t_stat jrnl_reset (DEVICE *dptr);
+t_stat jrnl_set_mode (UNIT *uptr, int32 val, char *cptr, void *desc);
+t_stat jrnl_set_intvl (UNIT *uptr, int32 val, char *cptr, void *desc);
+t_stat jrnl_show_intvl (FILE *st, UNIT *uptr, int32 val, void *desc);
+t_stat jrnl_show_mode (FILE *st, UNIT *uptr, int32 val, void *desc);
+
+/* JRNL data structures
+
+   jrnl_dev     JRNL device descriptor
+   jrnl_unit    JRNL unit descriptor (checkpoint timer)
+   jrnl_reg     JRNL register list
+*/
+
+UNIT jrnl_unit = { UDATA (&jrnl_svc, 0, 0) };
+
+REG jrnl_reg[] = {
+    { DRDATA (RECORDS, jrnl_nrec, 64), REG_RO },
+    { DRDATA (CKPTS, jrnl_nckpt, 32), REG_RO },
+    { NULL }
+    };
+
+MTAB jrnl_mod[] = {
+    { MTAB_XTD|MTAB_VDV|MTAB_NMO, JRNL_REC, NULL, "RECORD",
+      &jrnl_set_mode, NULL },
+    { MTAB_XTD|MTAB_VDV|MTAB_NMO, JRNL_PLAY, NULL, "REPLAY",
+      &jrnl_set_mode, NULL },
+    { MTAB_XTD|MTAB_VDV|MTAB_NMO, JRNL_OFF, NULL, "OFF",
+      &jrnl_set_mode, NULL },
+    { MTAB_XTD|MTAB_VDV, 0, "CHECKPOINT", "CHECKPOINT",
+      &jrnl_set_intvl, &jrnl_show_intvl },
+    { MTAB_XTD|MTAB_VDV, 0, "MODE", NULL,
+      NULL, &jrnl_show_mode },
+    { 0 }
+    };
+
+DEVICE jrnl_dev = {
+    "JRNL", &jrnl_unit, jrnl_reg, jrnl_mod,
+    1, 10, 31, 1, 8, 8,
+    NULL, NULL, &jrnl_reset,
+    NULL, NULL, NULL,
+    NULL, 0
+    };
+
+/* Variable-length integers, 7 bits per byte, low order first */
+
+static void jrnl_put_v (t_uint64 v)
+{
+while (v >= 0x80) {
+    fputc ((int) ((v & 0x7F) | 0x80), jrnl_file);
+    v = v >> 7;
+    }
+fputc ((int) v, jrnl_file);
+return;
+}
+
+static t_bool jrnl_get_v (t_uint64 *v)
+{
+int c;
+uint32 sh;
+
+*v = 0;
+for (sh = 0; sh < 64; sh = sh + 7) {
+    if ((c = fgetc (jrnl_file)) == EOF) return FALSE;
+    *v = *v | (((t_uint64) (c & 0x7F)) << sh);
+    if ((c & 0x80) == 0) return TRUE;
+    }
+return FALSE;
+}
+
+/* Identify a disk image by size and FNV-1a hash of its contents */
+
+static t_bool jrnl_disk_id (UNIT *uptr, uint8 *id)
+{
+static uint8 buf[JRNL_HASHBUF];
+t_uint64 size = 0, hash = SIM_ULL(0xCBF29CE484222325);
+int32 n, i;
+
+if (!(uptr->flags & UNIT_ATT) || (uptr->fileref == NULL)) return FALSE;
+while ((n = disk_pread (uptr, size, buf, sizeof (buf))) > 0) {
+    for (i = 0; i < n; i++)                             /* through overlays */
+        hash = (hash ^ buf[i]) * SIM_ULL(0x100000001B3);
+    size = size + n;
+    }
+id[0] = (uint8) (uptr - disk_dev.units);
+for (i = 0; i < 8; i++) {
+    id[1 + i] = (uint8) (size >> (i * 8));
+    id[9 + i] = (uint8) (hash >> (i * 8));
+    }
+return TRUE;
+}
+
+static void jrnl_disk_check (void)
+{
+uint8 id[17];
+uint32 u = jrnl_nbuf[0];
+
+if ((jrnl_nlen != sizeof (id)) || (u >= disk_dev.numunits)) return;
+if (!jrnl_disk_id (&disk_dev.units[u], id) ||
+    (memcmp (id, jrnl_nbuf, sizeof (id)) != 0))
+    fprintf (stderr, "%%Error: JRNL: DISK%d does not match the recorded image\n", u);
+return;
+}
+
+/* Read ahead the next input record for replay
+
+   Checkpoint marks are skipped, disk identities are checked, and records
+   older than the current count (replay starting from a checkpoint) are
+   passed over.
+*/
+
+static void jrnl_next (void)
+{
+t_uint64 delta, len;
+int c;
+
+for (;;) {
+    if (!jrnl_get_v (&delta) || ((c = fgetc (jrnl_file)) == EOF) ||
+        !jrnl_get_v (&len) || (len > JRNL_MAXREC) ||
+        (fread (jrnl_nbuf, 1, (size_t) len, jrnl_file) != len)) {
+        jrnl_ntype = 0;                                 /* end of journal */
+        return;
+        }
+    jrnl_last = jrnl_last + delta;
+    jrnl_nstamp = jrnl_last;
+    jrnl_nlen = (uint32) len;
+    jrnl_ntype = (uint32) c;
+    if (jrnl_nstamp < total_count) continue;            /* before checkpoint */
+    if (c == JRNL_CKPT) continue;
+    if (c == JRNL_DISK) {
+        jrnl_disk_check ();
+        continue;
+        }
+    return;
+    }
+}
+
+static void jrnl_close (void)
+{
+if (jrnl_file) fclose (jrnl_file);
+jrnl_file = NULL;
+jrnl_mode = JRNL_OFF;
+jrnl_ckpt_due = 0;
+jrnl_nhold = 0;
+sim_cancel (&jrnl_unit);
+return;
+}
+
+/* Log one input at the current count (record mode) */
+
+void jrnl_record (uint32 type, const void *buf, uint32 len)
+{
+if ((jrnl_mode != JRNL_REC) || (jrnl_file == NULL)) return;
+jrnl_put_v (total_count - jrnl_last);
+jrnl_last = total_count;
+fputc ((int) type, jrnl_file);
+jrnl_put_v (len);
+if (len) fwrite (buf, 1, len, jrnl_file);
+jrnl_nrec++;
+return;
+}
+
+/* Fetch the input of this type due at the current count (replay mode)
+
+   Inputs of different types at one count may be asked for in another
+   order than they were recorded in.  Records at the current count that
+   are not of the type asked for are held (up to JRNL_HOLD) until their
+   type is asked for; one still held when the count moves on means the
+   replay has diverged.
+   Outputs:
+        payload length, or -1 if nothing is due (or not replaying)
+*/
+
+static void jrnl_diverged (uint32 type, t_uint64 stamp)
+{
+fprintf (stderr, "%%Error: JRNL: replay diverged at count %lld, "
+    "type %d input was due at %lld\r\n", total_count, type, stamp);
+jrnl_close ();
+return;
+}
+
+int32 jrnl_replay (uint32 type, void *buf, uint32 max)
+{
+JRNLREC *rp;
+uint32 i, n;
+
+if (jrnl_mode != JRNL_PLAY) return -1;
+if (jrnl_nhold && (jrnl_hstamp < total_count)) {        /* held one missed? */
+    jrnl_diverged (jrnl_hold[0].type, jrnl_hstamp);
+    return -1;
+    }
+for (i = 0; i < jrnl_nhold; i++) {                      /* held for us? */
+    rp = &jrnl_hold[i];
+    if (rp->type != type) continue;
+    n = (rp->len < max)? rp->len: max;
+    memcpy (buf, rp->buf, n);
+    jrnl_nhold--;
+    memmove (rp, rp + 1, (jrnl_nhold - i) * sizeof (JRNLREC));
+    jrnl_nrec++;
+    return (int32) n;
+    }
+if (jrnl_ntype == 0) {                                  /* all used? */
+    if (jrnl_nhold) return -1;
+    printf ("JRNL: replay complete at count %lld\r\n", total_count);
+    jrnl_close ();                                      /* back to live input */
+    return -1;
+    }
+if (jrnl_nstamp < total_count) {                        /* missed one? */
+    jrnl_diverged (jrnl_ntype, jrnl_nstamp);
+    return -1;
+    }
+while ((jrnl_ntype != 0) && (jrnl_nstamp == total_count) &&
+    (jrnl_ntype != type) && (jrnl_nhold < JRNL_HOLD)) { /* look ahead */
+    rp = &jrnl_hold[jrnl_nhold++];
+    rp->type = jrnl_ntype;
+    rp->len = jrnl_nlen;
+    memcpy (rp->buf, jrnl_nbuf, jrnl_nlen);
+    jrnl_hstamp = jrnl_nstamp;
+    jrnl_next ();
+    }
+if ((jrnl_ntype == 0) || (jrnl_nstamp != total_count) ||
+    (jrnl_ntype != type)) return -1;
+n = (jrnl_nlen < max)? jrnl_nlen: max;
+memcpy (buf, jrnl_nbuf, n);
+jrnl_nrec++;
+jrnl_next ();
+return (int32) n;
+}
+
+/* Write the next checkpoint
+
+   Called from sim_instr between instructions, with the event queue in the
+   same state as at the command prompt, when the checkpoint timer is due
+   (run = TRUE); also called at the prompt at the start of recording.
+   Inside sim_instr the state scp saves is brought up to date from the
+   cores first; at the prompt scp's copy is the current one.
+*/
+
+void jrnl_checkpoint (t_bool run)
+{
+char name[CBUFSIZE + 16];
+uint8 num[4];
+FILE *sfile;
+t_stat r;
+uint32 i;
+
+jrnl_ckpt_due = 0;
+if (jrnl_mode != JRNL_REC) return;
+sprintf (name, "%s.%d", jrnl_path, jrnl_nckpt);
+if ((sfile = fopen (name, "wb")) == NULL) {
+    fprintf (stderr, "%%Error: JRNL: can't create checkpoint %s\r\n", name);
+    return;
+    }
+if (run) cpu_sync_scp ();                               /* as sim_instr exit */
+r = sim_save (sfile);
+fclose (sfile);
+if (r != SCPE_OK) {
+    fprintf (stderr, "%%Error: JRNL: checkpoint %s failed\r\n", name);
+    return;
+    }
+for (i = 0; i < 4; i++) num[i] = (uint8) (jrnl_nckpt >> (i * 8));
+jrnl_record (JRNL_CKPT, num, sizeof (num));
+jrnl_nckpt++;
+fflush (jrnl_file);
+return;
+}
+
+void jrnl_flush (void)
+{
+if (jrnl_file && (jrnl_mode == JRNL_REC)) fflush (jrnl_file);
+return;
+}
+
+/* Checkpoint timer */
+
+t_stat jrnl_svc (UNIT *uptr)
+{
+if ((jrnl_mode == JRNL_REC) && (jrnl_intvl > 0)) {
+    jrnl_ckpt_due = 1;                                  /* sim_instr saves */
+    sim_activate (uptr, jrnl_intvl);
+    }
+return SCPE_OK;
+}
+
+t_stat jrnl_reset (DEVICE *dptr)
+{
+sim_cancel (&jrnl_unit);
+if ((jrnl_mode == JRNL_REC) && (jrnl_intvl > 0))
+    sim_activate (&jrnl_unit, jrnl_intvl);
+return SCPE_OK;
+}
+
+/* SET JRNL RECORD=file, REPLAY=file, OFF */
+
+t_stat jrnl_set_mode (UNIT *uptr, int32 val, char *cptr, void *desc)
+{
+uint8 hdr[13], id[17];
+t_uint64 start;
+uint32 i;
+
+if (jrnl_mode != JRNL_OFF) jrnl_close ();
+if (val == JRNL_OFF) return SCPE_OK;
+if ((cptr == NULL) || (*cptr == 0)) return SCPE_ARG;
+if (strlen (cptr) >= sizeof (jrnl_path)) return SCPE_ARG;
+strcpy (jrnl_path, cptr);
+if (val == JRNL_REC) {
+    if ((jrnl_file = fopen (jrnl_path, "wb")) == NULL) return SCPE_OPENERR;
+    memcpy (hdr, "SC1J", 4);
+    hdr[4] = JRNL_VER;
+    for (i = 0; i < 8; i++) hdr[5 + i] = (uint8) (total_count >> (i * 8));
+    fwrite (hdr, 1, sizeof (hdr), jrnl_file);
+    jrnl_mode = JRNL_REC;
+    jrnl_last = total_count;
+    jrnl_nrec = 0;
+    jrnl_nckpt = 0;
+    for (i = 0; i < disk_dev.numunits; i++) {           /* note disk images */
+        if (jrnl_disk_id (&disk_dev.units[i], id))
+            jrnl_record (JRNL_DISK, id, sizeof (id));
+        }
+    jrnl_checkpoint (FALSE);                            /* state at start */
+    if (jrnl_intvl > 0) sim_activate (&jrnl_unit, jrnl_intvl);
+    return SCPE_OK;
+    }
+if ((jrnl_file = fopen (jrnl_path, "rb")) == NULL) return SCPE_OPENERR;
+if ((fread (hdr, 1, sizeof (hdr), jrnl_file) != sizeof (hdr)) ||
+    (memcmp (hdr, "SC1J", 4) != 0) || (hdr[4] != JRNL_VER)) {
+    fprintf (stderr, "%%Error: JRNL: %s is not a journal\n", jrnl_path);
+    jrnl_close ();
+    return SCPE_FMT;
+    }
+for (i = 0, start = 0; i < 8; i++) start |= ((t_uint64) hdr[5 + i]) << (i * 8);
+if (total_count < start)
+    fprintf (stderr, "%%Error: JRNL: journal starts at count %lld, "
+        "restore %s.0 first\n", start, jrnl_path);
+jrnl_mode = JRNL_PLAY;
+jrnl_last = start;
+jrnl_nrec = 0;
+jrnl_next ();
+return SCPE_OK;
+}
+
+/* SET JRNL CHECKPOINT=n (0 = start only) */
+
+t_stat jrnl_set_intvl (UNIT *uptr, int32 val, char *cptr, void *desc)
+{
+t_stat r;
+int32 n;
+
+if (cptr == NULL) return SCPE_ARG;
+n = (int32) get_uint (cptr, 10, 0x7FFFFFFF, &r);
+if (r != SCPE_OK) return r;
+jrnl_intvl = n;
+return jrnl_reset (&jrnl_dev);
+}
+
+t_stat jrnl_show_intvl (FILE *st, UNIT *uptr, int32 val, void *desc)
+{
+if (jrnl_intvl) fprintf (st, "checkpoint every %d", jrnl_intvl);
+else fprintf (st, "no periodic checkpoints");
+return SCPE_OK;
+}
+
+t_stat jrnl_show_mode (FILE *st, UNIT *uptr, int32 val, void *desc)
+{
+if (jrnl_mode == JRNL_REC)
+    fprintf (st, "recording to %s, %lld records, %d checkpoints",
+        jrnl_path, jrnl_nrec, jrnl_nckpt);
+else if (jrnl_mode == JRNL_PLAY)
+    fprintf (st, "replaying %s, %lld records, next at %lld",
+        jrnl_path, jrnl_nrec, jrnl_nstamp);
+else fprintf (st, "off");
+return SCPE_OK;
+}
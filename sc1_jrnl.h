@@ -0,0 +1,32 @@
+/* sc1_jrnl.h: SiCortex 1 input journal (record/replay)
+
+   Copyright (c) 2005, SiCortex, Inc.  All rights reserved.
+
+   The journal holds every input that does not come from simulated state,
+   stamped with total_count.  See sc1_jrnl.c.
+*/
+
+#ifndef _SC1_JRNL_H_
+#define _SC1_JRNL_H_    0
+
+#define JRNL_OFF        0                               /* modes */
+#define JRNL_REC        1
+#define JRNL_PLAY       2
+
+#define JRNL_KBD        1                               /* record types */
+#define JRNL_BRK        2                               /* console break */
+#define JRNL_ETH        3                               /* ethernet frame */
+#define JRNL_DISK       4                               /* disk image identity */
+#define JRNL_CKPT       5                               /* checkpoint taken */
+
+#define JRNL_MAXREC     2048                            /* max payload */
+
+extern uint32 jrnl_mode;
+extern uint32 jrnl_ckpt_due;
+
+void jrnl_record (uint32 type, const void *buf, uint32 len);
+int32 jrnl_replay (uint32 type, void *buf, uint32 max);
+void jrnl_checkpoint (t_bool run);
+void jrnl_flush (void);
+
+#endif
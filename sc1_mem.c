@@ -45,6 +45,8 @@
 #include "sc1_defs.h"
 #include "sc1_eth.h"
 #include "sc1_stats.h"
+#include "sc1_jrnl.h"
+#include "sc1_cmod.h"
 
 
 #if defined (_WIN32)
@@ -55,6 +57,7 @@
 
 /* POSIXy systems have this */
 #include <sched.h>
+#include <sys/mman.h>
 
 # ifdef SIMH_CPUSIMH
 
@@ -70,8 +73,15 @@ extern void ScxStep(unsigned int);
 
 #define UNIT_MSIZE      (1u << UNIT_V_UF)
 
+#if defined (SIMH_CPUSIMH) || defined (SIMH_EMULATION_LIBRARY)
+#define SPIN_DFLT       0                               /* refs bypass ReadP/WriteP */
+#else
+#define SPIN_DFLT       1
+#endif
+
 #ifdef SIMH_CPUSIMH
 extern t_uint64 simhLLStallCpu;
+extern t_uint64 scx_fb_stall, scx_fb_stallep, scx_fb_llretry;   /* SCX autotune */
 #endif
 
 t_uint64 *M = NULL;
@@ -84,18 +94,51 @@ uint32 global_stop = 0;
 uint32 global_int = 0;
 uint32 global_sleep = 0;
 uint32 global_stall = 0;
+uint32 mem_quantum = 1;                                 /* counts per core turn */
+static uint32 mem_lead[NUM_CORES];                      /* counts ahead after a stop */
+void (*mem_run_hook) (t_bool run) = NULL;               /* told of start/stop */
+uint32 spin_enb = SPIN_DFLT;                            /* spin detection */
+uint32 mem_share = 0;                                   /* host page merging */
+uint32 spin_watch = 0;                                  /* cores armed/parked */
+t_uint64 spin_parks = 0;                                /* times parked */
+t_uint64 spin_wakes = 0;                                /* times woken */
 CORECTX *cpu_ctx[NUM_CORES];
+uint32 brk_map[NUM_CORES][BRK_MAP_BITS / 32];           /* bkpt page filter */
+
+#define WATCH_N         16                              /* max watchpoints */
+
+typedef struct {
+    t_uint64            lo;                             /* first address */
+    t_uint64            hi;                             /* last address */
+    uint32              fl;                             /* WATCH_x */
+    t_uint64            hits[NUM_CORES];                /* hits by core */
+    } WATCHPT;
+
+static WATCHPT watch_tab[WATCH_N];
+uint32 watch_n = 0;                                     /* watchpoints set */
+uint32 watch_map[2][BRK_MAP_BITS / 32];                 /* phys, virt filter */
+char sc1_stop_watch[128];                               /* stop message */
 
 extern uint32 sim_brk_types, sim_brk_dflt, sim_brk_summ;
+extern BRKTAB *sim_brk_tab;
+extern int32 sim_brk_ent;
 extern int32 sim_interval, sim_int_char, sim_switches;
 extern FILE *sim_log;
 
 t_bool lock_write (t_uint64 addr);
 t_stat cpu_report_err (t_stat r0, t_stat r1, DEVICE *dptr, CORECTX *ctx);
+static t_bool brk_map_build (uint32 num);
+static t_stat sim_quantum (t_bool *cpu_enb, DEVICE **dev_list, uint32 num_enab);
 t_stat mem_reset (DEVICE *dptr);
 t_stat mem_ex (t_value *vptr, t_addr addr, UNIT *uptr, int32 sw);
 t_stat mem_dep (t_value vptr, t_addr addr, UNIT *uptr, int32 sw);
 t_stat mem_set_size (UNIT *uptr, int32 val, char *cptr, void *desc);
+t_stat mem_set_watch (UNIT *uptr, int32 val, char *cptr, void *desc);
+t_stat mem_show_watch (FILE *st, UNIT *uptr, int32 val, void *desc);
+t_stat mem_set_share (UNIT *uptr, int32 val, char *cptr, void *desc);
+t_stat mem_show_share (FILE *st, UNIT *uptr, int32 val, void *desc);
+static t_uint64 *mem_alloc (t_uint64 sz);
+static void mem_free (t_uint64 *p, t_uint64 sz);
 
 extern t_stat cpu_create (uint32 i);
 extern t_stat cpu_one_inst (CORECTX *ctx);
@@ -115,6 +158,10 @@ REG mem_reg[] = {
     { HRDATA (LOCK_FLAGS, global_lock, NUM_CORES) },
     { BRDATA (LOCK_ADDR, lock_addr, 16, 64, NUM_CORES) },
     { DRDATA (GCOUNT, total_count, 64) },
+    { DRDATA (QUANTUM, mem_quantum, 16), REG_NZ + PV_LEFT },
+    { FLDATA (SPIN, spin_enb, 0) },
+    { DRDATA (SPINPARK, spin_parks, 64), PV_LEFT },
+    { DRDATA (SPINWAKE, spin_wakes, 64), PV_LEFT },
     { HRDATA (STOP, global_stop, 16) },
     { HRDATA (WRU, sim_int_char, 8) },
     { NULL }
@@ -129,6 +176,16 @@ MTAB mem_mod[] = {
     { UNIT_MSIZE, (1u << 29), NULL, "512M", &mem_set_size },
     { UNIT_MSIZE, (1u << 30), NULL, "1024M", &mem_set_size },
     { UNIT_MSIZE, (1u << 31), NULL, "2048M", &mem_set_size },
+    { MTAB_XTD|MTAB_VDV, 0, "WATCH", "WATCH",
+      &mem_set_watch, &mem_show_watch },
+    { MTAB_XTD|MTAB_VDV, 1, NULL, "NOWATCH",
+      &mem_set_watch, NULL },
+    { MTAB_XTD|MTAB_VDV, 1, NULL, "SHARE",
+      &mem_set_share, NULL },
+    { MTAB_XTD|MTAB_VDV, 0, NULL, "NOSHARE",
+      &mem_set_share, NULL },
+    { MTAB_XTD|MTAB_VDV|MTAB_NMO, 0, "SHARING", NULL,
+      NULL, &mem_show_share },
     { 0 }
     };
 
@@ -148,7 +205,6 @@ t_stat sim_instr (void)
 t_stat reason, r1;
 uint32 i, num_enab;
 t_bool cpu_enb[NUM_CORES];
-CORECTX *ctx;
 DEVICE *dptr, *dev_list[NUM_CORES];
 char cname[NUM_CORES]; 
 
@@ -169,17 +225,29 @@ char cname[NUM_CORES];
         if (cpu_ctx[i]->hst_lnt || (cpu_ctx[i]->debug & TRAP_SIMTRC))
             cpu_ctx[i]->events |= EVT_HIST;
         else cpu_ctx[i]->events &= ~EVT_HIST;
-        if (sim_brk_summ) cpu_ctx[i]->events |= EVT_BKPT;
+        if (brk_map_build (i)) cpu_ctx[i]->events |= EVT_BKPT;
         else cpu_ctx[i]->events &= ~EVT_BKPT;
+        cpu_ctx[i]->events &= ~(EVT_SPIN|EVT_SARM);     /* nobody parked */
+        cpu_ctx[i]->spin_skip = 0;
         cname[3]++;
         }
+    spin_watch = 0;
+    if (mem_quantum <= 1)                               /* lock step: can't */
+        memset (mem_lead, 0, sizeof (mem_lead));        /* catch up */
+    if (mem_run_hook) mem_run_hook (TRUE);              /* e.g. fabric peers */
 
     reason = 0;        
     while (reason == 0) {                               /* loop until halted */
 
         if (sim_interval <= 0) {                        /* check clock queue */
             if ((reason = sim_process_event ())) break;
-            eval_intr_all ();
+            if (spin_watch) spin_event ();              /* parked cores look again */
+            if (jrnl_ckpt_due) jrnl_checkpoint (TRUE);  /* journal checkpoint */
+            if (intr_dirty) eval_intr_dirty ();         /* sources changed? */
+            }
+        if (mem_quantum > 1) {                          /* cores take turns? */
+            reason = sim_quantum (cpu_enb, dev_list, num_enab);
+            continue;
             }
         sim_interval = sim_interval - 1;
         global_sleep = 0;
@@ -191,22 +259,258 @@ char cname[NUM_CORES];
 	        if (cpu_enb[i] && (r1 = cpu_one_inst (cpu_ctx[i])))
 		        reason = cpu_report_err (reason, r1, dev_list[i], cpu_ctx[i]);
 	        }
+#ifdef SIMH_CPUSIMH
+        scx_fb_stall += global_stall;
+#endif
         if ((global_sleep == num_enab) ||               /* everyone napping? */
             (global_stall == num_enab)) {
             SNOOZE;
             }
         }                                               /* end while */
 
-    for (i = 0; i < NUM_CORES; i++) {
-        ctx = cpu_ctx[i];
-        dptr = dev_list[i];
-        dptr->dctrl = ctx->debug;
-        ctx->pcq_r->qptr = ctx->pcq_p;                  /* update pc q ptr */
-        }
+    if (cmod_wrk) cmod_wrk_done ();                     /* sample worker ends */
+    if (mem_run_hook) mem_run_hook (FALSE);
+    jrnl_flush ();
+    cpu_sync_scp ();
 global_stop = reason;
 return reason;
 }
 
+/* Bring the state scp sees up to date from the core contexts: debug
+   flags and PC queue pointers.  Done when sim_instr returns, and before
+   a journal checkpoint saves the machine from inside it. */
+
+void cpu_sync_scp (void)
+{
+uint32 i;
+DEVICE *dptr;
+char cname[8];
+
+strcpy (cname, "CPU0");
+for (i = 0; i < NUM_CORES; i++, cname[3]++) {
+    if ((dptr = find_dev (cname)) != NULL)
+        dptr->dctrl = cpu_ctx[i]->debug;
+    cpu_ctx[i]->pcq_r->qptr = cpu_ctx[i]->pcq_p;        /* update pc q ptr */
+    }
+return;
+}
+
+/* Run the cores in turn, each for up to mem_quantum counts.
+
+   Every core starts its turn from the same total_count and advances it
+   once per instruction, so time as each core sees it is the same as in
+   lock step; only the interleaving of memory references between cores
+   is coarser.  The turn is cut short at the next event, so device
+   service routines run at the same counts.  Device activity started
+   during a turn is timed from the start of the turn.
+
+   If a core stops, the turn ends at the count it stopped on: the cores
+   after it run only up to that count, and total_count is left there.
+   The cores before it have already run further, so each is left ahead
+   by up to mem_quantum - 1 counts (mem_lead), unlike lock step, where
+   all cores stop on the same count.  While stopped, those cores' Count
+   registers and the instructions they have executed reflect the later
+   count.  On the next turn a core that is ahead runs only up to the
+   turn's end, so the cores are back in step after one turn.
+*/
+
+static t_stat sim_quantum (t_bool *cpu_enb, DEVICE **dev_list, uint32 num_enab)
+{
+t_uint64 base = total_count, end, ran = 0;
+t_stat reason = SCPE_OK, r1;
+uint32 i, k;
+
+k = mem_quantum;                                        /* counts this turn */
+if ((int32) k > sim_interval) k = (sim_interval > 0)? sim_interval: 1;
+end = base + k;
+global_sleep = 0;
+global_stall = 0;
+for (i = 0; i < NUM_CORES; i++) {
+    if (i && !cpu_enb[i]) {                             /* core 0 always runs */
+        mem_lead[i] = 0;
+        continue;
+        }
+    for (total_count = base + mem_lead[i]; total_count < end; ) {
+        total_count++;
+        ran++;
+        if ((r1 = cpu_one_inst (cpu_ctx[i]))) {
+            reason = i? cpu_report_err (reason, r1, dev_list[i], cpu_ctx[i]): r1;
+            end = total_count;                          /* turn ends here */
+            break;
+            }
+        }
+    mem_lead[i] = (uint32) (total_count - base);        /* reached, for now */
+    }
+for (i = 0; i < NUM_CORES; i++)                         /* ahead of the end? */
+    mem_lead[i] = (mem_lead[i] > (end - base))? mem_lead[i] - (uint32) (end - base): 0;
+total_count = end;
+sim_interval = sim_interval - (int32) (end - base);
+#ifdef SIMH_CPUSIMH
+scx_fb_stall += global_stall;
+#endif
+if ((global_sleep == ran) ||                            /* everyone napping? */
+    (global_stall == ran)) {
+    SNOOZE;
+    }
+return reason;
+}
+
+/* Build the breakpoint filter for core num
+
+   Breakpoints can only change at the command prompt, so the filter is
+   rebuilt on every entry to sim_instr.  brk_pend is set so the first PC
+   that misses the filter still goes to sim_brk_test once, letting scp
+   forget the breakpoint it may just have stopped on.
+   Outputs:
+        TRUE if the core has any breakpoint
+*/
+
+static t_bool brk_map_build (uint32 num)
+{
+int32 i;
+uint32 bx, n = 0;
+BRKTAB *bp;
+
+memset (brk_map[num], 0, sizeof (brk_map[num]));
+cpu_ctx[num]->brk_pend = 1;
+if (sim_brk_summ == 0) return FALSE;
+for (i = 0; i < sim_brk_ent; i++) {
+    bp = &sim_brk_tab[i];
+    if ((bp->typ & (SWMASK ('E') | BRK_CORE (num))) == 0) continue;
+    bx = BRK_IDX ((t_uint64) bp->addr);
+    brk_map[num][bx >> 5] |= 1u << (bx & 31);
+    n++;
+    }
+return (n != 0);
+}
+
+/* Check a data access to a watched page
+
+   Called from the virtual read/write routines, after translation, for
+   accesses whose page is marked in watch_map.  Every watchpoint the
+   access overlaps is counted against the core; unless it is count-only,
+   the core stops after the instruction completes.
+*/
+
+void watch_test (CORECTX *ctx, t_uint64 va, t_uint64 pa, uint32 lnt, uint32 acc)
+{
+uint32 i;
+t_uint64 a;
+WATCHPT *wp;
+
+for (i = 0; i < watch_n; i++) {
+    wp = &watch_tab[i];
+    if ((wp->fl & acc) == 0) continue;
+    a = (wp->fl & WATCH_V)? va: pa;
+    if ((a + lnt - 1 < wp->lo) || (a > wp->hi)) continue;
+    wp->hits[ctx->cpu_num]++;
+    if (wp->fl & WATCH_C) continue;
+    sprintf (sc1_stop_watch, "Watchpoint %d, core %d %s VA %llX PA %llX, PC %llX",
+        i, ctx->cpu_num, (acc == WATCH_W)? "write": "read", va, pa, ctx->last_PC);
+    ctx->events |= EVT_WATCH;
+    }
+return;
+}
+
+/* Rebuild the watch page filters */
+
+static void watch_map_build (void)
+{
+uint32 i, bx;
+t_uint64 pg, npg;
+WATCHPT *wp;
+
+memset (watch_map, 0, sizeof (watch_map));
+for (i = 0; i < watch_n; i++) {
+    wp = &watch_tab[i];
+    npg = (wp->hi >> BRK_V_PAGE) - (wp->lo >> BRK_V_PAGE) + 1;
+    if (npg >= BRK_MAP_BITS) {                          /* covers every bit */
+        memset (watch_map[(wp->fl & WATCH_V)? 1: 0], 0xFF, sizeof (watch_map[0]));
+        continue;
+        }
+    for (pg = wp->lo >> BRK_V_PAGE; npg != 0; pg++, npg--) {
+        bx = BRK_IDX (pg << BRK_V_PAGE);
+        watch_map[(wp->fl & WATCH_V)? 1: 0][bx >> 5] |= 1u << (bx & 31);
+        }
+    }
+return;
+}
+
+/* SET MEM WATCH=lo[-hi][;flags], SET MEM NOWATCH[=n]
+
+   flags are any of R (loads), W (stores, the default), V (lo and hi are
+   virtual addresses, else physical), and C (count hits, don't stop).
+*/
+
+t_stat mem_set_watch (UNIT *uptr, int32 val, char *cptr, void *desc)
+{
+WATCHPT *wp;
+char *ep;
+uint32 n;
+
+if (val) {                                              /* NOWATCH */
+    if ((cptr == NULL) || (*cptr == 0)) watch_n = 0;
+    else {
+        n = (uint32) strtoul (cptr, &ep, 10);
+        if ((ep == cptr) || *ep || (n >= watch_n)) return SCPE_ARG;
+        for ( ; (n + 1) < watch_n; n++) watch_tab[n] = watch_tab[n + 1];
+        watch_n--;
+        }
+    watch_map_build ();
+    return SCPE_OK;
+    }
+if ((cptr == NULL) || (*cptr == 0)) return SCPE_ARG;
+if (watch_n >= WATCH_N) return SCPE_MEM;
+wp = &watch_tab[watch_n];
+memset (wp, 0, sizeof (WATCHPT));
+wp->lo = strtoull (cptr, &ep, 16);
+if (ep == cptr) return SCPE_ARG;
+wp->hi = wp->lo;
+if (*ep == '-') {
+    cptr = ep + 1;
+    wp->hi = strtoull (cptr, &ep, 16);
+    if ((ep == cptr) || (wp->hi < wp->lo)) return SCPE_ARG;
+    }
+if (*ep == ';') {
+    for (ep++; *ep; ep++) {
+        switch (*ep) {
+            case 'R': wp->fl |= WATCH_R; break;
+            case 'W': wp->fl |= WATCH_W; break;
+            case 'V': wp->fl |= WATCH_V; break;
+            case 'C': wp->fl |= WATCH_C; break;
+            default: return SCPE_ARG;
+            }
+        }
+    }
+if (*ep) return SCPE_ARG;
+if ((wp->fl & (WATCH_R|WATCH_W)) == 0) wp->fl |= WATCH_W;
+watch_n++;
+watch_map_build ();
+return SCPE_OK;
+}
+
+t_stat mem_show_watch (FILE *st, UNIT *uptr, int32 val, void *desc)
+{
+uint32 i, j;
+WATCHPT *wp;
+
+if (watch_n == 0) {
+    fprintf (st, "no watchpoints");
+    return SCPE_OK;
+    }
+fprintf (st, "watchpoints");
+for (i = 0; i < watch_n; i++) {
+    wp = &watch_tab[i];
+    fprintf (st, "\n%2d: %s %llX-%llX %s%s%s, hits", i,
+        (wp->fl & WATCH_V)? "VA": "PA", wp->lo, wp->hi,
+        (wp->fl & WATCH_R)? "R": "", (wp->fl & WATCH_W)? "W": "",
+        (wp->fl & WATCH_C)? " count": "");
+    for (j = 0; j < NUM_CORES; j++)
+        fprintf (st, " %lld", wp->hits[j]);
+    }
+return SCPE_OK;
+}
+
 /* Stop code from non-primary core */
 
 t_stat cpu_report_err (t_stat r0, t_stat r1, DEVICE *dptr, CORECTX *ctx)
@@ -223,18 +527,114 @@ if (sim_log) {
 return r0;
 }
 
+/* Direct regions
+
+   Simple backing-store devices (boot ROM, NVR) register their host
+   buffer here.  Loads and instruction fetches that miss main memory try
+   this short table before the sim_devices scan in ReadIO; stores do too
+   unless the region is read-only, so ROM stores still go through rom_wr.
+   Accesses are counted as I/O by the STATS hooks, as before.
+*/
+
+#define MEM_NDIR        4                               /* max regions */
+
+typedef struct {
+    t_uint64    low;                                    /* base pa */
+    t_uint64    size;                                   /* length */
+    t_uint64    *buf;                                   /* backing store */
+    t_bool      wr;                                     /* stores direct */
+    } MEMDIR;
+
+static MEMDIR mem_dir[MEM_NDIR];
+static uint32 mem_ndir = 0;
+
+t_bool mem_map_direct (t_uint64 low, t_uint64 size, t_uint64 *buf, t_bool wr)
+{
+uint32 i;
+
+for (i = 0; i < mem_ndir; i++) {                        /* remap? */
+    if (mem_dir[i].low == low) break;
+    }
+if (i >= MEM_NDIR) return FALSE;
+mem_dir[i].low = low;
+mem_dir[i].size = size;
+mem_dir[i].buf = buf;
+mem_dir[i].wr = wr;
+if (i == mem_ndir) mem_ndir++;
+return TRUE;
+}
+
+void mem_unmap_direct (t_uint64 low)
+{
+uint32 i;
+
+for (i = 0; i < mem_ndir; i++) {
+    if (mem_dir[i].low == low) {
+        mem_dir[i] = mem_dir[--mem_ndir];
+        return;
+        }
+    }
+return;
+}
+
+/* Loader access: the host bytes behind [pa, pa + len), if they all lie in
+   one region, read-only or not.  NULL otherwise.
+*/
+
+unsigned char *mem_dir_buf (t_uint64 pa, t_uint64 len)
+{
+uint32 i;
+
+for (i = 0; i < mem_ndir; i++) {
+    if (((pa - mem_dir[i].low) < mem_dir[i].size) &&
+        (len <= (mem_dir[i].size - (pa - mem_dir[i].low))))
+        return ((unsigned char *) mem_dir[i].buf) + (pa - mem_dir[i].low);
+    }
+return NULL;
+}
+
+static t_uint64 *mem_dir_rd (t_uint64 pa)
+{
+uint32 i;
+
+for (i = 0; i < mem_ndir; i++) {
+    if ((pa - mem_dir[i].low) < mem_dir[i].size)
+        return &mem_dir[i].buf[(pa - mem_dir[i].low) >> 3];
+    }
+return NULL;
+}
+
+static t_uint64 *mem_dir_wr (t_uint64 pa)
+{
+uint32 i;
+
+for (i = 0; i < mem_ndir; i++) {
+    if ((pa - mem_dir[i].low) < mem_dir[i].size)
+        return mem_dir[i].wr? &mem_dir[i].buf[(pa - mem_dir[i].low) >> 3]: NULL;
+    }
+return NULL;
+}
+
 /* Memory read routines */
 
 t_bool ReadPB (CORECTX *ctx, t_uint64 pa, t_uint64 *val, uint32 catr)
 {
 uint32 sc;
+t_uint64 *wp;
 
+if (ctx->events & EVT_SARM) spin_read (ctx, pa);
 if (PA_IS_MEM (pa)) {
     sc = (((uint32) pa) & 7) << 3;
     *val = (M[pa >> 3] >> sc) & M8;
     STATS_READPB(ctx, pa, *val, catr);
     return TRUE;
     }
+if ((wp = mem_dir_rd (pa)) != NULL) {
+    sc = (((uint32) pa) & 7) << 3;
+    *val = (*wp >> sc) & M8;
+    STATS_READIO(ctx, pa, *val, L_BYTE);
+    return TRUE;
+    }
 if (CALL_READIO (ctx, pa, val, L_BYTE)) return TRUE;
 ctx->traps |= TRAP_DBE;
 return FALSE;
@@ -243,13 +643,21 @@ return FALSE;
 t_bool ReadPH (CORECTX *ctx, t_uint64 pa, t_uint64 *val, uint32 catr)
 {
 uint32 sc;
+t_uint64 *wp;
 
+if (ctx->events & EVT_SARM) spin_read (ctx, pa);
 if (PA_IS_MEM (pa)) {
     sc = (((uint32) pa) & 6) << 3;
     *val = (M[pa >> 3] >> sc) & M16;
     STATS_READPH(ctx, pa, *val, catr);
     return TRUE;
     }
+if ((wp = mem_dir_rd (pa)) != NULL) {
+    sc = (((uint32) pa) & 6) << 3;
+    *val = (*wp >> sc) & M16;
+    STATS_READIO(ctx, pa, *val, L_HALF);
+    return TRUE;
+    }
 if (CALL_READIO (ctx, pa, val, L_HALF)) return TRUE;
 ctx->traps |= TRAP_DBE;
 return FALSE;
@@ -257,12 +665,21 @@ return FALSE;
 
 t_bool ReadPW (CORECTX *ctx, t_uint64 pa, t_uint64 *val, uint32 catr)
 {
+t_uint64 *wp;
+
+if (ctx->events & EVT_SARM) spin_read (ctx, pa);
 if (PA_IS_MEM (pa)) {
     if (pa & 4) *val = (M[pa >> 3] >> 32) & M32;
     else *val = M[pa >> 3] & M32;
     STATS_READPW(ctx, pa, *val, catr);
     return TRUE;
     }
+if ((wp = mem_dir_rd (pa)) != NULL) {
+    if (pa & 4) *val = (*wp >> 32) & M32;
+    else *val = *wp & M32;
+    STATS_READIO(ctx, pa, *val, L_WORD);
+    return TRUE;
+    }
 if (CALL_READIO (ctx, pa, val, L_WORD)) return TRUE;
 ctx->traps |= TRAP_DBE;
 return FALSE;
@@ -270,11 +687,19 @@ return FALSE;
 
 t_bool ReadPD (CORECTX *ctx, t_uint64 pa, t_uint64 *val, uint32 catr)
 {
+t_uint64 *wp;
+
+if (ctx->events & EVT_SARM) spin_read (ctx, pa);
 if (PA_IS_MEM (pa)) {
     *val = M[pa >> 3];
     STATS_READPD(ctx, pa, *val, catr);
     return TRUE;
     }
+if ((wp = mem_dir_rd (pa)) != NULL) {
+    *val = *wp;
+    STATS_READIO(ctx, pa, *val, L_DOUB);
+    return TRUE;
+    }
 if (CALL_READIO (ctx, pa, val, L_DOUB)) return TRUE;
 ctx->traps |= TRAP_DBE;
 return FALSE;
@@ -284,12 +709,20 @@ return FALSE;
 
 t_bool ReadPI (CORECTX *ctx, t_uint64 pa, t_uint64 *val, uint32 catr)
 {
+t_uint64 *wp;
+
 if (PA_IS_MEM (pa)) {
     if (pa & 4) *val = (M[pa >> 3] >> 32) & M32;
     else *val = M[pa >> 3] & M32;
     STATS_READPI(ctx, pa, *val, catr);
     return TRUE;
     }
+if ((wp = mem_dir_rd (pa)) != NULL) {
+    if (pa & 4) *val = (*wp >> 32) & M32;
+    else *val = *wp & M32;
+    STATS_READIO(ctx, pa, *val, L_WORD);
+    return TRUE;
+    }
 if (CALL_READIO (ctx, pa, val, L_WORD)) return TRUE;
 ctx->traps |= TRAP_IBE;
 return FALSE;
@@ -301,8 +734,10 @@ t_stat WritePB (CORECTX *ctx, t_uint64 pa, t_uint64 dat, uint32 catr)
 {
 uint32 sc;
 t_uint64 mask;
+t_uint64 *wp;
 
 if (global_lock) lock_write (pa);
+if (spin_watch) spin_write (ctx, pa);
 if (PA_IS_MEM (pa)) {
     sc = (((uint32) pa) & 7) << 3;
     mask = ((t_uint64) M8) << sc;
@@ -310,6 +745,13 @@ if (PA_IS_MEM (pa)) {
     STATS_WRITEPB(ctx, pa, dat, catr);
     return TRUE;
     }
+if ((wp = mem_dir_wr (pa)) != NULL) {
+    sc = (((uint32) pa) & 7) << 3;
+    mask = ((t_uint64) M8) << sc;
+    *wp = (*wp & ~mask) | ((dat << sc) & mask);
+    STATS_WRITEIO(ctx, pa, dat, L_BYTE);
+    return TRUE;
+    }
 if (CALL_WRITEIO (ctx, pa, dat, L_BYTE)) return TRUE;
 ctx->traps |= TRAP_DBE;
 return FALSE;
@@ -319,8 +761,10 @@ t_stat WritePH (CORECTX *ctx, t_uint64 pa, t_uint64 dat, uint32 catr)
 {
 uint32 sc;
 t_uint64 mask;
+t_uint64 *wp;
 
 if (global_lock) lock_write (pa);
+if (spin_watch) spin_write (ctx, pa);
 if (PA_IS_MEM (pa)) {
     sc = (((uint32) pa) & 6) << 3;
     mask = ((t_uint64) M16) << sc;
@@ -328,6 +772,13 @@ if (PA_IS_MEM (pa)) {
     STATS_WRITEPH(ctx, pa, dat, catr);
     return TRUE;
     }
+if ((wp = mem_dir_wr (pa)) != NULL) {
+    sc = (((uint32) pa) & 6) << 3;
+    mask = ((t_uint64) M16) << sc;
+    *wp = (*wp & ~mask) | ((dat << sc) & mask);
+    STATS_WRITEIO(ctx, pa, dat, L_HALF);
+    return TRUE;
+    }
 if (CALL_WRITEIO (ctx, pa, dat, L_HALF)) return TRUE;
 ctx->traps |= TRAP_DBE;
 return FALSE;
@@ -335,7 +786,10 @@ return FALSE;
 
 t_stat WritePW (CORECTX *ctx, t_uint64 pa, t_uint64 dat, uint32 catr)
 {
+t_uint64 *wp;
+
 if (global_lock) lock_write (pa);
+if (spin_watch) spin_write (ctx, pa);
 if (PA_IS_MEM (pa)) {
     if (pa & 4) M[pa >> 3] = (M[pa >> 3] & M32) |
         (dat << 32);
@@ -343,6 +797,12 @@ if (PA_IS_MEM (pa)) {
     STATS_WRITEPW(ctx, pa, dat, catr);
     return TRUE;
     }
+if ((wp = mem_dir_wr (pa)) != NULL) {
+    if (pa & 4) *wp = (*wp & M32) | (dat << 32);
+    else *wp = (*wp & ~((t_uint64) M32)) | (dat & M32);
+    STATS_WRITEIO(ctx, pa, dat, L_WORD);
+    return TRUE;
+    }
 if (CALL_WRITEIO (ctx, pa, dat, L_WORD)) return TRUE;
 ctx->traps |= TRAP_DBE;
 return FALSE;
@@ -350,21 +810,31 @@ return FALSE;
 
 t_stat WritePD (CORECTX *ctx, t_uint64 pa, t_uint64 dat, uint32 catr)
 {
+t_uint64 *wp;
+
 if (global_lock) lock_write (pa);
+if (spin_watch) spin_write (ctx, pa);
 if (PA_IS_MEM (pa)) {
     M[pa >> 3] = dat;
     STATS_WRITEPD(ctx, pa, dat, catr);
     return TRUE;
     }
+if ((wp = mem_dir_wr (pa)) != NULL) {
+    *wp = dat;
+    STATS_WRITEIO(ctx, pa, dat, L_DOUB);
+    return TRUE;
+    }
 if (CALL_WRITEIO (ctx, pa, dat, L_DOUB)) return TRUE;
 ctx->traps |= TRAP_DBE;
 return FALSE;
 }
 
-/* Prefetch, cache, and synchronization routines - stubs for now */
+/* Prefetch, cache, and synchronization routines - memory is coherent,
+   so these only inform the cache timing model */
 
 void mem_pref (CORECTX *ctx, t_uint64 pa, uint32 catr, uint32 hint)
 {
+if (PA_IS_MEM (pa)) CMOD_REF (ctx, pa, catr, CMOD_PREF);
 return;
 }
 
@@ -375,6 +845,8 @@ t_uint64 pa;
 
 if (Q_MD_U32) va = SEXT_W_D (va);
 if (!xlate_va (ctx, va, VA_DR, &pa, &catr)) return FALSE; 
+if (cmod_on && PA_IS_MEM (pa) && !CA_UNCACHED (catr))
+    cmod_cache (ctx, pa, hint);
 return TRUE;
 }
 
@@ -426,9 +898,11 @@ if (num < NUM_CORES) {
     if (lock_last[num] == addr) {
 	lock_try[num]++;
 #ifdef SIMH_CPUSIMH
+        scx_fb_llretry++;
         if (simhLLStallCpu && (lock_try[num] == simhLLStallCpu)) {
 	    fprintf (stderr, "SIMH: %dth ll to same address causing stall until end of epoch\n", (int)(simhLLStallCpu));
 	    cpu_ctx[num]->events |= EVT_STALL_EPOCH;
+	    scx_fb_stallep++;
 	    lock_try[num] = 0;
         }
 #endif
@@ -460,6 +934,392 @@ for (i = 0; i < NUM_CORES; i++) {
 return TRUE;
 }
 
+/* Break every reservation inside [pa, pa + len), in one pass */
+
+t_bool lock_write_range (t_uint64 pa, t_uint64 len)
+{
+uint32 i;
+
+for (i = 0; i < NUM_CORES; i++) {
+    if (((global_lock >> i) & 1) &&
+        (lock_addr[i] >= (pa & ~((t_uint64) 7))) && (lock_addr[i] < (pa + len))) {
+        global_lock &= ~(1u << i);
+        lock_addr[i] = 0;
+        }
+    }
+return TRUE;
+}
+
+/* Spin loop detection
+
+   A core busy-waiting on memory (a lock, a flag, a mailbox) runs the same
+   few instructions over and over without changing anything.  Each taken
+   branch back over no more than SPIN_MAXB bytes calls spin_loop with the
+   loop head in delay_PC.  The first time, the core is armed: spin_read
+   records the lines it loads (up to SPIN_NLD) and spin_write disarms it
+   if it stores.  If a pass completes within SPIN_MAXT counts, the
+   registers are hashed; if the next pass is also clean and leaves the
+   same hash, the loop can't make progress until one of those lines
+   changes, and the core is parked (EVT_SPIN).
+
+   A parked core does no work in cpu_one_inst, but time passes for it as
+   usual, so CP0 Count and Compare interrupts are unaffected.  It is woken
+   by a write to a line it loaded, from another core or from DMA, by any
+   event service (devices may change memory directly), or by an interrupt.
+   A loop that polls a device register is re-run every SPIN_IOPOLL counts,
+   or at once if a core writes to IO space.  A loop that fails the test is
+   left alone for SPIN_SKIP passes, so busy loops that do real work pay
+   little.  Detection is off while breakpoints, watchpoints or history are
+   active, and every sim_instr starts with all cores unparked.
+*/
+
+static void spin_disarm (CORECTX *ctx, uint32 skip)
+{
+ctx->events &= ~(EVT_SPIN|EVT_SARM);
+spin_watch &= ~(1u << ctx->cpu_num);
+ctx->spin_skip = skip;
+return;
+}
+
+static t_uint64 spin_hash (CORECTX *ctx)
+{
+t_uint64 h = ctx->fpcr;
+uint32 i;
+
+for (i = 0; i < 32; i++)
+    h = ((h << 7) | (h >> 57)) ^ ctx->R[i] ^ (ctx->F[i] * 0x9E3779B97F4A7C15ull);
+return h ^ ctx->mhi ^ (ctx->mlo << 1);
+}
+
+void spin_loop (CORECTX *ctx)
+{
+t_uint64 h, now = get_cp0_time ();
+
+if (ctx->spin_skip) {                                   /* backing off? */
+    ctx->spin_skip--;
+    return;
+    }
+if ((ctx->events & (EVT_BKPT|EVT_HIST)) || watch_n) return;
+if ((ctx->events & EVT_SARM) && (ctx->spin_pc == ctx->delay_PC)) {
+    if ((now - ctx->spin_t0) > SPIN_MAXT) {             /* pass too long? */
+        spin_disarm (ctx, SPIN_SKIP);
+        return;
+        }
+    h = spin_hash (ctx);
+    if (ctx->spin_fl & SPIN_HASH) {                     /* have last pass? */
+        if (h != ctx->spin_hash) {                      /* making progress */
+            spin_disarm (ctx, SPIN_SKIP);
+            return;
+            }
+        ctx->events = (ctx->events & ~EVT_SARM) | EVT_SPIN;
+        ctx->spin_t0 = now;                             /* park */
+        spin_parks++;
+        return;
+        }
+    ctx->spin_hash = h;                                 /* first clean pass */
+    ctx->spin_fl = SPIN_HASH;
+    }
+else {                                                  /* new loop, arm */
+    ctx->spin_pc = ctx->delay_PC;
+    ctx->spin_fl = 0;
+    ctx->events |= EVT_SARM;
+    spin_watch |= (1u << ctx->cpu_num);
+    }
+ctx->spin_nld = 0;                                      /* start a pass */
+ctx->spin_t0 = now;
+return;
+}
+
+/* Record a load by an armed core */
+
+void spin_read (CORECTX *ctx, t_uint64 pa)
+{
+t_uint64 ln = pa & ~((t_uint64) (SPIN_LINE - 1));
+uint32 i;
+
+if (!PA_IS_MEM (pa)) {                                  /* device register */
+    ctx->spin_fl |= SPIN_IO;
+    return;
+    }
+for (i = 0; i < ctx->spin_nld; i++) {
+    if (ctx->spin_ld[i] == ln) return;
+    }
+if (i >= SPIN_NLD) spin_disarm (ctx, SPIN_SKIP);        /* too many lines */
+else ctx->spin_ld[ctx->spin_nld++] = ln;
+return;
+}
+
+/* Wake (or restart the pass of) cores whose lines [lo, hi] were written */
+
+static void spin_hit (CORECTX *src, t_uint64 lo, t_uint64 hi, t_bool io)
+{
+uint32 i, j, w;
+t_bool hit;
+CORECTX *ctx;
+
+for (i = 0, w = spin_watch; w != 0; i++, w = w >> 1) {
+    if ((w & 1) == 0) continue;
+    ctx = cpu_ctx[i];
+    if (!(ctx->events & (EVT_SPIN|EVT_SARM))) {         /* left by interrupt */
+        spin_watch &= ~(1u << i);
+        continue;
+        }
+    if (ctx == src) {                                   /* own store */
+        spin_disarm (ctx, SPIN_SKIP);
+        continue;
+        }
+    if (io) hit = (ctx->spin_fl & SPIN_IO) != 0;
+    else for (j = 0, hit = FALSE; (j < ctx->spin_nld) && !hit; j++)
+        hit = (ctx->spin_ld[j] >= lo) && (ctx->spin_ld[j] <= hi);
+    if (hit) {
+        if (ctx->events & EVT_SPIN) spin_wakes++;
+        spin_disarm (ctx, 0);
+        }
+    }
+return;
+}
+
+void spin_write (CORECTX *ctx, t_uint64 pa)
+{
+t_uint64 ln = pa & ~((t_uint64) (SPIN_LINE - 1));
+
+spin_hit (ctx, ln, ln, !PA_IS_MEM (pa));
+return;
+}
+
+void spin_write_range (t_uint64 pa, t_uint64 len)
+{
+if (len) spin_hit (NULL, pa & ~((t_uint64) (SPIN_LINE - 1)), pa + len - 1, FALSE);
+return;
+}
+
+/* Event service may have changed anything; wake every parked core */
+
+void spin_event (void)
+{
+uint32 i, w;
+
+for (i = 0, w = spin_watch; w != 0; i++, w = w >> 1) {
+    if ((w & 1) && (cpu_ctx[i]->events & EVT_SPIN)) {
+        spin_wakes++;
+        spin_disarm (cpu_ctx[i], 0);
+        }
+    }
+return;
+}
+
+/* Bulk DMA to and from main memory
+
+   Device models move guest data with these instead of going through
+   the ReadP/WriteP routines a word at a time.  A transfer must lie
+   entirely in main memory; it is copied with memcpy and, for writes,
+   all load reservations in the range are broken in one pass.  Guest
+   memory is little endian, so the image in M is only byte addressable
+   on a little-endian host; on other hosts, and with SIMH_CPUSIMH where
+   main memory lives in the System-C model, everything here declines
+   and the caller falls back to per-word CALL_READPx/WRITEPx.
+   Outputs:
+        TRUE if done, FALSE if the caller must fall back
+
+   mem_dma_pin returns a host pointer to a range of guest memory, or
+   NULL if the caller must copy instead.  A device that writes through
+   a pinned pointer calls mem_dma_unpin (or mem_dma_sync while it keeps
+   the pin) with written = TRUE so reservations are broken.  Memory
+   can't be resized while anything is pinned.
+
+   mem_dma_fill and mem_dma_move set and copy ranges in place, for the
+   paravirtual bulk memory operations (see mem_bulk).
+*/
+
+static uint32 mem_dma_pins = 0;                         /* active pins */
+
+static t_bool mem_dma_range (t_uint64 pa, t_uint64 len)
+{
+extern int32 sim_end;
+
+#ifdef SIMH_CPUSIMH
+return FALSE;
+#else
+return (M != NULL) && sim_end && PA_IS_MEM (pa) && (len <= (MEMSIZE - pa));
+#endif
+}
+
+t_bool mem_dma_read (t_uint64 pa, void *buf, t_uint64 len)
+{
+if (len == 0) return TRUE;
+if (!mem_dma_range (pa, len)) return FALSE;
+memcpy (buf, ((unsigned char *) M) + pa, (size_t) len);
+return TRUE;
+}
+
+t_bool mem_dma_write (t_uint64 pa, const void *buf, t_uint64 len)
+{
+if (len == 0) return TRUE;
+if (!mem_dma_range (pa, len)) return FALSE;
+memcpy (((unsigned char *) M) + pa, buf, (size_t) len);
+if (global_lock) lock_write_range (pa, len);
+if (spin_watch) spin_write_range (pa, len);
+return TRUE;
+}
+
+void *mem_dma_pin (t_uint64 pa, t_uint64 len)
+{
+if ((len == 0) || !mem_dma_range (pa, len)) return NULL;
+mem_dma_pins++;
+return ((unsigned char *) M) + pa;
+}
+
+void mem_dma_sync (t_uint64 pa, t_uint64 len)
+{
+if (global_lock) lock_write_range (pa, len);
+if (spin_watch) spin_write_range (pa, len);
+}
+
+void mem_dma_unpin (t_uint64 pa, t_uint64 len, t_bool written)
+{
+if (written) mem_dma_sync (pa, len);
+if (mem_dma_pins) mem_dma_pins--;
+}
+
+t_bool mem_dma_fill (t_uint64 pa, uint32 val, t_uint64 len)
+{
+if (len == 0) return TRUE;
+if (!mem_dma_range (pa, len)) return FALSE;
+memset (((unsigned char *) M) + pa, (int) (val & M8), (size_t) len);
+mem_dma_sync (pa, len);
+return TRUE;
+}
+
+t_bool mem_dma_move (t_uint64 dst, t_uint64 src, t_uint64 len)
+{
+if (len == 0) return TRUE;
+if (!mem_dma_range (dst, len) || !mem_dma_range (src, len)) return FALSE;
+memmove (((unsigned char *) M) + dst, ((unsigned char *) M) + src, (size_t) len);
+mem_dma_sync (dst, len);
+return TRUE;
+}
+
+/* Memory allocation and page sharing
+
+   Memory is mapped anonymous and page aligned rather than taken from the
+   heap.  With SET MEM SHARE, it is also marked mergeable, so the host
+   (KSM on Linux) can back identical pages with one copy, across every
+   simulator process on the host: nodes running the same kernel, libc and
+   application image, REGRESS and CMOD workers, machines restored from
+   the same snapshot.  The first store to a shared page takes a host
+   copy-on-write fault, so the ReadP* and WriteP* paths are unchanged and
+   pay nothing.  The host must have KSM running (/sys/kernel/mm/ksm/run).
+
+   SHOW MEM SHARING reports what the host has merged, and the zero and
+   duplicate pages in this machine's memory, which is what merging could
+   save here even without KSM.
+*/
+
+#define MEM_PGSIZE      4096                            /* host page */
+
+static t_uint64 *mem_alloc (t_uint64 sz)
+{
+#if defined (MADV_MERGEABLE)
+void *p;
+
+p = mmap (NULL, (size_t) sz, PROT_READ | PROT_WRITE,
+    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+if (p == MAP_FAILED) return NULL;
+if (mem_share) madvise (p, (size_t) sz, MADV_MERGEABLE);
+return (t_uint64 *) p;
+#else
+return (t_uint64 *) calloc ((size_t) (sz >> 3), sizeof (t_uint64));
+#endif
+}
+
+static void mem_free (t_uint64 *p, t_uint64 sz)
+{
+if (p == NULL) return;
+#if defined (MADV_MERGEABLE)
+munmap ((void *) p, (size_t) sz);
+#else
+free (p);
+#endif
+return;
+}
+
+t_stat mem_set_share (UNIT *uptr, int32 val, char *cptr, void *desc)
+{
+#if defined (MADV_MERGEABLE)
+if (cptr) return SCPE_ARG;
+if ((uint32) val == mem_share) return SCPE_OK;          /* no change */
+if (M && madvise ((void *) M, (size_t) MEMSIZE,
+    val? MADV_MERGEABLE: MADV_UNMERGEABLE) && val)
+    return SCPE_NOFNC;                                  /* no KSM in host */
+mem_share = val;
+return SCPE_OK;
+#else
+return val? SCPE_NOFNC: SCPE_OK;
+#endif
+}
+
+static t_bool mem_get_num (const char *fname, t_uint64 *v)
+{
+FILE *fp;
+unsigned long long n;
+int k;
+
+if ((fp = fopen (fname, "r")) == NULL) return FALSE;
+k = fscanf (fp, "%llu", &n);
+fclose (fp);
+*v = n;
+return (k == 1);
+}
+
+static int mem_cmp_hash (const void *a, const void *b)
+{
+t_uint64 x = *(const t_uint64 *) a, y = *(const t_uint64 *) b;
+
+return (x < y)? -1: (x > y);
+}
+
+t_stat mem_show_share (FILE *st, UNIT *uptr, int32 val, void *desc)
+{
+t_uint64 *hash, h, zh = 0, pg, npg, nzero, ndup, run, shd, shg, mrg;
+uint32 i;
+
+fprintf (st, "sharing %s", mem_share? "on": "off");
+if (mem_get_num ("/sys/kernel/mm/ksm/run", &run)) {
+    fprintf (st, ", host KSM %s", (run == 1)? "running": "stopped");
+    if (mem_get_num ("/sys/kernel/mm/ksm/pages_shared", &shd) &&
+        mem_get_num ("/sys/kernel/mm/ksm/pages_sharing", &shg))
+        fprintf (st, ", %lld pages shared by %lld on host", shd, shg);
+    if (mem_get_num ("/proc/self/ksm_merging_pages", &mrg))
+        fprintf (st, ", %lld of this node's merged", mrg);
+    }
+if (M == NULL) return SCPE_OK;
+npg = MEMSIZE / MEM_PGSIZE;
+if ((hash = (t_uint64 *) malloc ((size_t) npg * sizeof (t_uint64))) == NULL)
+    return SCPE_MEM;
+for (pg = nzero = 0; pg < npg; pg++) {                  /* hash each page */
+    t_uint64 *wp = M + (pg * (MEM_PGSIZE >> 3)), acc = 0;
+    for (i = 0, h = SIM_ULL(0xCBF29CE484222325); i < (MEM_PGSIZE >> 3); i++) {
+        acc = acc | wp[i];
+        h = (h ^ wp[i]) * SIM_ULL(0x100000001B3);
+        h = h ^ (h >> 29);
+        }
+    if (acc == 0) {
+        nzero++;
+        zh = h;
+        }
+    hash[pg] = h;
+    }
+qsort (hash, (size_t) npg, sizeof (t_uint64), &mem_cmp_hash);
+for (pg = 1, ndup = 0; pg < npg; pg++) {                /* repeats of a page */
+    if ((hash[pg] == hash[pg - 1]) && (!nzero || (hash[pg] != zh))) ndup++;
+    }
+free (hash);
+fprintf (st, "\n%lld pages: %lld zero, %lld duplicates of others, "
+    "%lld MB could be shared", npg, nzero, ndup,
+    (((nzero? nzero - 1: 0) + ndup) * MEM_PGSIZE) >> 20);
+return SCPE_OK;
+}
+
 #ifdef SIMH_CPUSIMH
 
 /* Memory reset */
@@ -471,11 +1331,13 @@ t_stat mem_reset (DEVICE *dptr)
     int32 i;
     t_stat r;
 
-    sim_brk_types = sim_brk_dflt = SWMASK ('E');
+    sim_brk_types = SWMASK ('E') | BRK_ALL_CORES;
+    sim_brk_dflt = SWMASK ('E');
     global_lock = 0;
+    memset (mem_lead, 0, sizeof (mem_lead));
 
     if (M == NULL && simhMem) {
-        M = (t_uint64 *) calloc ((uint32) (mem_unit.capac >> 3), sizeof (t_uint64));
+        M = mem_alloc (mem_unit.capac);
         if (M == NULL) return SCPE_MEM;
     }
 
@@ -495,17 +1357,21 @@ t_stat mem_set_size (UNIT *uptr, int32 val, char *cptr, void *desc)
     t_uint64 *nM = NULL;
 
     if ((val == 0) || (val & 0xFFFFFF)) return SCPE_ARG;
+    if (mem_dma_pins) {
+        fprintf (stderr, "%%Error: MEM: memory is pinned by a device\n");
+        return SCPE_NOFNC;
+    }
 
     if (simhMem) {
         sz = val;
         for (i = sz; i < MEMSIZE; i = i + 8) mc = mc | M[i >> 3];
         if ((mc != 0) && !get_yn ("Really truncate memory [N]?", FALSE))
             return SCPE_OK;
-        nM = (t_uint64 *) calloc ((uint32) (sz >> 3), sizeof (t_uint64));
+        nM = mem_alloc (sz);
         if (nM == NULL) return SCPE_MEM;
         clim = (sz < MEMSIZE)? sz: MEMSIZE;
         for (i = 0; i < clim; i = i + 8) nM[i >> 3] = M[i >> 3];
-        free (M);
+        mem_free (M, MEMSIZE);
         M = nM;
     }
 
@@ -522,10 +1388,11 @@ t_stat mem_reset (DEVICE *dptr)
 int32 i;
 t_stat r;
 
-sim_brk_types = sim_brk_dflt = SWMASK ('E');
+sim_brk_types = SWMASK ('E') | BRK_ALL_CORES;
+sim_brk_dflt = SWMASK ('E');
 global_lock = 0;
 if (M == NULL) {
-    M = (t_uint64 *) calloc ((uint32) (mem_unit.capac >> 3), sizeof (t_uint64));
+    M = mem_alloc (mem_unit.capac);
     if (M == NULL) return SCPE_MEM;
     for (i = 1; i < NUM_CORES; i++) {
         if ((r = cpu_create (i))) return r;
@@ -544,6 +1411,10 @@ t_uint64 i, clim, mc = 0, sz;
 t_uint64 *nM = NULL;
 
 if ((val == 0) || (val & 0xFFFFFF)) return SCPE_ARG;
+if (mem_dma_pins) {
+    fprintf (stderr, "%%Error: MEM: memory is pinned by a device\n");
+    return SCPE_NOFNC;
+    }
 sz = (uint32) val; // don't you dare sign extend me
 if (sz > (1ULL << 32)) {
     fprintf (stderr, "%%Error: int32 vs uint64 rounding bug. now memory is going to be %lld MB!\n", sz/1024/1024);
@@ -551,11 +1422,11 @@ if (sz > (1ULL << 32)) {
 for (i = sz; i < MEMSIZE; i = i + 8) mc = mc | M[i >> 3];
 if ((mc != 0) && !get_yn ("Really truncate memory [N]?", FALSE))
     return SCPE_OK;
-nM = (t_uint64 *) calloc ((uint32) (sz >> 3), sizeof (t_uint64));
+nM = mem_alloc (sz);
 if (nM == NULL) return SCPE_MEM;
 clim = (sz < MEMSIZE)? sz: MEMSIZE;
 for (i = 0; i < clim; i = i + 8) nM[i >> 3] = M[i >> 3];
-free (M);
+mem_free (M, MEMSIZE);
 M = nM;
 MEMSIZE = sz;
 return SCPE_OK;
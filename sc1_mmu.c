@@ -46,6 +46,8 @@
 
         ReadB,H,W,D     -       read aligned virtual
         WriteB,H,W,D    -       write aligned virtual
+        mem_bulk        -       paravirtual bulk memory operations
+        tlb_refill      -       native TLB refill
 
    The TLB is comprised of these fields:
 
@@ -83,6 +85,7 @@ extern void counter_wr_count (CORECTX *ctx, t_uint64 val);
 extern void counter_wr_compr (CORECTX *ctx, t_uint64 val);
 
 extern t_uint64 total_count;
+extern t_uint64 *M;
 extern UNIT mem_unit;
 
 /* Enable uncached access check unless told otherwise */
@@ -113,6 +116,7 @@ uint32 catr;
 
 if (Q_MD_U32) va = SEXT_W_D (va);
 if (!xlate_va (ctx, va, VA_DR, &pa, &catr)) return FALSE;
+WATCH_CHECK (ctx, va, pa, 1, WATCH_R);
 return CALL_READPB (ctx, pa, val, catr);
 }
 
@@ -124,6 +128,7 @@ uint32 catr;
 if (Q_MD_U32) va = SEXT_W_D (va);
 if (va & 1) return tlb_set_aer (ctx, va, VA_DR);
 if (!xlate_va (ctx, va, VA_DR, &pa, &catr)) return FALSE;
+WATCH_CHECK (ctx, va, pa, 2, WATCH_R);
 return CALL_READPH (ctx, pa, val, catr);
 }
 
@@ -135,6 +140,7 @@ uint32 catr;
 if (Q_MD_U32) va = SEXT_W_D (va);
 if (va & 3) return tlb_set_aer (ctx, va, VA_DR);
 if (!xlate_va (ctx, va, VA_DR, &pa, &catr)) return FALSE;
+WATCH_CHECK (ctx, va, pa, 4, WATCH_R);
 return CALL_READPW (ctx, pa, val, catr);
 }
 
@@ -146,6 +152,7 @@ uint32 catr;
 if (Q_MD_U32) va = SEXT_W_D (va);
 if (va & 7) return tlb_set_aer (ctx, va, VA_DR);
 if (!xlate_va (ctx, va, VA_DR, &pa, &catr)) return FALSE;
+WATCH_CHECK (ctx, va, pa, 8, WATCH_R);
 return CALL_READPD (ctx, pa, val, catr);
 }
 
@@ -176,6 +183,7 @@ uint32 catr;
 
 if (Q_MD_U32) va = SEXT_W_D (va);
 if (!xlate_va (ctx, va, VA_DW, &pa, &catr)) return FALSE;
+WATCH_CHECK (ctx, va, pa, 1, WATCH_W);
 return CALL_WRITEPB (ctx, pa, val, catr);
 }
 
@@ -187,6 +195,7 @@ uint32 catr;
 if (Q_MD_U32) va = SEXT_W_D (va);
 if (va & 1) return tlb_set_aer (ctx, va, VA_DW);
 if (!xlate_va (ctx, va, VA_DW, &pa, &catr)) return FALSE;
+WATCH_CHECK (ctx, va, pa, 2, WATCH_W);
 return CALL_WRITEPH (ctx, pa, val, catr);
 }
 
@@ -198,6 +207,7 @@ uint32 catr;
 if (Q_MD_U32) va = SEXT_W_D (va);
 if (va & 3) return tlb_set_aer (ctx, va, VA_DW);
 if (!xlate_va (ctx, va, VA_DW, &pa, &catr)) return FALSE;
+WATCH_CHECK (ctx, va, pa, 4, WATCH_W);
 return CALL_WRITEPW (ctx, pa, val, catr);
 }
 
@@ -209,6 +219,7 @@ uint32 catr;
 if (Q_MD_U32) va = SEXT_W_D (va);
 if (va & 7) return tlb_set_aer (ctx, va, VA_DW);
 if (!xlate_va (ctx, va, VA_DW, &pa, &catr)) return FALSE;
+WATCH_CHECK (ctx, va, pa, 8, WATCH_W);
 return CALL_WRITEPD (ctx, pa, val, catr);
 }
 
@@ -222,6 +233,109 @@ uint32 catr;
 return xlate_va (ctx, va, VA_DW, &pa, &catr); 
 }
 
+/* Paravirtual bulk memory operations
+
+   AND rd,rs,rt with SA = MAGIC_MEMSET, MAGIC_MEMCPY or MAGIC_CSUM lets a
+   patched guest zero, copy or checksum memory in one instruction:
+
+        MEMSET  rd bytes at VA rs are set to rt<7:0>
+        MEMCPY  rd bytes at VA rt are copied to VA rs (no overlap)
+        CSUM    rd bytes at VA rs are added into rt, as little-endian
+                halfwords at even addresses, in 32b one's complement
+
+   The ranges are processed a page at a time.  Each page is translated
+   with the usual protection checks, and writes break reservations and
+   wake parked spinners.  After each piece, rs, rt (MEMCPY) and rd are
+   advanced, so a TLB exception leaves the operation ready to resume
+   where it stopped.  At most BULK_MAX bytes are done per execution; if
+   more remain, the instruction is executed again, so interrupts and
+   events are not held off.  rd = 0 when done; for CSUM, rt holds the
+   sign-extended sum.  An instruction in a delay slot can't be executed
+   again on its own, so there the operation takes a reserved
+   instruction exception instead.
+
+   Inputs:
+        ctx     =       context
+        op      =       MAGIC_x
+        rs,rt,rd =      register numbers, distinct and nonzero (rt
+                        may be R0 for MEMSET)
+   Outputs:
+        TRUE if ok, FALSE if abort
+*/
+
+t_bool mem_bulk (CORECTX *ctx, uint32 op, uint32 rs, uint32 rt, uint32 rd)
+{
+t_uint64 va, sva, pa, spa, n, i, t, sum, left;
+uint32 catr, scatr;
+uint8 *p;
+
+if (ctx->delay) {                                       /* can't resume */
+    ctx->traps |= TRAP_RSVI;
+    return FALSE;
+    }
+left = BULK_MAX;                                        /* bytes this time */
+sum = ctx->R[rt] & M32;
+while ((ctx->R[rd] != 0) && (left != 0)) {
+    va = ctx->R[rs];
+    if (Q_MD_U32) va = SEXT_W_D (va);
+    n = VA_M_OFF + 1 - (va & VA_M_OFF);                 /* to end of page */
+    if (n > ctx->R[rd]) n = ctx->R[rd];
+    if (n > left) n = left;
+    if (!xlate_va (ctx, va, (op == MAGIC_CSUM)? VA_DR: VA_DW, &pa, &catr))
+        return FALSE;
+    WATCH_CHECK (ctx, va, pa, (uint32) n, (op == MAGIC_CSUM)? WATCH_R: WATCH_W);
+    switch (op) {
+
+    case MAGIC_MEMSET:
+        if (mem_dma_fill (pa, (uint32) ctx->R[rt], n)) break;
+        for (i = 0; i < n; i++) {                       /* not memory */
+            if (!CALL_WRITEPB (ctx, pa + i, ctx->R[rt] & M8, catr))
+                return FALSE;
+            }
+        break;
+
+    case MAGIC_MEMCPY:
+        sva = ctx->R[rt];
+        if (Q_MD_U32) sva = SEXT_W_D (sva);
+        if (n > (VA_M_OFF + 1 - (sva & VA_M_OFF)))      /* src page ends first? */
+            n = VA_M_OFF + 1 - (sva & VA_M_OFF);
+        if (!xlate_va (ctx, sva, VA_DR, &spa, &scatr))
+            return FALSE;
+        WATCH_CHECK (ctx, sva, spa, (uint32) n, WATCH_R);
+        if (mem_dma_move (pa, spa, n)) break;
+        for (i = 0; i < n; i++) {
+            if (!CALL_READPB (ctx, spa + i, &t, scatr) ||
+                !CALL_WRITEPB (ctx, pa + i, t, catr))
+                return FALSE;
+            }
+        break;
+
+    case MAGIC_CSUM:
+        if ((p = (uint8 *) mem_dma_pin (pa, n)) != NULL) {
+            for (i = 0; i < n; i++)
+                sum = sum + (((t_uint64) p[i]) << (((uint32) (pa + i) & 1) << 3));
+            mem_dma_unpin (pa, n, FALSE);
+            }
+        else for (i = 0; i < n; i++) {
+            if (!CALL_READPB (ctx, pa + i, &t, catr))
+                return FALSE;
+            sum = sum + (t << (((uint32) (pa + i) & 1) << 3));
+            }
+        while (sum > M32)                               /* end around carry */
+            sum = (sum & M32) + (sum >> 32);
+        ctx->R[rt] = SEXT_W_D (sum);
+        break;
+        }
+
+    ctx->R[rs] = ctx->R[rs] + n;                        /* advance */
+    if (op == MAGIC_MEMCPY) ctx->R[rt] = ctx->R[rt] + n;
+    ctx->R[rd] = ctx->R[rd] - n;
+    left = left - n;
+    }
+if (ctx->R[rd] != 0) set_pc (ctx->last_PC);             /* more? run again */
+return TRUE;
+}
+
 /* Translate address, instruction and data
 
    Inputs:
@@ -656,6 +770,219 @@ tlb_inv_mtlb (ctx);
 return;
 }
 
+/* Native TLB refill
+
+   With REFILL set, a TLB refill that would enter the guest's handler
+   (EXL and ERL clear, BEV clear) runs the handler here instead of
+   vectoring to it.  The handler code is read from memory each time and
+   interpreted directly, without the exception entry and per-instruction
+   overhead.  Any handler built from the usual refill instructions is
+   accepted, so no page table format has to be configured:
+
+        MFC0/DMFC0 of Context, BadVAddr, EntryHi or XContext
+        MTC0/DMTC0 of EntryLo0, EntryLo1 or PageMask
+        LD, LW, LWU from memory
+        shifts, ADDU/DADDU, AND/OR/XOR, ADDIU/DADDIU, ANDI/ORI/XORI, LUI
+        BEQ, BNE, BLTZ, BGEZ, J, JR (with their delay slots)
+        TLBWR, then ERET
+
+   Register and CP0 writes are held until ERET is reached, then done in
+   order, followed by the TLBWR and the effect of ERET.  If the handler
+   uses anything else, loads from a page that isn't mapped by a valid
+   TLB entry (the guest would take a nested miss) or from a page with a
+   watchpoint (so the guest's own load stops on it), or runs for more than
+   RFL_MAXI instructions, nothing is changed and the guest handler runs as
+   usual.  Invalid PTEs need nothing special: Linux-style handlers load
+   them anyway, and the next access takes a TLB invalid exception.
+
+   Inputs:
+        ctx     =       context
+        pc      =       refill vector
+   Outputs:
+        TRUE if the refill was done, FALSE to run the guest handler
+*/
+
+#define RFL_MAXI        64                              /* max instructions */
+#define RFL_MAXW        4                               /* max CP0 writes */
+
+uint32 tlb_refill_enb = 0;                              /* REFILL set */
+
+static t_bool rfl_pa (CORECTX *ctx, t_uint64 va, t_uint64 *pa)
+{
+TLBENT *tlbp;
+uint32 rgn = VA_GETRGN (va);
+
+if (rgn == VA_XKPHYS) *pa = va & PA_MASK;               /* unmapped */
+else if ((rgn == VA_XKSEG) && (va >= XKSEG_COMP) && (va < XKSEG_SSEG))
+    *pa = va & PA_MASK_29;
+else {                                                  /* mapped, no side */
+    if ((tlbp = tlb_search (ctx, va)) == NULL)          /* effects */
+        return FALSE;
+    if (!(((va & tlbp->sel)? tlbp->f1: tlbp->f0) & TLBF_V))
+        return FALSE;
+    *pa = ((va & tlbp->sel)? tlbp->pfn1: tlbp->pfn0) |
+        VA_GETOFF (tlbp->mask >> 1, va);
+    }
+return (M != NULL) && PA_IS_MEM (*pa);
+}
+
+static t_bool rfl_exec (CORECTX *ctx, t_uint64 pc)
+{
+t_uint64 r[32], wv[RFL_MAXW], sv[4], tgt = 0, ea, pa, t;
+uint32 wn[RFL_MAXW], nw = 0, dly = 0, n, ir, rs, rt, rd, sa;
+t_bool wr = FALSE;
+
+memcpy (r, ctx->R, sizeof (r));
+for (n = 0; n < RFL_MAXI; n++) {
+    if ((pc & 3) || !rfl_pa (ctx, pc, &pa)) break;     /* fetch */
+    ir = (uint32) (M[pa >> 3] >> ((pa & 4)? 32: 0));
+    rs = I_GETRS (ir);
+    rt = I_GETRT (ir);
+    rd = I_GETRD (ir);
+    sa = I_GETSA (ir);
+    t = SEXT_DISP (I_GETDISP (ir));
+    switch (I_GETOP (ir)) {
+
+    case OP_SPECIAL:
+        switch (I_GETFNC (ir)) {                        /* shifts need rs = 0; */
+        case SP_SLL: case SP_SRL: case SP_DSLL:         /* else ROTR, DROTR... */
+        case SP_DSLL32: case SP_DSRL: case SP_DSRL32:
+            if (rs) return FALSE;
+            }
+        switch (I_GETFNC (ir)) {
+        case SP_SLL:    t = SEXT_W_D ((r[rt] << sa) & M32); break;
+        case SP_SRL:    t = SEXT_W_D ((r[rt] & M32) >> sa); break;
+        case SP_DSLL:   t = r[rt] << sa; break;
+        case SP_DSRL:   t = r[rt] >> sa; break;
+        case SP_DSLL32: t = r[rt] << (sa + 32); break;
+        case SP_DSRL32: t = r[rt] >> (sa + 32); break;
+        case SP_ADDU:   t = SEXT_W_D ((r[rs] + r[rt]) & M32); break;
+        case SP_DADDU:  t = r[rs] + r[rt]; break;
+        case SP_OR:     t = r[rs] | r[rt]; break;
+        case SP_XOR:    t = r[rs] ^ r[rt]; break;
+        case SP_AND:
+            if (sa != 0) return FALSE;                  /* magic */
+            t = r[rs] & r[rt];
+            break;
+        case SP_JR:
+            if (dly) return FALSE;
+            tgt = r[rs];
+            dly = 2;
+            rd = 0;
+            break;
+        default:
+            return FALSE;
+            }
+        if (rd) r[rd] = t;
+        break;
+
+    case OP_REGIMM:
+        if (((rt != RI_BLTZ) && (rt != RI_BGEZ)) || dly) return FALSE;
+        if (((t_int64) r[rs] < 0) == (rt == RI_BLTZ)) tgt = pc + 4 + (t << 2);
+        else tgt = pc + 8;
+        dly = 2;
+        break;
+
+    case OP_BEQ: case OP_BNE:
+        if (dly) return FALSE;
+        if ((r[rs] == r[rt]) == (I_GETOP (ir) == OP_BEQ)) tgt = pc + 4 + (t << 2);
+        else tgt = pc + 8;
+        dly = 2;
+        break;
+
+    case OP_J:
+        if (dly) return FALSE;
+        tgt = ((pc + 4) & ~SIM_ULL(0x0FFFFFFF)) | (I_GETJT (ir) << 2);
+        dly = 2;
+        break;
+
+    case OP_ADDIU:  if (rt) r[rt] = SEXT_W_D ((r[rs] + t) & M32); break;
+    case OP_DADDIU: if (rt) r[rt] = r[rs] + t; break;
+    case OP_ANDI:   if (rt) r[rt] = r[rs] & (ir & M16); break;
+    case OP_ORI:    if (rt) r[rt] = r[rs] | (ir & M16); break;
+    case OP_XORI:   if (rt) r[rt] = r[rs] ^ (ir & M16); break;
+    case OP_LUI:    if (rt) r[rt] = SEXT_W_D ((ir & M16) << 16); break;
+
+    case OP_LD: case OP_LW: case OP_LWU:
+        ea = r[rs] + t;
+        if ((ea & ((I_GETOP (ir) == OP_LD)? 7: 3)) || !rfl_pa (ctx, ea, &pa))
+            return FALSE;                               /* guest takes it */
+        if (watch_n && (BRK_MAP_HIT (watch_map[0], pa) ||
+            BRK_MAP_HIT (watch_map[1], ea)))            /* watched: guest */
+            return FALSE;                               /* load checks it */
+        t = M[pa >> 3];
+        if (I_GETOP (ir) != OP_LD) {
+            t = (pa & 4)? (t >> 32): (t & M32);
+            if (I_GETOP (ir) == OP_LW) t = SEXT_W_D (t);
+            }
+        if (rt) r[rt] = t;
+        break;
+
+    case OP_COP0:
+        if (rs & 0x10) {                                /* TLB, ERET */
+            if ((I_GETFNC (ir) == CP0T_TLBWR) && !wr && !dly) {
+                wr = TRUE;
+                break;
+                }
+            if ((I_GETFNC (ir) != CP0T_ERET) || !wr || dly) return FALSE;
+            sv[0] = get_cp0_entlo0 ();                  /* commit */
+            sv[1] = get_cp0_entlo1 ();
+            sv[2] = get_cp0_mask ();
+            sv[3] = get_cp0_tlbr ();
+            for (n = 0; n < nw; n++)
+                cp0_putreg (ctx, wn[n], 0, wv[n]);
+            if (!tlb_write_r (ctx)) {                   /* machine check? */
+                set_cp0_entlo0 (sv[0]);                 /* undo, let the */
+                set_cp0_entlo1 (sv[1]);                 /* guest take it */
+                set_cp0_mask (sv[2]);
+                set_cp0_tlbr (sv[3]);
+                set_cp0_sr (get_cp0_sr () & ~CP0_SR_TS);
+                ctx->traps &= ~TRAP_MCHK;
+                return FALSE;
+                }
+            memcpy (ctx->R, r, sizeof (r));
+            set_pc (get_cp0_epc ());                    /* ERET */
+            set_cp0_sr (get_cp0_sr () & ~CP0_SR_EXL);
+            lock_clear (ctx->cpu_num);
+            return TRUE;
+            }
+        if ((ir & 7) || wr) return FALSE;               /* sel 0 only */
+        if ((rs == CP0_MFC0) || (rs == CP0_DMFC0)) {
+            if ((rd != 4) && (rd != 8) && (rd != 10) && (rd != 20))
+                return FALSE;                           /* Ctxt, BadVA, EntHi, XCtxt */
+            t = cp0_getreg (ctx, rd, 0);
+            if (rt) r[rt] = (rs == CP0_MFC0)? SEXT_W_D (t & M32): t;
+            }
+        else if ((rs == CP0_MTC0) || (rs == CP0_DMTC0)) {
+            if (((rd != 2) && (rd != 3) && (rd != 5)) || (nw >= RFL_MAXW))
+                return FALSE;                           /* EntLo0/1, PgMask */
+            wn[nw] = rd;
+            wv[nw++] = r[rt];
+            }
+        else return FALSE;
+        break;
+
+    default:
+        return FALSE;
+        }
+
+    if (dly == 1) pc = tgt;                             /* delay slot done */
+    else pc = pc + 4;
+    if (dly) dly--;
+    }
+return FALSE;
+}
+
+t_bool tlb_refill (CORECTX *ctx, t_uint64 pc)
+{
+if (rfl_exec (ctx, pc)) {
+    ctx->rfl_n++;
+    return TRUE;
+    }
+ctx->rfl_fb++;
+return FALSE;
+}
+
 /* Coprocessor 0 interface */
 
 t_stat op_cop0 (CORECTX *ctx, uint32 ir)
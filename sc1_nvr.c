@@ -181,6 +181,7 @@ t_stat nvr_reset (DEVICE *dptr)
     if (nvr == NULL) {
         return SCPE_MEM;
     }
+    mem_map_direct (NVRBASE, NVRSIZE, nvr, TRUE);
 
     return SCPE_OK;
 }
@@ -69,18 +69,22 @@
    should never be turned on at the same time, or things will break. */
 
 #ifndef RAVEN_INTERFACE   
+// The physical reference hooks feed the cache timing model (sc1_cmod.c),
+// which does nothing but test cmod_on unless SET CMOD ENABLED.
+#include "sc1_cmod.h"
+
 // called after a ReadP* has occured, with the data returned by the read
-#define STATS_READPB(ctx,pa,dat,catr)
-#define STATS_READPH(ctx,pa,dat,catr)
-#define STATS_READPW(ctx,pa,dat,catr)
-#define STATS_READPD(ctx,pa,dat,catr)
-#define STATS_READPI(ctx,pa,dat,catr)
+#define STATS_READPB(ctx,pa,dat,catr)   CMOD_REF(ctx,pa,catr,CMOD_READ)
+#define STATS_READPH(ctx,pa,dat,catr)   CMOD_REF(ctx,pa,catr,CMOD_READ)
+#define STATS_READPW(ctx,pa,dat,catr)   CMOD_REF(ctx,pa,catr,CMOD_READ)
+#define STATS_READPD(ctx,pa,dat,catr)   CMOD_REF(ctx,pa,catr,CMOD_READ)
+#define STATS_READPI(ctx,pa,dat,catr)   CMOD_REF(ctx,pa,catr,CMOD_IFETCH)
 
 // called after a WriteP* has occured, with the data that was written
-#define STATS_WRITEPB(ctx,pa,dat,catr)
-#define STATS_WRITEPH(ctx,pa,dat,catr)
-#define STATS_WRITEPW(ctx,pa,dat,catr)
-#define STATS_WRITEPD(ctx,pa,dat,catr)
+#define STATS_WRITEPB(ctx,pa,dat,catr)  CMOD_REF(ctx,pa,catr,CMOD_WRITE)
+#define STATS_WRITEPH(ctx,pa,dat,catr)  CMOD_REF(ctx,pa,catr,CMOD_WRITE)
+#define STATS_WRITEPW(ctx,pa,dat,catr)  CMOD_REF(ctx,pa,catr,CMOD_WRITE)
+#define STATS_WRITEPD(ctx,pa,dat,catr)  CMOD_REF(ctx,pa,catr,CMOD_WRITE)
 #define STATS_STALL_BEGIN(ctx)
 #define STATS_STALL_END(ctx)
 #endif   /* end if not defined RAVEN_INTERFACE */
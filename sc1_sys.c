@@ -45,6 +45,9 @@
 #include <sys/stat.h>
 #if !defined (_WIN32)
 #include <elf.h>
+#include <sys/mman.h>
+#include <pthread.h>
+#include <unistd.h>
 #endif
 
 #include "sc1_defs.h"
@@ -87,6 +90,8 @@ extern DEVICE scdma_dev;  /* supplied by either sc1_scdma.c, sc1_nodma.c, or sc1
 extern DEVICE scx_dev;
 #endif
 extern DEVICE gdb_dev;
+extern DEVICE jrnl_dev;
+extern DEVICE cmod_dev;
 extern DEVICE scb_dev;
 extern DEVICE ddr_dev;
 
@@ -94,6 +99,8 @@ extern REG cpu0_reg[];
 extern int32 sim_switches;
 
 extern CORECTX *cpu_ctx[NUM_CORES];
+extern t_uint64 *M;
+extern uint32 global_lock;
 
 uint32 sprint_sym_m (char *cptr, t_addr addr, uint32 inst);
 t_stat parse_sym_m (char *cptr, t_addr addr, t_value *inst);
@@ -133,6 +140,8 @@ DEVICE *sim_devices[DEV_MAX + 1] = {
     &eth_dev,
 #endif
     &disk_dev,
+    &jrnl_dev,
+    &cmod_dev,
 #ifdef SIMH_USE_PCIE
     &pcie_dev,
     &pmi_dev,
@@ -168,6 +177,7 @@ DEVICE *sim_devices[DEV_MAX + 1] = {
     };
 
 extern char sc1_stop_trap[];
+extern char sc1_stop_watch[];
 
 char *sim_stop_messages[] = {
     "Unknown error",
@@ -179,6 +189,7 @@ char *sim_stop_messages[] = {
     "Test passed",
     sc1_stop_trap,
     "Simulator hook detected",
+    sc1_stop_watch,
     };
 
 /* Local routines to write either memory or ROM */
@@ -197,20 +208,114 @@ else if (PA_IS_ROM (pa)) return CALL_LOAD_WRITEIO (NULL, pa, dat, L_WORD);
 return FALSE;
 }
 
+/* Write size bytes from datap (NULL for zeroes), a word at a time where
+   aligned, so ROM takes one I/O write per word rather than per byte */
+
 t_stat sim_load_WritePtr (t_uint64 pa, unsigned char* datap, t_uint64 size)
 {
-    t_uint64 leftpa = pa;
-    t_uint64 leftsize = size;
-    unsigned char* leftdatap = datap;
-    while (leftsize) {
-	if (!sim_load_WritePB(leftpa, *leftdatap, 0)) return SCPE_NXM;
-	leftpa += 1;
-	leftsize -= 1;
-	leftdatap += 1;
+    t_uint64 val;
+
+    while (size) {
+	if (((pa & 3) == 0) && (size >= 4)) {
+	    val = datap? ((t_uint64) datap[0] | ((t_uint64) datap[1] << 8) |
+			  ((t_uint64) datap[2] << 16) | ((t_uint64) datap[3] << 24)): 0;
+	    if (!sim_load_WritePW(pa, val, 0)) return SCPE_NXM;
+	    pa += 4;
+	    size -= 4;
+	    if (datap) datap += 4;
+	}
+	else {
+	    if (!sim_load_WritePB(pa, datap? *datap: 0, 0)) return SCPE_NXM;
+	    pa += 1;
+	    size -= 1;
+	    if (datap) datap += 1;
+	}
+    }
+    return SCPE_OK;
+}
+
+/* Copy a block into memory, zero filling from filesz to memsz
+
+   Main memory and direct regions (boot ROM, NVR) are filled directly;
+   anything else, SCX builds and big-endian hosts go through
+   sim_load_WritePtr.
+*/
+
+t_stat sim_load_block (t_uint64 pa, unsigned char *datap,
+    t_uint64 filesz, t_uint64 memsz)
+{
+extern int32 sim_end;
+extern t_uint64 lock_addr[NUM_CORES];
+t_uint64 i;
+unsigned char *dp;
+
+#if !defined (SIMH_CPUSIMH)
+if (sim_end && !PA_IS_MEM (pa) && ((dp = mem_dir_buf (pa, memsz)) != NULL)) {
+    memcpy (dp, datap, (size_t) filesz);                /* ROM, NVR */
+    memset (dp + filesz, 0, (size_t) (memsz - filesz));
+    return SCPE_OK;
     }
+if (sim_end && PA_IS_MEM (pa) && (memsz <= (MEMSIZE - pa))) {
+    memcpy (((unsigned char *) M) + pa, datap, (size_t) filesz);
+    memset (((unsigned char *) M) + pa + filesz, 0, (size_t) (memsz - filesz));
+    for (i = 0; i < NUM_CORES; i++) {                   /* break reservations */
+        if ((global_lock & (1u << i)) &&
+            (lock_addr[i] >= pa) && (lock_addr[i] < (pa + memsz)))
+            lock_clear ((uint32) i);
+        }
+    return SCPE_OK;
+    }
+#endif
+if (sim_load_WritePtr (pa, datap, filesz) != SCPE_OK) return SCPE_NXM;
+return sim_load_WritePtr (pa + filesz, NULL, memsz - filesz);
+}
+
+
+/* Map a load file into memory
+
+   The whole file is mapped read-only; where it can't be mapped (or on
+   Windows) it is read into a buffer instead.  An empty file yields a
+   NULL image of size 0.
+*/
+
+t_stat sim_load_map (FILE *fileref, unsigned char **imgp, t_uint64 *size,
+    t_bool *mapped)
+{
+struct stat statbuf;
+
+*imgp = NULL;
+*mapped = FALSE;
+if (fstat (fileno (fileref), &statbuf) != 0) return SCPE_IOERR;
+*size = (t_uint64) statbuf.st_size;
+if (*size == 0) return SCPE_OK;
+#if !defined (_WIN32)
+*imgp = (unsigned char *) mmap (NULL, (size_t) *size, PROT_READ, MAP_PRIVATE,
+    fileno (fileref), 0);
+if (*imgp != (unsigned char *) MAP_FAILED) {
+    *mapped = TRUE;
     return SCPE_OK;
+    }
+#endif
+*imgp = (unsigned char *) malloc ((size_t) *size);
+if (*imgp == NULL) return SCPE_MEM;
+if (fread (*imgp, 1, (size_t) *size, fileref) != *size) {
+    free (*imgp);
+    *imgp = NULL;
+    return SCPE_IOERR;
+    }
+return SCPE_OK;
 }
 
+void sim_load_unmap (unsigned char *imgp, t_uint64 size, t_bool mapped)
+{
+#if !defined (_WIN32)
+if (mapped) {
+    munmap (imgp, (size_t) size);
+    return;
+    }
+#endif
+free (imgp);
+}
 
 /*
  * YAMON style argument / environment loader
@@ -242,87 +347,662 @@ static t_stat yamon_arg_env(char *str, t_uint64 loc, t_uint64 ent)
 
 #if defined (_WIN32)
 
+char *sim_sym_lookup (t_uint64 va, t_uint64 *off)
+{
+return NULL;
+}
+
 static t_stat sim_load_elf (FILE *fileref, char *cptr, char *fnam, int flag)
 {
 return SCPE_NOFNC;
 }
 
 #else
-static t_stat sim_load_elf (FILE *fileref, char *cptr, char *fnam, int flag)
+
+/* ELF symbol table, kept for the debugger and profilers */
+
+typedef struct {
+    t_uint64            val;                            /* symbol address */
+    t_uint64            size;                           /* symbol size */
+    char                *name;
+    } ELFSYM;
+
+static ELFSYM *elf_sym = NULL;                          /* sorted by address */
+static uint32 elf_nsym = 0;
+static char *elf_strtab = NULL;                         /* names point here */
+
+static int elf_sym_cmp (const void *a, const void *b)
 {
-    struct stat statbuf;
-    unsigned char *mappedfilep;
-    unsigned char *loadblockp;
-    Elf64_Ehdr* ehdrp;
+const ELFSYM *sa = (const ELFSYM *) a, *sb = (const ELFSYM *) b;
+
+if (sa->val < sb->val) return -1;
+return (sa->val > sb->val);
+}
 
-    // Suck the whole file in (mmap isn't on all systems)
-    fstat (fileno(fileref), &statbuf);
+/* Look up the symbol covering virtual address va
 
-    mappedfilep = (unsigned char*)malloc(statbuf.st_size);
-    loadblockp  = (unsigned char*)malloc(statbuf.st_size);
-    fread (mappedfilep, statbuf.st_size, 1, fileref);
+   Inputs:
+        va      =       virtual address (32b addresses sign extended)
+        off     =       pointer to offset from symbol start, or NULL
+   Outputs:
+        symbol name, or NULL if none loaded or va is not covered
+*/
 
-    // First is the header
-    ehdrp = (Elf64_Ehdr*) mappedfilep;
-    if (strncmp((char*)ehdrp->e_ident, "\177ELF",3)) {
-	fprintf(stderr, "%s is not an ELF (exe) file\n", fnam);
-	return SCPE_FMT;
+char *sim_sym_lookup (t_uint64 va, t_uint64 *off)
+{
+uint32 lo, hi, mid;
+ELFSYM *sp;
+
+if (elf_nsym == 0) return NULL;
+for (lo = 0, hi = elf_nsym; (hi - lo) > 1; ) {          /* last sym <= va */
+    mid = (lo + hi) >> 1;
+    if (elf_sym[mid].val <= va) lo = mid;
+    else hi = mid;
+    }
+sp = &elf_sym[lo];
+if ((va < sp->val) || (sp->size && (va >= (sp->val + sp->size))))
+    return NULL;
+if (off) *off = va - sp->val;
+return sp->name;
+}
+
+static void elf_sym_free (void)
+{
+free (elf_sym);
+free (elf_strtab);
+elf_sym = NULL;
+elf_strtab = NULL;
+elf_nsym = 0;
+}
+
+/* Capture function and object symbols from the first SHT_SYMTAB */
+
+static void elf_sym_load (unsigned char *imgp, t_uint64 size, Elf64_Ehdr *ehdrp)
+{
+Elf64_Shdr *shdrp, *strp;
+Elf64_Sym *symp;
+t_uint64 i, nsym;
+uint32 typ;
+
+elf_sym_free ();
+if ((ehdrp->e_shoff == 0) || (ehdrp->e_shentsize != sizeof (Elf64_Shdr)) ||
+    ((ehdrp->e_shoff + ((t_uint64) ehdrp->e_shnum) * sizeof (Elf64_Shdr)) > size))
+    return;
+shdrp = (Elf64_Shdr *) (imgp + ehdrp->e_shoff);
+for (i = 0; i < ehdrp->e_shnum; i++, shdrp++) {
+    if ((shdrp->sh_type == SHT_SYMTAB) &&
+        (shdrp->sh_entsize == sizeof (Elf64_Sym)) &&
+        (shdrp->sh_link < ehdrp->e_shnum))
+        break;
+    }
+if (i >= ehdrp->e_shnum) return;                        /* stripped */
+strp = ((Elf64_Shdr *) (imgp + ehdrp->e_shoff)) + shdrp->sh_link;
+if (((shdrp->sh_offset + shdrp->sh_size) > size) ||
+    ((strp->sh_offset + strp->sh_size) > size) || (strp->sh_size == 0))
+    return;
+nsym = shdrp->sh_size / sizeof (Elf64_Sym);
+elf_sym = (ELFSYM *) malloc (nsym * sizeof (ELFSYM));
+elf_strtab = (char *) malloc (strp->sh_size + 1);
+if ((elf_sym == NULL) || (elf_strtab == NULL)) {
+    elf_sym_free ();
+    return;
+    }
+memcpy (elf_strtab, imgp + strp->sh_offset, strp->sh_size);
+elf_strtab[strp->sh_size] = 0;                          /* guard */
+symp = (Elf64_Sym *) (imgp + shdrp->sh_offset);
+for (i = 0; i < nsym; i++, symp++) {
+    typ = ELF64_ST_TYPE (symp->st_info);
+    if (((typ != STT_FUNC) && (typ != STT_OBJECT) && (typ != STT_NOTYPE)) ||
+        (symp->st_shndx == SHN_UNDEF) || (symp->st_name == 0) ||
+        (symp->st_name >= strp->sh_size))
+        continue;
+    elf_sym[elf_nsym].val = symp->st_value;
+    elf_sym[elf_nsym].size = symp->st_size;
+    elf_sym[elf_nsym].name = elf_strtab + symp->st_name;
+    elf_nsym++;
+    }
+qsort (elf_sym, elf_nsym, sizeof (ELFSYM), &elf_sym_cmp);
+}
+
+/* Map an ELF load address to a physical address
+
+   Unmapped kernel addresses (KSEG0/1, XKPHYS) are converted the way
+   xlate_va would; anything else must come with a usable p_paddr.
+*/
+
+static t_bool elf_va_to_pa (t_uint64 va, t_uint64 paddr, t_uint64 *pa)
+{
+if (va == ~((t_uint64) 0)) {                            /* unset */
+    *pa = 0;
+    return TRUE;
     }
-    if (ehdrp->e_ident[EI_CLASS]!=ELFCLASS64
-	|| ehdrp->e_ident[EI_DATA]!=ELFDATA2LSB) {
-	fprintf(stderr, "%s is not 64-bit little endian ELF\n", fnam);
+if ((va & ~((t_uint64) M32)) == 0)                      /* 32b, sign extend */
+    va = SEXT_W_D (va);
+if ((va >= XKSEG_COMP) && (va < XKSEG_SSEG)) {          /* KSEG0/1 */
+    *pa = va & PA_MASK_29;
+    return TRUE;
+    }
+if ((VA_GETRGN (va) == VA_XKPHYS) && !(va & XKPHYS_MBZ)) {
+    *pa = va & PA_MASK;
+    return TRUE;
+    }
+if (paddr < PA_MAX) {                                   /* mapped, use LMA */
+    *pa = paddr;
+    return TRUE;
+    }
+return FALSE;
+}
+
+static t_stat sim_load_elf (FILE *fileref, char *cptr, char *fnam, int flag)
+{
+    unsigned char *imgp;
+    t_uint64 size, pa;
+    t_bool mapped;
+    t_stat r = SCPE_OK;
+    Elf64_Ehdr *ehdrp;
+    Elf64_Phdr *phdrp;
+    uint32 i;
+
+    if ((r = sim_load_map (fileref, &imgp, &size, &mapped)) != SCPE_OK)
+	return r;
+    if (size < sizeof (Elf64_Ehdr)) {
+	fprintf (stderr, "%s is not an ELF (exe) file\n", fnam);
+	sim_load_unmap (imgp, size, mapped);
 	return SCPE_FMT;
     }
 
-    // Now through each loader section...
-#define LOADER_NTOHS(x) (x)
-#define LOADER_NTOHL(x) (x)
-#define LOADER_NTOHLL(x) (x)
-    Elf64_Phdr* phdrp = (Elf64_Phdr*) &mappedfilep[LOADER_NTOHL(ehdrp->e_phoff)];
-    for (int i=0; i < LOADER_NTOHS(ehdrp->e_phnum); i++, phdrp++) {
-	int off = LOADER_NTOHL(phdrp->p_offset);
-	t_uint64 loadaddr = LOADER_NTOHLL(phdrp->p_vaddr);
-	if (phdrp->p_memsz) {
-	    int loadsize = 0;
-	    //int memsz = LOADER_NTOHL(phdrp->p_memsz);
-	    int filesz = LOADER_NTOHL(phdrp->p_filesz);
-	    if (LOADER_NTOHL(phdrp->p_type) & PT_LOAD) {
-		t_uint64 adr;
-		if (filesz > statbuf.st_size) {
-		    fprintf(stderr, "Elf specified load larger then ELF file!\n");
-		    return SCPE_FMT;
-		}
-		if (loadaddr == ~0ULL) loadaddr=0;
-		for (adr = loadaddr; adr < (loadaddr + filesz); adr++, off++) {
-		    unsigned char data = *((unsigned char *) (mappedfilep + off));
-		    loadblockp[loadsize++] = data;
-		}
-		if (loadsize) {
-		    // Write to destination
-		    t_uint64 pa = loadaddr & 0x3fffffff;  // Cheap virtual->physical conversion
-		    sim_load_WritePtr(pa, loadblockp, loadsize);
-		}
-		// Note if filesz<memsz, then there are ZEROs to load.
-		// For speed, memory already is zeroed, so we can skip that part of the section.
-	    }
+    // First is the header
+    ehdrp = (Elf64_Ehdr *) imgp;
+    if (strncmp ((char *) ehdrp->e_ident, "\177ELF", 4)) {
+	fprintf (stderr, "%s is not an ELF (exe) file\n", fnam);
+	r = SCPE_FMT;
+    }
+    else if (ehdrp->e_ident[EI_CLASS] != ELFCLASS64
+	|| ehdrp->e_ident[EI_DATA] != ELFDATA2LSB) {
+	fprintf (stderr, "%s is not 64-bit little endian ELF\n", fnam);
+	r = SCPE_FMT;
+    }
+    else if ((ehdrp->e_phentsize != sizeof (Elf64_Phdr)) ||
+	     ((ehdrp->e_phoff + ((t_uint64) ehdrp->e_phnum) * sizeof (Elf64_Phdr)) > size)) {
+	fprintf (stderr, "%s has a bad program header table\n", fnam);
+	r = SCPE_FMT;
+    }
+
+    // Now through each loadable segment...
+    phdrp = (Elf64_Phdr *) (imgp + ehdrp->e_phoff);
+    for (i = 0; (r == SCPE_OK) && (i < ehdrp->e_phnum); i++, phdrp++) {
+	if ((phdrp->p_type != PT_LOAD) || (phdrp->p_memsz == 0))
+	    continue;
+	if ((phdrp->p_filesz > phdrp->p_memsz) ||
+	    (phdrp->p_offset > size) ||
+	    (phdrp->p_filesz > (size - phdrp->p_offset))) {
+	    fprintf (stderr, "Elf specified load larger then ELF file!\n");
+	    r = SCPE_FMT;
+	    break;
+	}
+	if (!elf_va_to_pa (phdrp->p_vaddr, phdrp->p_paddr, &pa)) {
+	    fprintf (stderr, "%s: segment %d at %#llx is not in an unmapped region\n",
+		     fnam, i, (t_uint64) phdrp->p_vaddr);
+	    r = SCPE_FMT;
+	    break;
 	}
+	r = sim_load_block (pa, imgp + phdrp->p_offset, phdrp->p_filesz, phdrp->p_memsz);
     }
 
-    // Entry address
-    if (ehdrp->e_entry) {
-	int j;
-	for (j = 0; j < NUM_CORES; j++) {
-	    cpu_ctx[j]->PC = ehdrp->e_entry |  ~((t_uint64) M32);
+    if (r == SCPE_OK) {
+	elf_sym_load (imgp, size, ehdrp);
+
+	// Entry address; 32b compat addresses are sign extended, as in
+	// elf_va_to_pa, and full 64b ones (XKPHYS, XKSEG) used as is
+	if (ehdrp->e_entry) {
+	    t_uint64 entry = ehdrp->e_entry;
+	    int j;
+	    if ((entry & ~((t_uint64) M32)) == 0)
+		entry = SEXT_W_D (entry);
+	    for (j = 0; j < NUM_CORES; j++) {
+		cpu_ctx[j]->PC = entry;
+	    }
 	}
     }
 
-    free(mappedfilep); mappedfilep=NULL;
-    free(loadblockp);  loadblockp=NULL;
-    return SCPE_OK;
+    sim_load_unmap (imgp, size, mapped);
+    return r;
 }
 
 #endif
 
+/* Hex and SREC text image loader
+
+   The image is mapped and decoded in place by a hand-written parser.
+   Decoding produces a list of data runs per chunk (adjacent records
+   are merged into a single run), which are then written to memory in
+   file order with sim_load_block.  Images larger than LDT_PAR_MIN are
+   cut at line boundaries into one chunk per host cpu and decoded in
+   parallel; the runs are still applied serially, so the result is the
+   same as a serial load.
+
+   Mips hex format: lines of "word-address data", '#' comments.
+   SREC format: S3 data records and the S7 entry point are loaded, the
+   remaining S records are checked and skipped, and "!L" / "!B" select
+   little or big endian byte order.  Every S record's checksum is
+   verified.
+
+   With -c, the decoded runs are saved next to the image as <file>.ldc
+   and reused as long as the image's size and modification time match.
+*/
+
+#define LDT_HEX         0                               /* Mips hex */
+#define LDT_SREC        1                               /* Motorola SREC */
+
+#define LDR_DATA        0                               /* data run */
+#define LDR_ENTRY       1                               /* entry point */
+#define LDR_LE          2                               /* !L */
+#define LDR_BE          3                               /* !B */
+
+#define LDT_PAR_MIN     (1u << 20)                      /* parallel if larger */
+#define LDT_MAX_THR     8
+#define LDC_MAGIC       0x43444C3143534C53ull           /* "SLSC1LDC" */
+
+typedef struct {
+    t_uint64            pa;                             /* address */
+    uint32              typ;                            /* LDR_x */
+    uint32              len;                            /* data bytes */
+    size_t              off;                            /* offset in dat */
+    } LDREC;
+
+typedef struct {
+    const char          *beg;                           /* text to decode */
+    const char          *end;
+    uint32              fmt;                            /* LDT_x */
+    LDREC               *rec;                           /* decoded runs */
+    size_t              nrec, maxrec;
+    unsigned char       *dat;                           /* run data */
+    size_t              ndat, maxdat;
+    t_stat              r;                              /* status */
+    const char          *errp;                          /* failing line */
+    } LDCHUNK;
+
+typedef struct {
+    t_uint64            magic;
+    t_uint64            srcsize;                        /* image size */
+    t_uint64            srctime;                        /* image mtime */
+    t_uint64            fmt;
+    t_uint64            nrec;
+    } LDCHDR;
+
+static const signed char ldt_hexval[256] = {
+ ['0'] = 1, ['1'] = 2, ['2'] = 3, ['3'] = 4, ['4'] = 5,
+ ['5'] = 6, ['6'] = 7, ['7'] = 8, ['8'] = 9, ['9'] = 10,
+ ['A'] = 11, ['B'] = 12, ['C'] = 13, ['D'] = 14, ['E'] = 15, ['F'] = 16,
+ ['a'] = 11, ['b'] = 12, ['c'] = 13, ['d'] = 14, ['e'] = 15, ['f'] = 16
+ };                                                     /* digit + 1, 0 = not hex */
+
+#define LDT_HEXV(c)     (ldt_hexval[(unsigned char) (c)] - 1)
+
+static t_bool ldt_grow (LDCHUNK *cp, size_t ndat)
+{
+if ((cp->nrec + 1) > cp->maxrec) {
+    size_t n = cp->maxrec? cp->maxrec * 2: 1024;
+    LDREC *p = (LDREC *) realloc (cp->rec, n * sizeof (LDREC));
+    if (p == NULL) return FALSE;
+    cp->rec = p;
+    cp->maxrec = n;
+    }
+if ((cp->ndat + ndat) > cp->maxdat) {
+    size_t n = cp->maxdat? cp->maxdat * 2: 65536;
+    unsigned char *p;
+    while (n < (cp->ndat + ndat)) n = n * 2;
+    p = (unsigned char *) realloc (cp->dat, n);
+    if (p == NULL) return FALSE;
+    cp->dat = p;
+    cp->maxdat = n;
+    }
+return TRUE;
+}
+
+/* Append data at pa, merging with the previous run if contiguous */
+
+static unsigned char *ldt_data (LDCHUNK *cp, t_uint64 pa, uint32 len)
+{
+LDREC *lp = cp->nrec? &cp->rec[cp->nrec - 1]: NULL;
+unsigned char *dp;
+
+if (!ldt_grow (cp, len)) return NULL;
+dp = cp->dat + cp->ndat;
+if (lp && (lp->typ == LDR_DATA) && ((lp->pa + lp->len) == pa) &&
+    ((lp->off + lp->len) == cp->ndat) && (lp->len < 0x40000000))
+    lp->len = lp->len + len;
+else {
+    lp = &cp->rec[cp->nrec++];
+    lp->pa = pa;
+    lp->typ = LDR_DATA;
+    lp->len = len;
+    lp->off = cp->ndat;
+    }
+cp->ndat = cp->ndat + len;
+return dp;
+}
+
+static t_bool ldt_mark (LDCHUNK *cp, uint32 typ, t_uint64 pa)
+{
+if (!ldt_grow (cp, 0)) return FALSE;
+cp->rec[cp->nrec].pa = pa;
+cp->rec[cp->nrec].typ = typ;
+cp->rec[cp->nrec].len = 0;
+cp->rec[cp->nrec].off = cp->ndat;
+cp->nrec++;
+return TRUE;
+}
+
+/* Parse up to 8 hex digits; returns updated pointer, NULL if none */
+
+static const char *ldt_hex (const char *p, const char *e, uint32 *val)
+{
+uint32 v = 0, n;
+
+for (n = 0; (p < e) && (LDT_HEXV (*p) >= 0); p++, n++)
+    v = (v << 4) | LDT_HEXV (*p);
+if ((n == 0) || (n > 8)) return NULL;
+*val = v;
+return p;
+}
+
+static t_bool ldt_line_hex (LDCHUNK *cp, const char *p, const char *e)
+{
+uint32 addr, dat;
+unsigned char *dp;
+
+while ((p < e) && ((*p == ' ') || (*p == '\t'))) p++;
+if (p == e) return TRUE;                                /* blank */
+if ((p = ldt_hex (p, e, &addr)) == NULL) return FALSE;
+while ((p < e) && ((*p == ' ') || (*p == '\t'))) p++;
+if ((p = ldt_hex (p, e, &dat)) == NULL) return FALSE;
+if ((dp = ldt_data (cp, ((t_uint64) addr) << 2, 4)) == NULL) return FALSE;
+dp[0] = (unsigned char) dat;                            /* little endian */
+dp[1] = (unsigned char) (dat >> 8);
+dp[2] = (unsigned char) (dat >> 16);
+dp[3] = (unsigned char) (dat >> 24);
+return TRUE;
+}
+
+static t_bool ldt_line_srec (LDCHUNK *cp, const char *p, const char *e)
+{
+unsigned char buf[256];
+uint32 i, n, sum, alen;
+t_uint64 addr;
+unsigned char *dp;
+char typ;
+
+if ((e - p) < 2) return (e == p);                       /* blank ok */
+if (p[0] == '!') {
+    if (p[1] == 'L') return ldt_mark (cp, LDR_LE, 0);
+    if (p[1] == 'B') return ldt_mark (cp, LDR_BE, 0);
+    return FALSE;
+    }
+if ((p[0] != 'S') || (p[1] < '0') || (p[1] > '9') || (p[1] == '6'))
+    return FALSE;
+typ = p[1];
+for (n = 0, p = p + 2; ((p + 1) < e) && (n < sizeof (buf)); p = p + 2, n++) {
+    int32 hi = LDT_HEXV (p[0]), lo = LDT_HEXV (p[1]);
+    if ((hi < 0) || (lo < 0)) break;
+    buf[n] = (unsigned char) ((hi << 4) | lo);
+    }
+if ((n < 1) || (buf[0] != (n - 1))) return FALSE;       /* count */
+for (i = 0, sum = 0; i < (n - 1); i++) sum = sum + buf[i];
+if ((~sum & 0xFF) != buf[n - 1]) {                      /* checksum */
+    cp->r = SCPE_CSUM;
+    return FALSE;
+    }
+switch (typ) {                                          /* record type */
+    case '3': case '7':
+        alen = 4;
+        break;
+    default:                                            /* checked, skipped */
+        return TRUE;
+    }
+if (n < (alen + 2)) return FALSE;
+for (i = 0, addr = 0; i < alen; i++) addr = (addr << 8) | buf[1 + i];
+if (typ == '7')
+    return ldt_mark (cp, LDR_ENTRY, addr);
+addr = addr & ~XKSEG_COMP;
+n = n - alen - 2;
+if (n == 0) return TRUE;
+if ((dp = ldt_data (cp, addr, n)) == NULL) return FALSE;
+memcpy (dp, buf + 1 + alen, n);
+return TRUE;
+}
+
+static void ldt_decode (LDCHUNK *cp)
+{
+const char *p = cp->beg, *e, *le;
+
+while (p < cp->end) {
+    le = (const char *) memchr (p, '\n', cp->end - p);
+    if (le == NULL) le = cp->end;
+    e = le;
+    if ((e > p) && (e[-1] == '\r')) e--;
+    if ((cp->fmt == LDT_HEX)? ((*p != '#') && !ldt_line_hex (cp, p, e)):
+        !ldt_line_srec (cp, p, e)) {
+        if (cp->r == SCPE_OK) cp->r = SCPE_FMT;
+        cp->errp = p;
+        return;
+        }
+    p = le + 1;
+    }
+}
+
+#if !defined (_WIN32)
+static void *ldt_thread (void *arg)
+{
+ldt_decode ((LDCHUNK *) arg);
+return NULL;
+}
+#endif
+
+/* Write one chunk's runs to memory, in order */
+
+static t_stat ldt_apply (LDCHUNK *cp, t_bool *bigend, FILE *cf, t_uint64 *ncrec)
+{
+size_t i;
+uint32 j;
+t_stat r;
+LDREC *lp;
+unsigned char *dp;
+
+for (i = 0, lp = cp->rec; i < cp->nrec; i++, lp++) {
+    dp = cp->dat + lp->off;
+    switch (lp->typ) {
+    case LDR_LE:
+    case LDR_BE:
+        *bigend = (lp->typ == LDR_BE);
+        continue;                                       /* not cached */
+    case LDR_ENTRY:
+        for (j = 0; j < NUM_CORES; j++)
+            cpu_ctx[j]->PC = lp->pa | ~((t_uint64) M32);
+        break;
+    default:
+        if (!*bigend) {
+            if ((r = sim_load_block (lp->pa, dp, lp->len, lp->len)) != SCPE_OK)
+                return r;
+            }
+        else {                                          /* swap within words */
+            t_uint64 a;
+            for (j = 0; j < lp->len; j++) {
+                a = lp->pa + j;
+                if (!sim_load_WritePB (a + 3 - 2 * (a % 4), dp[j], 0))
+                    return SCPE_NXM;
+                }
+            }
+        break;
+        }
+    if (cf) {                                           /* save to cache */
+        LDREC cr = *lp;
+        if (*bigend && (lp->typ == LDR_DATA)) {         /* cache as stored */
+            for (j = 0; j < lp->len; j++) {
+                t_uint64 a = lp->pa + j;
+                cr.pa = a + 3 - 2 * (a % 4);
+                cr.len = 1;
+                if ((fwrite (&cr, sizeof (cr), 1, cf) != 1) ||
+                    (fwrite (&dp[j], 1, 1, cf) != 1)) return SCPE_IOERR;
+                (*ncrec)++;
+                }
+            continue;
+            }
+        if ((fwrite (&cr, sizeof (cr), 1, cf) != 1) ||
+            (lp->len && (fwrite (dp, 1, lp->len, cf) != lp->len)))
+            return SCPE_IOERR;
+        (*ncrec)++;
+        }
+    }
+return SCPE_OK;
+}
+
+/* Load from a cache file; returns SCPE_OK if it was valid and loaded */
+
+static t_stat ldt_load_cache (char *cname, struct stat *sp, uint32 fmt)
+{
+FILE *cf;
+LDCHDR hdr;
+LDREC cr;
+t_uint64 i;
+unsigned char *dp = NULL;
+uint32 j, maxlen = 0;
+t_stat r = SCPE_OK;
+
+if ((cf = fopen (cname, "rb")) == NULL) return SCPE_OPENERR;
+if ((fread (&hdr, sizeof (hdr), 1, cf) != 1) || (hdr.magic != LDC_MAGIC) ||
+    (hdr.srcsize != (t_uint64) sp->st_size) ||
+    (hdr.srctime != (t_uint64) sp->st_mtime) || (hdr.fmt != fmt)) {
+    fclose (cf);
+    return SCPE_FMT;                                    /* stale */
+    }
+for (i = 0; (r == SCPE_OK) && (i < hdr.nrec); i++) {
+    if (fread (&cr, sizeof (cr), 1, cf) != 1) r = SCPE_IOERR;
+    else if (cr.typ == LDR_ENTRY) {
+        for (j = 0; j < NUM_CORES; j++)
+            cpu_ctx[j]->PC = cr.pa | ~((t_uint64) M32);
+        }
+    else {
+        if (cr.len > maxlen) {
+            free (dp);
+            maxlen = cr.len;
+            if ((dp = (unsigned char *) malloc (maxlen)) == NULL) {
+                r = SCPE_MEM;
+                break;
+                }
+            }
+        if (fread (dp, 1, cr.len, cf) != cr.len) r = SCPE_IOERR;
+        else r = sim_load_block (cr.pa, dp, cr.len, cr.len);
+        }
+    }
+free (dp);
+fclose (cf);
+return r;
+}
+
+static t_stat sim_load_text (FILE *fileref, char *fnam, uint32 fmt)
+{
+unsigned char *imgp;
+t_uint64 size, ncrec = 0;
+t_bool mapped, bigend = FALSE;
+LDCHUNK chunk[LDT_MAX_THR];
+uint32 i, nthr = 1;
+t_stat r;
+struct stat statbuf;
+char cname[CBUFSIZE + 8];
+FILE *cf = NULL;
+LDCHDR hdr;
+
+if (sim_switches & SWMASK ('C')) {                      /* try the cache */
+    if ((fstat (fileno (fileref), &statbuf) == 0) &&
+        (strlen (fnam) < CBUFSIZE)) {
+        sprintf (cname, "%s.ldc", fnam);
+        r = ldt_load_cache (cname, &statbuf, fmt);
+        if ((r == SCPE_OK) || (r == SCPE_NXM) || (r == SCPE_MEM)) return r;
+        cf = fopen (cname, "wb");                       /* rebuild it */
+        if (cf) {
+            memset (&hdr, 0, sizeof (hdr));
+            if (fwrite (&hdr, sizeof (hdr), 1, cf) != 1) {
+                fclose (cf);
+                cf = NULL;
+                }
+            }
+        }
+    }
+if ((r = sim_load_map (fileref, &imgp, &size, &mapped)) != SCPE_OK) {
+    if (cf) fclose (cf);
+    return r;
+    }
+memset (chunk, 0, sizeof (chunk));
+#if !defined (_WIN32)
+if (size >= LDT_PAR_MIN) {
+    long ncpu = sysconf (_SC_NPROCESSORS_ONLN);
+    nthr = (ncpu < 1)? 1: ((ncpu > LDT_MAX_THR)? LDT_MAX_THR: (uint32) ncpu);
+    }
+#endif
+for (i = 0; i < nthr; i++) {                            /* cut at newlines */
+    const char *e = (const char *) imgp + (size * (i + 1)) / nthr;
+    chunk[i].beg = i? chunk[i - 1].end: (const char *) imgp;
+    if (i == (nthr - 1)) e = (const char *) imgp + size;
+    else {
+        const char *nl = (e > chunk[i].beg)?
+            (const char *) memchr (e, '\n', ((const char *) imgp + size) - e): NULL;
+        e = nl? nl + 1: (const char *) imgp + size;
+        }
+    if (e < chunk[i].beg) e = chunk[i].beg;
+    chunk[i].end = e;
+    chunk[i].fmt = fmt;
+    }
+#if !defined (_WIN32)
+if (nthr > 1) {
+    pthread_t tid[LDT_MAX_THR];
+    t_bool started[LDT_MAX_THR];
+    for (i = 1; i < nthr; i++)
+        started[i] = (pthread_create (&tid[i], NULL, &ldt_thread, &chunk[i]) == 0);
+    ldt_decode (&chunk[0]);
+    for (i = 1; i < nthr; i++) {
+        if (started[i]) pthread_join (tid[i], NULL);
+        else ldt_decode (&chunk[i]);
+        }
+    }
+else
+#endif
+ldt_decode (&chunk[0]);
+for (i = 0; i < nthr; i++) {
+    if ((r = chunk[i].r) != SCPE_OK) {
+        const char *p;
+        uint32 line = 1;
+        for (p = (const char *) imgp; p < chunk[i].errp; p++)
+            if (*p == '\n') line++;
+        fprintf (stderr, "%s: line %d: %s\n", fnam, line,
+            (r == SCPE_CSUM)? "SREC checksum error": "format error");
+        break;
+        }
+    if ((r = ldt_apply (&chunk[i], &bigend, cf, &ncrec)) != SCPE_OK)
+        break;
+    }
+for (i = 0; i < nthr; i++) {
+    free (chunk[i].rec);
+    free (chunk[i].dat);
+    }
+sim_load_unmap (imgp, size, mapped);
+if (cf) {                                               /* finish cache */
+    t_bool ok = (r == SCPE_OK);
+    if (ok) {
+        hdr.magic = LDC_MAGIC;
+        hdr.srcsize = (t_uint64) statbuf.st_size;
+        hdr.srctime = (t_uint64) statbuf.st_mtime;
+        hdr.fmt = fmt;
+        hdr.nrec = ncrec;
+        ok = (fseek (cf, 0, SEEK_SET) == 0) &&
+            (fwrite (&hdr, sizeof (hdr), 1, cf) == 1);
+        }
+    fclose (cf);
+    if (!ok) remove (cname);
+    }
+return r;
+}
+
 /* Binary loader
 
    The binary loader handles absolute system images.  Supported switches:
@@ -333,14 +1013,13 @@ static t_stat sim_load_elf (FILE *fileref, char *cptr, char *fnam, int flag)
    -s           swap bytes
    -m           Motorola SREC format
    -e		ELF
+   -c           with -h or -m, cache the decoded image in <file>.ldc
 */
 
 t_stat sim_load (FILE *fileref, char *cptr, char *fnam, int flag)
 {
     t_stat r;
-    char gbuf[CBUFSIZE];
-    uint32 addr, dat;
-    int32 i, j;
+    int32 i;
     t_uint64 origin=0;
 
     if (flag) return SCPE_ARG;                          /* dump? */
@@ -351,73 +1030,9 @@ t_stat sim_load (FILE *fileref, char *cptr, char *fnam, int flag)
 
     if ((sim_switches & SWMASK ('H')) ||                /* HEX format? */
         (match_ext (fnam, "HEX") && !(sim_switches & SWMASK ('B')))) {
-        while (fgets (gbuf, CBUFSIZE - 1, fileref) != NULL) {
-            if (gbuf[0] == '#') continue;
-            if (sscanf (gbuf, "%X%X", &addr, &dat) != 2) return SCPE_FMT;
-            if (!sim_load_WritePW (((t_uint64) addr) << 2, dat, 0)) return SCPE_NXM;
-        }
+	return sim_load_text (fileref, fnam, LDT_HEX);
     } else if( sim_switches & SWMASK ('M') ) {          /* Motorola SREC format */
-        char line[1024];
-        unsigned int i, count;
-        int bigendian = 0;
-        long ori;
-        long byte;
-        while(fgets(line, 1024, fileref)) {
-            switch(line[0]) {
-                                                        /* We do not currently check the checksum */
-                case '!':
-                    switch(line[1]) {
-                        case 'L': bigendian = 0;
-                            break;
-                        case 'B': bigendian = 1;
-                            break;
-                        default: return SCPE_FMT;
-                    }
-                    break;
-                case 'S':
-                    switch(line[1]) {
-                        case '0': break; /* We don't read this currently */
-                        case '1': break; /* We don't read this currently */
-                        case '2': break; /* We don't read this currently */
-                        case '3': /* 32-bit entry */
-                            sscanf(line, "S3%2X", &count);
-                            sscanf(&line[4], "%8lX", &ori);
-                            ori &= ~XKSEG_COMP;
-                            for(i=0; i<(count-5); i++) {
-                                sscanf(&line[12+(i*2)], "%2lX", &byte);
-                                if( bigendian ) {
-                                    if (!sim_load_WritePB ((ori+i)+3-2*((ori+i)%4), byte, 0)) {
-                                        return SCPE_NXM;
-                                    }
-                                } else {
-                                    if (!sim_load_WritePB (ori+i, byte, 0)) {
-                                        return SCPE_NXM;
-                                    }
-                                }
-                            }
-                            break;
-                        case '4': break; /* We don't read this currently */
-                        case '5': break; /* We don't read this currently */
-                        case '6': return SCPE_FMT; break; /* UNUSED */
-                        case '7': /* 32-bit Entry point address */
-                            // If there are multiple S7 records, only the last one sticks...
-                            sscanf(&line[4], "%8lX", &ori);
-			    for (j = 0; j < NUM_CORES; j++) {
-				cpu_ctx[j]->PC = ori |  ~((t_uint64) M32);
-			    }
-                            // printf("S7 entry point: ffffffff%.8s\n", &line[4]);
-                            break;
-                        case '8': break; /* We don't read this currently */
-                        case '9': break; /* We don't read this currently */
-                        default:
-                            return SCPE_FMT;
-                            break;
-                    }
-                    break;
-                default:
-                    return SCPE_FMT;
-            }
-        }
+	return sim_load_text (fileref, fnam, LDT_SREC);
     } else if( sim_switches & SWMASK ('E') ) {          /* ELF format */
 	return sim_load_elf (fileref, cptr, fnam, flag);
     } else if( sim_switches & SWMASK ('A') ) {          /* Kernel arguments in a string */
@@ -490,18 +1105,363 @@ t_stat sim_load (FILE *fileref, char *cptr, char *fnam, int flag)
     return SCPE_OK;
 }
 
+/* Batch regression runner
+
+   REGRESS <script|directory> {<summary file> {<jobs>}}
+
+   Runs a test script in the style of sc1_test.txt (one test per "load"
+   command and the lines that follow it), or every .hex file in a
+   directory, with each test in its own forked copy of the simulator.
+   The machine is reset once, before the first fork; every test then
+   starts from that template state (shared copy-on-write) instead of
+   resetting and reallocating it, so "run" is executed as "go".  Up to
+   <jobs> tests (default: one per host cpu) run at once.
+
+   A test passes if every command in it succeeds, so the verdict is the
+   script's own: a failing ASSERT fails the test, EXIT ends it early.
+   Test output is discarded.  The summary is comma-separated, in script
+   (or sorted file name) order: test name, pass/fail, stop code,
+   instructions executed, wall time in ms.
+*/
+
+#if defined (_WIN32)
+
+static t_stat sc1_regress_cmd (int32 flag, char *cptr)
+{
+return SCPE_NOFNC;
+}
+
+#else
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+
+#define RGR_MAX_JOBS    64
+
+typedef struct {
+    char                *name;                          /* test name */
+    char                *cmds;                          /* command lines */
+    } RGRTEST;
+
+typedef struct {
+    t_stat              r;                              /* first error, or OK */
+    uint32              stop;                           /* last stop code */
+    t_uint64            count;                          /* instructions */
+    double              ms;                             /* wall time */
+    } RGRRES;
+
+typedef struct {
+    pid_t               pid;
+    int                 fd;                             /* result pipe */
+    uint32              test;
+    } RGRJOB;
+
+extern uint32 global_stop;
+extern FILE *sim_log;
+extern FILE *sim_deb;
+CTAB *find_cmd (char *gbuf);
+
+static double rgr_now (void)
+{
+struct timeval tv;
+
+gettimeofday (&tv, NULL);
+return (tv.tv_sec * 1000.0) + (tv.tv_usec / 1000.0);
+}
+
+static t_bool rgr_add (RGRTEST **tests, uint32 *ntest, const char *name, const char *cmds)
+{
+RGRTEST *tp;
+const char *bp;
+
+if ((*ntest & 63) == 0) {
+    tp = (RGRTEST *) realloc (*tests, (*ntest + 64) * sizeof (RGRTEST));
+    if (tp == NULL) return FALSE;
+    *tests = tp;
+    }
+tp = &(*tests)[*ntest];
+for (bp = name + strlen (name); (bp > name) && (bp[-1] != '/') && (bp[-1] != '\\'); bp--) ;
+tp->name = (char *) malloc (strlen (bp) + 1);
+tp->cmds = (char *) malloc (strlen (cmds) + 1);
+if ((tp->name == NULL) || (tp->cmds == NULL)) return FALSE;
+strcpy (tp->name, bp);
+strcpy (tp->cmds, cmds);
+(*ntest)++;
+return TRUE;
+}
+
+/* Split a script into tests, one per "load" and the lines after it */
+
+static t_stat rgr_read_script (FILE *sf, RGRTEST **tests, uint32 *ntest)
+{
+char line[CBUFSIZE], gbuf[CBUFSIZE], name[CBUFSIZE], *cptr, *cmds = NULL;
+size_t len = 0, n;
+t_stat r = SCPE_OK;
+
+while (fgets (line, CBUFSIZE, sf) != NULL) {
+    cptr = line;
+    while (isspace ((unsigned char) *cptr)) cptr++;
+    if ((*cptr == 0) || (*cptr == ';')) continue;
+    get_glyph (cptr, gbuf, 0);
+    if (strcmp (gbuf, "LOAD") == 0) {                   /* new test */
+        char *fp = get_glyph_nc (cptr, gbuf, 0);
+        if (cmds && !rgr_add (tests, ntest, name, cmds)) {
+            r = SCPE_MEM;
+            break;
+            }
+        len = 0;
+        while (*fp == '-') fp = get_glyph_nc (fp, gbuf, 0); /* skip switches */
+        get_glyph_nc (fp, name, 0);
+        }
+    else if (cmds == NULL) continue;                    /* before first test */
+    n = strlen (cptr);
+    if ((cmds = (char *) realloc (cmds, len + n + 2)) == NULL) {
+        r = SCPE_MEM;
+        break;
+        }
+    memcpy (cmds + len, cptr, n + 1);
+    len = len + n;
+    if ((len == 0) || (cmds[len - 1] != '\n')) {
+        cmds[len++] = '\n';
+        cmds[len] = 0;
+        }
+    }
+if ((r == SCPE_OK) && cmds && !rgr_add (tests, ntest, name, cmds))
+    r = SCPE_MEM;
+free (cmds);
+return r;
+}
+
+static int rgr_cmp (const void *a, const void *b)
+{
+return strcmp (((const RGRTEST *) a)->name, ((const RGRTEST *) b)->name);
+}
+
+static t_stat rgr_read_dir (char *dname, RGRTEST **tests, uint32 *ntest)
+{
+DIR *dp;
+struct dirent *ep;
+char cmds[3 * CBUFSIZE];
+uint32 first = *ntest;
+
+if ((dp = opendir (dname)) == NULL) return SCPE_OPENERR;
+while ((ep = readdir (dp)) != NULL) {
+    size_t n = strlen (ep->d_name);
+    if ((n < 5) || (strcasecmp (ep->d_name + n - 4, ".hex") != 0) ||
+        ((strlen (dname) + n) > (CBUFSIZE - 16)))
+        continue;
+    sprintf (cmds, "load -h %s/%s\ngo %X\nassert mem stop =%d\n",
+        dname, ep->d_name, ROMBASE_29, STOP_PASS);
+    if (!rgr_add (tests, ntest, ep->d_name, cmds)) {
+        closedir (dp);
+        return SCPE_MEM;
+        }
+    }
+closedir (dp);
+if (*ntest > first)                                     /* readdir order varies */
+    qsort (*tests + first, *ntest - first, sizeof (RGRTEST), &rgr_cmp);
+return SCPE_OK;
+}
+
+/* Run one test in the forked copy; never returns.  The exit status is
+   0 if the test passed and its result reached the parent.
+*/
+
+static void rgr_child (RGRTEST *tp, int fd)
+{
+char gbuf[CBUFSIZE], line[CBUFSIZE], *lp, *nl, *cptr;
+CTAB *cmdp;
+RGRRES res;
+t_uint64 start = total_count;
+t_stat r;
+int nfd;
+size_t done;
+ssize_t n;
+
+if ((nfd = open ("/dev/null", O_RDWR)) >= 0) {          /* quiet */
+    dup2 (nfd, 0);
+    dup2 (nfd, 1);
+    dup2 (nfd, 2);
+    }
+sim_log = NULL;
+sim_deb = NULL;
+res.r = SCPE_OK;
+res.ms = rgr_now ();
+for (lp = tp->cmds; (res.r == SCPE_OK) && *lp; lp = nl) {
+    nl = strchr (lp, '\n');
+    nl = nl? nl + 1: lp + strlen (lp);
+    if ((size_t) (nl - lp) >= CBUFSIZE) {
+        res.r = SCPE_ARG;
+        break;
+        }
+    memcpy (line, lp, nl - lp);
+    line[nl - lp] = 0;
+    cptr = get_glyph (line, gbuf, 0);
+    if (strcmp (gbuf, "RUN") == 0) strcpy (gbuf, "GO"); /* template is reset */
+    if ((cmdp = find_cmd (gbuf)) == NULL) res.r = SCPE_UNK;
+    else {
+        r = cmdp->action (cmdp->arg, cptr);
+        if (r == SCPE_EXIT) break;                      /* script ends */
+        if ((r >= SCPE_BASE) && (r != SCPE_OK)) res.r = r;
+        }
+    }
+res.ms = rgr_now () - res.ms;
+res.stop = global_stop;
+res.count = total_count - start;
+for (done = 0; done < sizeof (res); done = done + n) {
+    n = write (fd, ((char *) &res) + done, sizeof (res) - done);
+    if ((n < 0) && (errno == EINTR)) n = 0;
+    else if (n <= 0) _exit (2);
+    }
+_exit ((res.r == SCPE_OK)? 0: 1);
+}
+
+static t_stat sc1_regress_cmd (int32 flag, char *cptr)
+{
+char path[CBUFSIZE], sname[CBUFSIZE], gbuf[CBUFSIZE];
+RGRTEST *tests = NULL;
+RGRJOB job[RGR_MAX_JOBS];
+struct pollfd pf[RGR_MAX_JOBS];
+RGRRES *res = NULL, *rp;
+t_bool *pass = NULL;
+uint32 ntest = 0, next = 0, nrun = 0, npass = 0, njobs, i;
+struct stat statbuf;
+FILE *sf, *of = stdout;
+double t0;
+t_stat r;
+pid_t pid;
+int st, pfd[2];
+
+if ((cptr == NULL) || (*cptr == 0)) return SCPE_2FARG;
+cptr = get_glyph_nc (cptr, path, 0);
+cptr = get_glyph_nc (cptr, sname, 0);
+cptr = get_glyph (cptr, gbuf, 0);
+if (*cptr != 0) return SCPE_2MARG;
+njobs = (uint32) sysconf (_SC_NPROCESSORS_ONLN);
+if (gbuf[0]) {
+    njobs = (uint32) get_uint (gbuf, 10, RGR_MAX_JOBS, &r);
+    if ((r != SCPE_OK) || (njobs == 0)) return SCPE_ARG;
+    }
+if ((njobs == 0) || (njobs > RGR_MAX_JOBS)) njobs = RGR_MAX_JOBS;
+if (stat (path, &statbuf) != 0) return SCPE_OPENERR;
+if (S_ISDIR (statbuf.st_mode)) r = rgr_read_dir (path, &tests, &ntest);
+else if ((sf = fopen (path, "r")) == NULL) return SCPE_OPENERR;
+else {
+    r = rgr_read_script (sf, &tests, &ntest);
+    fclose (sf);
+    }
+if ((r == SCPE_OK) && sname[0] && ((of = fopen (sname, "w")) == NULL))
+    r = SCPE_OPENERR;
+if ((r == SCPE_OK) && ntest &&
+    (((res = (RGRRES *) calloc (ntest, sizeof (RGRRES))) == NULL) ||
+     ((pass = (t_bool *) calloc (ntest, sizeof (t_bool))) == NULL)))
+    r = SCPE_MEM;
+if ((r == SCPE_OK) && ((r = reset_all (0)) == SCPE_OK)) { /* build template */
+    fflush (NULL);
+    t0 = rgr_now ();
+    while ((next < ntest) || nrun) {
+        while ((next < ntest) && (nrun < njobs)) {      /* fill the pool */
+            if (pipe (pfd) != 0) break;
+            if ((pid = fork ()) == 0) {
+                close (pfd[0]);
+                rgr_child (&tests[next], pfd[1]);
+                }
+            close (pfd[1]);
+            if (pid < 0) {
+                close (pfd[0]);
+                break;
+                }
+            job[nrun].pid = pid;
+            job[nrun].fd = pfd[0];
+            job[nrun].test = next++;
+            nrun++;
+            }
+        if (nrun == 0) {
+            r = SCPE_IERR;                              /* can't fork */
+            break;
+            }
+        for (i = 0; i < nrun; i++) {                    /* a child done? */
+            pf[i].fd = job[i].fd;
+            pf[i].events = POLLIN;
+            pf[i].revents = 0;
+            }
+        if (poll (pf, nrun, -1) < 0) {
+            if (errno == EINTR) continue;
+            r = SCPE_IERR;
+            break;
+            }
+        for (i = 0; (i < nrun) && (pf[i].revents == 0); i++) ;
+        if (i >= nrun) continue;
+        rp = &res[job[i].test];
+        if (read (job[i].fd, rp, sizeof (RGRRES)) != sizeof (RGRRES)) {
+            rp->r = SCPE_IERR;                          /* child died */
+            rp->stop = 0;
+            rp->count = 0;
+            rp->ms = 0;
+            }
+        close (job[i].fd);
+        while ((waitpid (job[i].pid, &st, 0) < 0) && (errno == EINTR)) ;
+        pass[job[i].test] = (rp->r == SCPE_OK) && WIFEXITED (st) &&
+            (WEXITSTATUS (st) == 0);
+        job[i] = job[--nrun];
+        }
+    while (nrun) {                                      /* on error */
+        nrun--;
+        kill (job[nrun].pid, SIGKILL);
+        close (job[nrun].fd);
+        waitpid (job[nrun].pid, &st, 0);
+        }
+    fprintf (of, "test,result,stop,instructions,wall_ms\n");
+    for (i = 0; i < next; i++) {                        /* in test order */
+        if (pass[i]) npass++;
+        fprintf (of, "%s,%s,%d,%llu,%.3f\n", tests[i].name,
+            pass[i]? "pass": "fail", res[i].stop, res[i].count, res[i].ms);
+        }
+    printf ("REGRESS: %d tests, %d passed, %d failed, %.3f s\n",
+        ntest, npass, ntest - npass, (rgr_now () - t0) / 1000.0);
+    }
+if (of && (of != stdout)) fclose (of);
+for (i = 0; i < ntest; i++) {
+    free (tests[i].name);
+    free (tests[i].cmds);
+    }
+free (tests);
+free (res);
+free (pass);
+if (r != SCPE_OK) return r;
+return (npass == ntest)? SCPE_OK: SCPE_AFAIL;
+}
+
+#endif
+
+/* SCP extensions */
+
+static CTAB sc1_cmd[] = {
+    { "REGRESS", &sc1_regress_cmd, 0,
+      "regress <script|dir> {<summary> {<jobs>}}  run tests in parallel\n" },
+    { NULL }
+    };
+
+static void dt_build (void);
+
+static void sc1_vm_init (void)
+{
+sim_vm_cmd = sc1_cmd;
+dt_build ();                                            /* opcode decoder */
+}
+
+void (*sim_vm_init) (void) = &sc1_vm_init;
+
 static const uint32 fld_shift[16] = {
  0, I_V_RS, I_V_RT, I_V_RD, I_V_SA, I_V_FNC, 0, 0,
  I_V_SA, 0, 0, 0, 0, 0, 0, 0
  };
 
-struct opcode {
-    char*               name;
-    uint32              val;
-    uint32              mask;
-    uint32              flg;
-    };
-
 /* Instruction table */
 
 struct opcode opc[] = {
@@ -545,6 +1505,9 @@ struct opcode opc[] = {
     { "ADDU",   0x00000021, M_OP3, F_OP3 },
     { "SUB",    0x00000022, M_OP3, F_OP3 },
     { "SUBU",   0x00000023, M_OP3, F_OP3 },
+    { "MEMSET", 0x00000024 | (MAGIC_MEMSET << I_V_SA), M_MG3, F_MG3 }, /* bulk magic */
+    { "MEMCPY", 0x00000024 | (MAGIC_MEMCPY << I_V_SA), M_MG3, F_MG3 },
+    { "CSUM",   0x00000024 | (MAGIC_CSUM << I_V_SA), M_MG3, F_MG3 },
     { "AND",    0x00000024, M_OP3, F_OP3 },
     { "MOVE",   0x00000025, M_OP2, F_OP2 },             /* must preceed or */
     { "OR",     0x00000025, M_OP3, F_OP3 },
@@ -848,6 +1811,186 @@ struct opcode opc[] = {
     { NULL, 0, M_NOP, F_NOP }
 };
 
+/* Decode tree
+
+   opc[] is searched in order and the first matching entry wins, so entries
+   may overlap (NOP ahead of SLL, and so on).  The tree is built from opc[]
+   at startup.  Each node indexes on one instruction field.  An entry is
+   copied down every branch that its value and mask allow, so each leaf is
+   the in-order list of entries that can match there, usually just one.
+   opc_decode returns the first entry in that list which matches, which is
+   the same entry the linear search found.
+*/
+
+typedef struct {
+    uint32              sh;                             /* field position */
+    uint32              msk;                            /* field mask, 0 = leaf */
+    uint32              idx;                            /* children or list */
+    } DTNODE;
+
+#define DT_NFLD         6
+
+static const uint32 dt_fld[DT_NFLD][2] = {              /* candidate fields */
+    { I_V_OP, 0x3F },
+    { I_V_FNC, 0x3F },
+    { I_V_RS, 0x1F },
+    { I_V_RT, 0x1F },
+    { I_V_SA, 0x1F },
+    { I_V_RD, 0x1F }
+    };
+
+static DTNODE *dt_node = NULL;                          /* nodes, [0] = root */
+static uint32 dt_nnode = 0;
+static int16 *dt_list = NULL;                           /* leaf lists, -1 ends */
+static uint32 dt_nlist = 0;
+static int16 *dt_name = NULL;                           /* opc[] sorted by name */
+static uint32 opc_num = 0;
+
+static void *dt_grow (void *p, uint32 n, size_t sz)
+{
+uint32 m;
+
+for (m = 256; m < n; m = m << 1) ;                      /* power of 2 size */
+return realloc (p, m * sz);
+}
+
+static t_bool dt_build_node (uint32 nd, int16 *cand, uint32 n, uint32 used)
+{
+uint32 f, bf, bd, bc, c, d, i, k, fm, sh, msk, base;
+uint8 seen[64];
+int16 *sub;
+
+for (f = bf = bc = 0, bd = 1; (n > 1) && (f < DT_NFLD); f++) {
+    if (used & (1u << f)) continue;                     /* pick the field */
+    sh = dt_fld[f][0];                                  /* that splits most */
+    msk = dt_fld[f][1];
+    fm = msk << sh;
+    memset (seen, 0, sizeof (seen));
+    for (i = c = d = 0; i < n; i++) {
+        if ((opc[cand[i]].mask & fm) != fm) continue;
+        c++;
+        k = (opc[cand[i]].val >> sh) & msk;
+        if (!seen[k]) {
+            seen[k] = 1;
+            d++;
+            }
+        }
+    if ((d > bd) || ((d == bd) && (d > 1) && (c > bc))) {
+        bf = f + 1;
+        bd = d;
+        bc = c;
+        }
+    }
+if (bf == 0) {                                          /* leaf */
+    if ((dt_list = (int16 *) dt_grow (dt_list, dt_nlist + n + 1,
+        sizeof (int16))) == NULL) return FALSE;
+    dt_node[nd].msk = 0;
+    dt_node[nd].idx = dt_nlist;
+    for (i = 0; i < n; i++) dt_list[dt_nlist++] = cand[i];
+    dt_list[dt_nlist++] = -1;
+    return TRUE;
+    }
+sh = dt_fld[bf - 1][0];
+msk = dt_fld[bf - 1][1];
+fm = msk << sh;
+base = dt_nnode;
+dt_nnode = dt_nnode + msk + 1;
+if ((dt_node = (DTNODE *) dt_grow (dt_node, dt_nnode, sizeof (DTNODE))) == NULL)
+    return FALSE;
+dt_node[nd].sh = sh;
+dt_node[nd].msk = msk;
+dt_node[nd].idx = base;
+if ((sub = (int16 *) malloc (n * sizeof (int16))) == NULL) return FALSE;
+for (k = 0; k <= msk; k++) {                            /* build branches */
+    for (i = c = 0; i < n; i++) {
+        if ((((k << sh) ^ opc[cand[i]].val) & opc[cand[i]].mask & fm) == 0)
+            sub[c++] = cand[i];
+        }
+    if (!dt_build_node (base + k, sub, c, used | (1u << (bf - 1)))) {
+        free (sub);
+        return FALSE;
+        }
+    }
+free (sub);
+return TRUE;
+}
+
+static int dt_name_cmp (const void *a, const void *b)
+{
+int16 ia = *(const int16 *) a, ib = *(const int16 *) b;
+int r = strcmp (opc[ia].name, opc[ib].name);
+
+return r? r: (ia - ib);                                 /* first entry first */
+}
+
+static void dt_build (void)
+{
+int16 *all;
+uint32 i;
+
+for (opc_num = 0; opc[opc_num].name != NULL; opc_num++) ;
+if ((all = (int16 *) malloc (opc_num * sizeof (int16))) == NULL) return;
+for (i = 0; i < opc_num; i++) all[i] = (int16) i;
+dt_nnode = 1;
+if (((dt_node = (DTNODE *) dt_grow (NULL, 1, sizeof (DTNODE))) == NULL) ||
+    !dt_build_node (0, all, opc_num, 0)) {
+    free (dt_node);                                     /* no memory, */
+    free (dt_list);                                     /* search linearly */
+    dt_node = NULL;
+    dt_list = NULL;
+    free (all);
+    return;
+    }
+qsort (all, opc_num, sizeof (int16), &dt_name_cmp);
+dt_name = all;
+return;
+}
+
+/* Decode an instruction, returns opc[] index or -1 */
+
+int32 opc_decode (uint32 inst)
+{
+const DTNODE *np;
+const int16 *lp;
+uint32 i;
+
+if (dt_node == NULL) {                                  /* no tree? */
+    for (i = 0; opc[i].name != NULL; i++) {
+        if (((inst ^ opc[i].val) & opc[i].mask) == 0) return (int32) i;
+        }
+    return -1;
+    }
+for (np = dt_node; np->msk != 0; )
+    np = &dt_node[np->idx + ((inst >> np->sh) & np->msk)];
+for (lp = &dt_list[np->idx]; *lp >= 0; lp++) {
+    if (((inst ^ opc[*lp].val) & opc[*lp].mask) == 0) return *lp;
+    }
+return -1;
+}
+
+/* Look up an opcode name, returns first opc[] index or -1 */
+
+int32 opc_lookup (const char *name)
+{
+int32 lo, hi, mid;
+uint32 i;
+
+if (dt_name == NULL) {
+    for (i = 0; opc[i].name != NULL; i++) {
+        if (strcmp (opc[i].name, name) == 0) return (int32) i;
+        }
+    return -1;
+    }
+for (lo = 0, hi = (int32) opc_num - 1; lo <= hi; ) {    /* lowest match */
+    mid = (lo + hi) / 2;
+    if (strcmp (opc[dt_name[mid]].name, name) < 0) lo = mid + 1;
+    else hi = mid - 1;
+    }
+if ((lo < (int32) opc_num) && (strcmp (opc[dt_name[lo]].name, name) == 0))
+    return dt_name[lo];
+return -1;
+}
+
 /* Symbolic decode
 
    Inputs:
@@ -937,101 +2080,98 @@ return -7;
 
 uint32 sprint_sym_m (char *cptr, t_addr addr, uint32 inst)
 {
-uint32 i, k, fl, fld[16], any;
+int32 i;
+uint32 k, fl, fld[16], any;
 char *optr, *oldptr;
 
 oldptr = cptr;                                          /* save start */
-for (i = 0; opc[i].name != NULL; i++) {                 /* loop thru ops */
-    if (((inst ^ opc[i].val) & opc[i].mask) == 0) {
-        fl = opc[i].flg;                                /* flags */
-        fld[F_RS] = I_GETRS (inst);                     /* all fields */
-        fld[F_RT] = I_GETRT (inst);
-        fld[F_RD] = I_GETRD (inst);
-        fld[F_SA] = I_GETSA (inst);
-        fld[F_FNC] = I_GETFNC (inst);
-        fld[F_JT] = I_GETJT (inst);
-        fld[F_DISP] = I_GETDISP (inst);
-        fld[F_CODE] = (inst >> I_V_SA) & 0xFFFFF;
-        fld[F_Z] = 0;
-        any = 0;
-        for (optr = opc[i].name; *optr; optr++) {       /* copy op, lc */
-            if (isupper (*optr)) *cptr++ = tolower (*optr);
-            else *cptr++ = *optr;
-            }
-        *cptr = 0;
-        for (k = 0; k < 4; k++) {                       /* up to 4 fields */
-            uint32 fmt = SYM_GETFMT (fl, k);            /* get format */
-            uint32 val = fld[SYM_GETFLD (fl, k)];       /* get field */
-            t_uint64 v64 = val;
-            switch (fmt) {                              /* case fmt */
-
-                case FMT_RC:                            /* cond ret reg */
-                    if (val == 31) break;               /* dont print 31 */
-                case FMT_R:                             /* int reg */
-                case FMT_FR:                            /* flt reg */
-                    any = sprintf (cptr, (any? ",$%d": " $%d"), val);
-                    break;
-
-                case FMT_SA:                            /* shift amt */
-                    any = sprintf (cptr, (any? ",%d": " %d"), val);
-                    break;
-
-                case FMT_CC:                            /* cond code */
-                    val = (val >> 2) & 0x7;             /* don't print 0 */
-                    if (val) any = sprintf (cptr, (any? ",%d": " %d"), val);
-                    break;
-
-                case FMT_SEL:                           /* select */
-                    val = val & 0x7;                    /* don't print 0 */
-                    if (val) any = sprintf (cptr, (any? ",%d": " %d"), val);
-                    break;
-
-                case FMT_CODE:                          /* code */
-                    if (val) any = sprintf (cptr, (any? ",%X": " %X"), val);
-                    break;
-
-                case FMT_IMM:                           /* immediate */
-                    any = sprintf (cptr, (any? ",%X": " %X"), val);
-                    break;
-
-                case FMT_JA:                            /* jump */
-                    addr = ((addr + 4) & J_REGION) | (v64 << 2);
-                    any = sprintf (cptr, (any? ",": " "));
-                    cptr = cptr + strlen (cptr);
-                    sprint_addr (cptr, addr);
-                    break;
-
-                case FMT_BA:                            /* branch */
-                    addr = addr + (SEXT_DISP (v64) << 2) + 4;
-                    any = sprintf (cptr, (any? ",": " "));
-                    cptr = cptr + strlen (cptr);
-                    sprint_addr (cptr, addr);
-                    break;
-
-                case FMT_MA:                            /* mem ref */
-                    if (val & SIGN_DISP)
-                        any = sprintf (cptr, (any? ",-%X": " -%X"), 0x10000 - val);
-                    else any = sprintf (cptr, (any? ",%X": " %X"), val);
-                    if (fld[F_RS]) {
-                        cptr = cptr + strlen (cptr);
-                        sprintf (cptr, "($%d)", fld[F_RS]);
-                        }
-                    break;
-
-                case FMT_XA:                            /* XA */
-                    any = sprintf (cptr, (any? ",$%d": " $%d"), val);
-                    if (fld[F_RT]) {
-                        cptr = cptr + strlen (cptr);
-                        sprintf (cptr, "($%d)", fld[F_RT]);
-                        }
-                    break;
-                }                                       /* end case */
+if ((i = opc_decode (inst)) < 0) return 0;              /* find op */
+fl = opc[i].flg;                                        /* flags */
+fld[F_RS] = I_GETRS (inst);                             /* all fields */
+fld[F_RT] = I_GETRT (inst);
+fld[F_RD] = I_GETRD (inst);
+fld[F_SA] = I_GETSA (inst);
+fld[F_FNC] = I_GETFNC (inst);
+fld[F_JT] = I_GETJT (inst);
+fld[F_DISP] = I_GETDISP (inst);
+fld[F_CODE] = (inst >> I_V_SA) & 0xFFFFF;
+fld[F_Z] = 0;
+any = 0;
+for (optr = opc[i].name; *optr; optr++) {               /* copy op, lc */
+    if (isupper (*optr)) *cptr++ = tolower (*optr);
+    else *cptr++ = *optr;
+    }
+*cptr = 0;
+for (k = 0; k < 4; k++) {                               /* up to 4 fields */
+    uint32 fmt = SYM_GETFMT (fl, k);                    /* get format */
+    uint32 val = fld[SYM_GETFLD (fl, k)];               /* get field */
+    t_uint64 v64 = val;
+    switch (fmt) {                                      /* case fmt */
+
+        case FMT_RC:                                    /* cond ret reg */
+            if (val == 31) break;                       /* dont print 31 */
+        case FMT_R:                                     /* int reg */
+        case FMT_FR:                                    /* flt reg */
+            any = sprintf (cptr, (any? ",$%d": " $%d"), val);
+            break;
+
+        case FMT_SA:                                    /* shift amt */
+            any = sprintf (cptr, (any? ",%d": " %d"), val);
+            break;
+
+        case FMT_CC:                                    /* cond code */
+            val = (val >> 2) & 0x7;                     /* don't print 0 */
+            if (val) any = sprintf (cptr, (any? ",%d": " %d"), val);
+            break;
+
+        case FMT_SEL:                                   /* select */
+            val = val & 0x7;                            /* don't print 0 */
+            if (val) any = sprintf (cptr, (any? ",%d": " %d"), val);
+            break;
+
+        case FMT_CODE:                                  /* code */
+            if (val) any = sprintf (cptr, (any? ",%X": " %X"), val);
+            break;
+
+        case FMT_IMM:                                   /* immediate */
+            any = sprintf (cptr, (any? ",%X": " %X"), val);
+            break;
+
+        case FMT_JA:                                    /* jump */
+            addr = ((addr + 4) & J_REGION) | (v64 << 2);
+            any = sprintf (cptr, (any? ",": " "));
+            cptr = cptr + strlen (cptr);
+            sprint_addr (cptr, addr);
+            break;
+
+        case FMT_BA:                                    /* branch */
+            addr = addr + (SEXT_DISP (v64) << 2) + 4;
+            any = sprintf (cptr, (any? ",": " "));
             cptr = cptr + strlen (cptr);
-            }                                           /* end for k */
-        return strlen (oldptr);
-        }                                               /* end if */
-    }                                                   /* end for i */
-return 0;
+            sprint_addr (cptr, addr);
+            break;
+
+        case FMT_MA:                                    /* mem ref */
+            if (val & SIGN_DISP)
+                any = sprintf (cptr, (any? ",-%X": " -%X"), 0x10000 - val);
+            else any = sprintf (cptr, (any? ",%X": " %X"), val);
+            if (fld[F_RS]) {
+                cptr = cptr + strlen (cptr);
+                sprintf (cptr, "($%d)", fld[F_RS]);
+                }
+            break;
+
+        case FMT_XA:                                    /* XA */
+            any = sprintf (cptr, (any? ",$%d": " $%d"), val);
+            if (fld[F_RT]) {
+                cptr = cptr + strlen (cptr);
+                sprintf (cptr, "($%d)", fld[F_RT]);
+                }
+            break;
+        }                                               /* end case */
+    cptr = cptr + strlen (cptr);
+    }                                                   /* end for k */
+return strlen (oldptr);
 }
 
 /* Symbolic input
@@ -1135,139 +2275,136 @@ return -7;
 
 t_stat parse_sym_m (char *cptr, t_addr addr, t_value *inst)
 {
-uint32 i, k, fl, num_fmt, num_glyph;
+int32 i;
+uint32 k, fl, num_fmt, num_glyph;
 int32 fldv=0, reg;
 t_uint64 jba, df, db;
 t_stat r;
 char *tptr, gbuf[CBUFSIZE];
 
 cptr = get_glyph (cptr, gbuf, 0);                       /* get opcode */
-for (i = 0; opc[i].name != NULL; i++) {                 /* loop thru opcodes */
-    if (strcmp (opc[i].name, gbuf) == 0) {              /* string match? */
-        *inst = opc[i].val;                             /* save base op */
-        fl = opc[i].flg;                                /* get parse data */
-
-        for (k = num_fmt = 0; k < 4; k++) {             /* count #formats */
-            if ((fl >> (k * 8)) & 0xFF) num_fmt++;
-            }
-        for (tptr = cptr, num_glyph = 0;                /* count #fields */
-            *tptr != 0;
-            tptr = get_glyph (tptr, gbuf, ',')) num_glyph++;
-
-        for (k = 0; k < 4; k++) {                       /* up to 4 fields */
-            uint32 fn = SYM_GETFLD (fl, k);             /* get field # */
-            uint32 fmt = SYM_GETFMT (fl, k);            /* get format */
-            switch (fmt) {
-
-            case FMT_RC:                                /* cond ret reg */
-                if (num_glyph < num_fmt) {              /* not enough fields? */
-                    fldv = 31;                          /* default value */
-                    break;
-                    }                                   /* otherwise fall thru */
-            case FMT_R:                                 /* int reg */
-            case FMT_FR:                                /* flt reg */
-                cptr = get_glyph (cptr, gbuf, ',');     /* get glyph */
-                if ((fldv = parse_reg (gbuf, NULL)) < 0) return SCPE_ARG;
-                break;
-
-            case FMT_SA:                                /* 5b literal */
-                cptr = get_glyph (cptr, gbuf, ',');     /* get glyph */
-                fldv = (int32) get_uint (gbuf, 10, 31, &r);
-                if (r != SCPE_OK) return r;
-                break;
-
-            case FMT_CC:                                /* cc */
-                if (num_glyph < num_fmt) fldv = 0;      /* not enough fields? */
-                else {
-                    cptr = get_glyph (cptr, gbuf, ',');
-                    fldv = (int32) (get_uint (gbuf, 10, 7, &r) << 2);
-                    if (r != SCPE_OK) return r;
-                    }
-                break;
+if ((i = opc_lookup (gbuf)) < 0) return SCPE_ARG;      /* find opcode */
+*inst = opc[i].val;                                     /* save base op */
+fl = opc[i].flg;                                        /* get parse data */
 
-            case FMT_SEL:                               /* select */
-                if (num_glyph < num_fmt) fldv = 0;      /* not enough fields? */
-                else {
-                    cptr = get_glyph (cptr, gbuf, ',');
-                    fldv = (int32) get_uint (gbuf, 10, 7, &r);
-                    if (r != SCPE_OK) return r;
-                    }
-                break;
-
-            case FMT_IMM:                               /* 16b literal */
-                cptr = get_glyph (cptr, gbuf, 0);
-                fldv = parse_imm (gbuf, &tptr);
-                if (tptr == gbuf) return SCPE_ARG;
-                break;
-
-            case FMT_CODE:                              /* 20b code */
-                if (num_glyph < num_fmt) fldv = 0;      /* not enough fields? */
-                else {
-                    cptr = get_glyph (cptr, gbuf, 0);
-                    fldv = (int32) get_uint (gbuf, 16, 0xFFFFF, &r);
-                    if (r != SCPE_OK) return r;
-                    fldv = fldv << I_V_SA;
-                    }
-                break;
-
-            case FMT_JA:                                /* jump addr */
-                cptr = get_glyph (cptr, gbuf, 0);       /* get glyph */
-                jba = get_uint (gbuf, 16, M64, &r);
-                if ((r != SCPE_OK) || (jba & 3) ||
-                    (((addr + 4) ^ jba) & J_REGION))
-                    return SCPE_ARG;
-                fldv = ((uint32) (jba & ~J_REGION)) >> 2;
-                break;
-
-            case FMT_BA:                                /* branch addr */
-                cptr = get_glyph (cptr, gbuf, 0);
-                jba = get_uint (gbuf, 16, M64, &r);
-                if ((r != SCPE_OK) || (jba & 3)) return SCPE_ARG;
-                df = ((jba - (addr + 4)) >> 2) & I_M_DISP;
-                db = ((addr + 4 - jba) >> 2) & I_M_DISP;
-                if (jba == (addr + 4 + (SEXT_DISP (df) << 2)))
-                    fldv = (uint32) df;
-                else if (jba == (addr + 4 + (SEXT_DISP (db) << 2)))
-                    fldv = (uint32) db;
-                else return SCPE_ARG;
-                break;
+for (k = num_fmt = 0; k < 4; k++) {                     /* count #formats */
+    if ((fl >> (k * 8)) & 0xFF) num_fmt++;
+    }
+for (tptr = cptr, num_glyph = 0;                        /* count #fields */
+    *tptr != 0;
+    tptr = get_glyph (tptr, gbuf, ',')) num_glyph++;
 
-            case FMT_MA:                                /* mem ref? */
-                cptr = get_glyph (cptr, gbuf, 0);
-                fldv = parse_imm (gbuf, &tptr);
-                if (tptr == gbuf) return SCPE_ARG;
-                if (*tptr == '(') {
-                    tptr = get_glyph (tptr + 1, gbuf, 0);
-                    if ((reg = parse_reg (gbuf, &tptr)) < 0) return SCPE_ARG;
-                    if (*tptr++ != ')') return SCPE_ARG;
-                    fldv |= (reg << I_V_RS);
-                    }
-                if (*tptr != 0) return SCPE_ARG;
-                break;
+for (k = 0; k < 4; k++) {                               /* up to 4 fields */
+    uint32 fn = SYM_GETFLD (fl, k);                     /* get field # */
+    uint32 fmt = SYM_GETFMT (fl, k);                    /* get format */
+    switch (fmt) {
 
-            case FMT_XA:                                /* reg indexed? */
-                cptr = get_glyph (cptr, gbuf, 0);
-                if ((fldv = parse_reg (cptr, &tptr)) < 0) return SCPE_ARG;
-                if (*tptr == '(') {
-                    if ((reg = parse_reg (tptr, &tptr)) < 0) return SCPE_ARG;
-                    if (*tptr != ')') return SCPE_ARG;
-                    fldv |= (reg << 5);
-                    }
-                else if (*tptr) return SCPE_ARG;
-                break;
+    case FMT_RC:                                        /* cond ret reg */
+        if (num_glyph < num_fmt) {                      /* not enough fields? */
+            fldv = 31;                                  /* default value */
+            break;
+            }                                           /* otherwise fall thru */
+    case FMT_R:                                         /* int reg */
+    case FMT_FR:                                        /* flt reg */
+        cptr = get_glyph (cptr, gbuf, ',');             /* get glyph */
+        if ((fldv = parse_reg (gbuf, NULL)) < 0) return SCPE_ARG;
+        break;
+
+    case FMT_SA:                                        /* 5b literal */
+        cptr = get_glyph (cptr, gbuf, ',');             /* get glyph */
+        fldv = (int32) get_uint (gbuf, 10, 31, &r);
+        if (r != SCPE_OK) return r;
+        break;
+
+    case FMT_CC:                                        /* cc */
+        if (num_glyph < num_fmt) fldv = 0;              /* not enough fields? */
+        else {
+            cptr = get_glyph (cptr, gbuf, ',');
+            fldv = (int32) (get_uint (gbuf, 10, 7, &r) << 2);
+            if (r != SCPE_OK) return r;
+            }
+        break;
+
+    case FMT_SEL:                                       /* select */
+        if (num_glyph < num_fmt) fldv = 0;              /* not enough fields? */
+        else {
+            cptr = get_glyph (cptr, gbuf, ',');
+            fldv = (int32) get_uint (gbuf, 10, 7, &r);
+            if (r != SCPE_OK) return r;
+            }
+        break;
+
+    case FMT_IMM:                                       /* 16b literal */
+        cptr = get_glyph (cptr, gbuf, 0);
+        fldv = parse_imm (gbuf, &tptr);
+        if (tptr == gbuf) return SCPE_ARG;
+        break;
+
+    case FMT_CODE:                                      /* 20b code */
+        if (num_glyph < num_fmt) fldv = 0;              /* not enough fields? */
+        else {
+            cptr = get_glyph (cptr, gbuf, 0);
+            fldv = (int32) get_uint (gbuf, 16, 0xFFFFF, &r);
+            if (r != SCPE_OK) return r;
+            fldv = fldv << I_V_SA;
+            }
+        break;
+
+    case FMT_JA:                                        /* jump addr */
+        cptr = get_glyph (cptr, gbuf, 0);               /* get glyph */
+        jba = get_uint (gbuf, 16, M64, &r);
+        if ((r != SCPE_OK) || (jba & 3) ||
+            (((addr + 4) ^ jba) & J_REGION))
+            return SCPE_ARG;
+        fldv = ((uint32) (jba & ~J_REGION)) >> 2;
+        break;
+
+    case FMT_BA:                                        /* branch addr */
+        cptr = get_glyph (cptr, gbuf, 0);
+        jba = get_uint (gbuf, 16, M64, &r);
+        if ((r != SCPE_OK) || (jba & 3)) return SCPE_ARG;
+        df = ((jba - (addr + 4)) >> 2) & I_M_DISP;
+        db = ((addr + 4 - jba) >> 2) & I_M_DISP;
+        if (jba == (addr + 4 + (SEXT_DISP (df) << 2)))
+            fldv = (uint32) df;
+        else if (jba == (addr + 4 + (SEXT_DISP (db) << 2)))
+            fldv = (uint32) db;
+        else return SCPE_ARG;
+        break;
+
+    case FMT_MA:                                        /* mem ref? */
+        cptr = get_glyph (cptr, gbuf, 0);
+        fldv = parse_imm (gbuf, &tptr);
+        if (tptr == gbuf) return SCPE_ARG;
+        if (*tptr == '(') {
+            tptr = get_glyph (tptr + 1, gbuf, 0);
+            if ((reg = parse_reg (gbuf, &tptr)) < 0) return SCPE_ARG;
+            if (*tptr++ != ')') return SCPE_ARG;
+            fldv |= (reg << I_V_RS);
+            }
+        if (*tptr != 0) return SCPE_ARG;
+        break;
+
+    case FMT_XA:                                        /* reg indexed? */
+        cptr = get_glyph (cptr, gbuf, 0);
+        if ((fldv = parse_reg (cptr, &tptr)) < 0) return SCPE_ARG;
+        if (*tptr == '(') {
+            if ((reg = parse_reg (tptr, &tptr)) < 0) return SCPE_ARG;
+            if (*tptr != ')') return SCPE_ARG;
+            fldv |= (reg << 5);
+            }
+        else if (*tptr) return SCPE_ARG;
+        break;
 
-            case FMT_NOPARSE:                           /* do nothing */
-                if (fn == F_Z) fldv = 0;
-                break;          
-                }                                       /* end case */
+    case FMT_NOPARSE:                                   /* do nothing */
+        if (fn == F_Z) fldv = 0;
+        break;          
+        }                                               /* end case */
 
-            *inst |= (fldv << fld_shift[fn]);           /* move into place */
-            }                                           /* end for k */
-        if (*cptr != 0) return SCPE_ARG;                /* any leftovers? */
-        return -3;
-        }                                               /* end if */
-    }                                                   /* end for */
-return SCPE_ARG;
+    *inst |= (fldv << fld_shift[fn]);                   /* move into place */
+    }                                                   /* end for k */
+if (*cptr != 0) return SCPE_ARG;                        /* any leftovers? */
+return -3;
 }
 
 /* Parse a register */
@@ -1332,31 +2469,28 @@ return cptr;
 
 uint32 trace_fetch_reg (CORECTX *ctx, uint32 inst, t_uint64 *reg)
 {
-uint32 i, j, k, fl, fld[16];
+int32 i;
+uint32 j, k, fl, fld[16];
 
 for (k = 0; k < 4; k++)
     reg[k] = 0;
-for (i = 0; opc[i].name != NULL; i++) {                 /* loop thru ops */
-    if (((inst ^ opc[i].val) & opc[i].mask) == 0) {
-        fl = opc[i].flg;                                /* flags */
-        fld[F_RS] = I_GETRS (inst);                     /* all reg fields */
-        fld[F_RT] = I_GETRT (inst);
-        fld[F_RD] = I_GETRD (inst);
-        fld[F_SA] = I_GETSA (inst);
-        for (j = k = 0; k < 4; k++) {                   /* up to 4 reg */
-            uint32 fmt = SYM_GETFMT (fl, k);            /* get format */
-            uint32 fsl = SYM_GETFLD (fl, k);            /* get field select */
-            if ((fsl >= F_RS) && (fsl <= F_SA)) {
-                if ((fmt == FMT_R) || (fmt == FMT_RC))  /* R? */
-                    reg[j++] = gpr(fld[fsl]);        /* get int */
-                else if (fmt == FMT_FR)                 /* F? */
-                    reg[j++] = fpr(fld[fsl]);        /* get flt */
-                }                                       /* end if fsl */
-            }                                           /* end for k */
-        return fl;                                      /* return flags */
-        }                                               /* end if */
-    }                                                   /* end for i */
-return 0;
+if ((i = opc_decode (inst)) < 0) return 0;              /* find op */
+fl = opc[i].flg;                                        /* flags */
+fld[F_RS] = I_GETRS (inst);                             /* all reg fields */
+fld[F_RT] = I_GETRT (inst);
+fld[F_RD] = I_GETRD (inst);
+fld[F_SA] = I_GETSA (inst);
+for (j = k = 0; k < 4; k++) {                           /* up to 4 reg */
+    uint32 fmt = SYM_GETFMT (fl, k);                    /* get format */
+    uint32 fsl = SYM_GETFLD (fl, k);                    /* get field select */
+    if ((fsl >= F_RS) && (fsl <= F_SA)) {
+        if ((fmt == FMT_R) || (fmt == FMT_RC))          /* R? */
+            reg[j++] = gpr(fld[fsl]);                /* get int */
+        else if (fmt == FMT_FR)                         /* F? */
+            reg[j++] = fpr(fld[fsl]);                /* get flt */
+        }                                               /* end if fsl */
+    }                                                   /* end for k */
+return fl;                                              /* return flags */
 }
 
 /* Routine to print one line for tracing */
@@ -166,5 +166,21 @@
 #define F_ALNV          SYM4 (SYM (F_FD, FMT_FR), SYM (F_FS, FMT_FR), SYM (F_FT, FMT_FR), SYM (F_RS, FMT_R))
 #define M_POP           0xFC00003F
 #define F_POP           SYM4 (SYM (F_RD, FMT_R), SYM (F_RS, FMT_R), 0, 0)
+#define M_MG3           0xFC0007FF
+#define F_MG3           SYM4 (SYM (F_RD, FMT_R), SYM (F_RS, FMT_R), SYM (F_RT, FMT_R), 0)
+
+/* Instruction table, and decoders built from it (sc1_sys.c) */
+
+struct opcode {
+    char*               name;
+    uint32              val;
+    uint32              mask;
+    uint32              flg;
+    };
+
+extern struct opcode opc[];
+
+int32 opc_decode (uint32 inst);
+int32 opc_lookup (const char *name);
 
 #endif
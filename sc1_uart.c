@@ -45,6 +45,7 @@
 #include "sc1_defs.h"
 #include "sc1_cac.h"
 #include "sc1_uart.h"
+#include "sc1_jrnl.h"
 #include "simple_socket.h"
 
 #define UNIT_V_8B       (UNIT_V_UF + 0)                 /* 8B */
@@ -388,7 +389,15 @@ char ch;
 
 if (uptr->flags & UNIT_DIS) return SCPE_OK;             /* disabled? stop poll */
 sim_activate (uptr, uptr->wait);                        /* continue poll */
-if (uart_socket_read(&ch) == 1) {
+if (jrnl_mode == JRNL_PLAY) {                           /* replaying? */
+    if (jrnl_replay (JRNL_KBD, &ch, 1) == 1)
+        c = (int32) (uint8) ch | SCPE_KFLAG;
+    else if (jrnl_replay (JRNL_BRK, NULL, 0) == 0)
+        c = SCPE_KFLAG | SCPE_BREAK;
+    else if ((c = sim_poll_kbd ()) >= SCPE_KFLAG)       /* only WRU counts */
+        c = SCPE_OK;
+    }
+else if (uart_socket_read(&ch) == 1) {
     c = (int32) ch | SCPE_KFLAG;
 #ifdef KGDB_SERIAL
     if (kgdb_serial && ch == 0x3) {
@@ -399,6 +408,13 @@ if (uart_socket_read(&ch) == 1) {
 } else {
     c = sim_poll_kbd ();
 }
+if ((jrnl_mode == JRNL_REC) && (c >= SCPE_KFLAG)) {     /* log the input */
+    if (c & SCPE_BREAK) jrnl_record (JRNL_BRK, NULL, 0);
+    else {
+        ch = (char) c;
+        jrnl_record (JRNL_KBD, &ch, 1);
+        }
+    }
 if (c < SCPE_KFLAG) {        /* no char or error? */
     if (uart_rcv_tmo && (--uart_rcv_tmo == 0)) {        /* countdown to 0? */
         uart_ista |= UART_ISTA_TMO;                     /* set timeout int */
@@ -55,6 +55,7 @@ return SCPE_OK;
 #include "sc1_defs.h"
 #include "tapd.h"
 #include "sc1_eth.h"
+#include "sc1_jrnl.h"
 
 #define ETH_POLL_INTVL 100000
 
@@ -366,6 +367,7 @@ static t_bool eth_wr(t_uint64 pa, t_uint64 idata, uint32 unit)
 {
     uint32 relative_addr = ((uint32) ((pa - ETHBASE) ));
     struct eth_priv *priv = &priv_instance;
+    uint32 old_int;
 
     if (relative_addr == ETH_IOREG)
     {
@@ -385,10 +387,12 @@ static t_bool eth_wr(t_uint64 pa, t_uint64 idata, uint32 unit)
             eth_nextpacket(priv);
         if (idata & ETH_IOREG_W_PKT_WRITTEN)
             eth_write(priv, ETH_IOREG_W_PKT_SIZE(idata));
+        old_int = global_int;
         global_int &= ~(INT_ETH);
         if (priv->packetavail && priv->enabinterrupts)
             global_int |= INT_ETH;
-        eval_intr_all();
+        if (global_int != old_int)
+            eval_intr_all();
 
     } else if (relative_addr == ETH_IOCTL_MIN) {
         return eth_ioctl(priv, idata);
@@ -424,7 +428,18 @@ static t_stat eth_rcv_svc( UNIT *uptr )
 {
     struct eth_priv *priv = &priv_instance;
 
-    if (priv->up && priv->fd)
+    if (jrnl_mode == JRNL_PLAY)
+    {
+        static uint32 frame[(JRNL_MAXREC + 3) / 4];
+        int32 size;
+
+        while ((size = jrnl_replay(JRNL_ETH, frame, sizeof(frame))) >= 0)
+        {
+            eth_putpacket(priv, frame, (uint16) size);
+            eth_loadpacket(priv);
+        }
+    }
+    else if (priv->up && priv->fd)
     {
         ethmsg_t emsg;
         struct pollfd pfd;
@@ -444,6 +459,7 @@ static t_stat eth_rcv_svc( UNIT *uptr )
             read(priv->fd, &emsg, sizeof(emsg));
             if (emsg.type == ETPACKET)
             {
+                jrnl_record(JRNL_ETH, emsg.payload.ep.data, emsg.payload.ep.size);
                 eth_putpacket(priv, (uint32*)emsg.payload.ep.data, emsg.payload.ep.size);
                 eth_loadpacket(priv);
             } else if (emsg.type == ETIOCTL) {
@@ -454,10 +470,11 @@ static t_stat eth_rcv_svc( UNIT *uptr )
             pfd.revents = 0;
         }
     }
-    if (priv->enabinterrupts && priv->packetavail)
+    if (priv->enabinterrupts && priv->packetavail &&
+        !(global_int & INT_ETH))
     {
         global_int |= INT_ETH;
-        eval_intr_all ();
+        intr_dirty |= INTR_ALL;          /* evaluated after this event */
     }
 
     sim_activate(uptr, ETH_POLL_INTVL);
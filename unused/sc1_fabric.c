@@ -0,0 +1,567 @@
+/* sc1_fabric.c - Shared-memory fabric links between SC1 nodes
+
+   Copyright (c) 2005, SiCortex, Inc.  All rights reserved.
+
+   Permission is hereby granted, free of charge, to any person obtaining a
+   copy of this software and associated documentation files (the "Software"),
+   to deal in the Software without restriction, including without limitation
+   the rights to use, copy, modify, merge, publish, distribute, sublicense,
+   and/or sell copies of the Software, and to permit persons to whom the
+   Software is furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+   ROBERT M SUPNIK BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+   IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+   CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+   Except as contained in this notice, the name of Robert M Supnik shall not
+   be used in advertising or otherwise to promote the sale, use or other dealings
+   in this Software without prior written authorization from Robert M Supnik.
+
+*/
+
+/* A multi-node job runs one simulator process per node on the same host.
+   Node 0 creates a segment (a file, normally under /dev/shm) that every
+   node maps shared; it holds
+
+	header		magic, node count, job number
+	node[i]		quantum counter and state of node i
+	ring[s][d]	packets from node s to node d
+
+   Node 0 removes any old segment at the path and creates a fresh one.
+   The other nodes only accept a segment that node 0 of their own job
+   made.  It must carry their job number (SET SCDMA FABRIC=...,job,path),
+   node 0 must not have left it, and the path must still name it.  So a
+   node that starts before node 0 does not join a segment left by the
+   last job.  Without a job number, a segment left by a job whose node 0
+   crashed can still be taken, so give one or use a fresh path per job.
+
+   Each ring has exactly one producer (s) and one consumer (d), so it
+   needs no lock: the producer fills a slot and then advances tail, the
+   consumer copies a slot out and then advances head, with a memory
+   barrier between the data and the index in both directions.
+
+   The nodes are kept in step by quantum.  fabric_sync is called from the
+   SCDMA fabric service once per quantum; it bumps the node's counter and
+   then waits until no running node is behind it, so no two running
+   nodes are ever more than one quantum apart.  Only running nodes are
+   waited for: a node that has not attached yet, is stopped at the
+   console (mem_run_hook), or has detached or exited is not.  A node that
+   starts or resumes takes the quantum of the furthest running node.  A
+   node that keeps us waiting FAB_SYNC_MS is reported and skipped until
+   it catches up, and the console stop key is honoured while waiting.
+   Waiting is a short spin and then, on Linux, a futex wait on the
+   slower node's change counter (seq), which that node wakes whenever
+   its quantum or state changes; elsewhere, sleeps that double from
+   FAB_NAP_US up to 1ms.
+
+   Two jobs running at the same time must not use the same path.
+*/
+
+#include "sc1_defs.h"
+#include "sc1_cmod.h"
+#include "sc1_fabric.h"
+
+#if !defined (_WIN32)
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#if defined (__linux__)
+#include <limits.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+
+#define FAB_MAGIC       0x53433146                      /* "SC1F" */
+#define FAB_WAIT_MS     30000                           /* attach timeout */
+#define FAB_SYNC_MS     10000                           /* sync timeout */
+#define FAB_SPINS       64                              /* checks, then sleeps */
+#define FAB_NAP_US      20                              /* first sleep */
+#define FAB_POLL_MS     100                             /* stop key, timeout */
+#define FAB_LINE        64                              /* cache line */
+
+#define FAB_ABSENT      0                               /* node states */
+#define FAB_RUNNING     1
+#define FAB_GONE        2
+#define FAB_STOPPED     3                               /* at the console */
+
+#define FAB_MB()        __sync_synchronize ()
+
+typedef struct {
+    uint32      len;                                    /* bytes used */
+    uint32      src;                                    /* sending node */
+    unsigned char data[FAB_PKTMAX];
+    } FABPKT;
+
+typedef struct {
+    volatile uint32 head;                               /* next to receive */
+    char        pad0[FAB_LINE - sizeof (uint32)];
+    volatile uint32 tail;                               /* next to send */
+    char        pad1[FAB_LINE - sizeof (uint32)];
+    FABPKT      slot[FAB_RING];
+    } FABRING;
+
+typedef struct {
+    volatile t_uint64 quantum;                          /* quanta completed */
+    volatile uint32 state;                              /* FAB_x */
+    volatile uint32 seq;                                /* changes, futex word */
+    volatile uint32 waiters;                            /* nodes waiting on seq */
+    char        pad[FAB_LINE - sizeof (t_uint64) - 3 * sizeof (uint32)];
+    } FABNODE;
+
+typedef struct {
+    volatile uint32 magic;
+    uint32      nnodes;
+    uint32      job;                                    /* job number, 0 = none */
+    char        pad[FAB_LINE - 3 * sizeof (uint32)];
+    FABNODE     node[FAB_NODES_MAX];
+    } FABHDR;
+
+static FABHDR *fab_hdr = NULL;                          /* mapped segment */
+static FABRING *fab_ring = NULL;                        /* ring[0][0] */
+static size_t fab_size = 0;                             /* segment bytes */
+static uint32 fab_self = 0;                             /* this node */
+static uint32 fab_n = 0;                                /* nodes in job */
+static uint32 fab_next = 0;                             /* next ring to poll */
+static uint32 fab_job = 0;                              /* job number */
+static char fab_path[256] = "";                         /* segment file */
+static t_bool fab_atexit = FALSE;                       /* exit hook set */
+static t_bool fab_skip[FAB_NODES_MAX];                  /* timed out, skipped */
+
+t_uint64 fab_sent = 0;                                  /* packets sent */
+t_uint64 fab_rcvd = 0;                                  /* packets received */
+t_uint64 fab_full = 0;                                  /* sends refused */
+t_uint64 fab_waits = 0;                                 /* quanta waited */
+
+#define FAB_LINK(s,d)   (&fab_ring[((s) * fab_n) + (d)])
+
+static size_t fabric_size (uint32 nnodes)
+{
+    return sizeof (FABHDR) + ((size_t) nnodes * nnodes * sizeof (FABRING));
+}
+
+/* This node's quantum or state changed: wake the nodes waiting on it */
+
+static void fabric_post (void)
+{
+    FABNODE *np = &fab_hdr->node[fab_self];
+
+    __sync_fetch_and_add (&np->seq, 1);                 /* a full barrier */
+    if (np->waiters) {
+#if defined (__linux__)
+	syscall (SYS_futex, &np->seq, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+#endif
+    }
+}
+
+/* Wait up to about ms for node i's seq to move on from seq */
+
+static void fabric_wait (uint32 i, uint32 seq, uint32 *nap)
+{
+    FABNODE *np = &fab_hdr->node[i];
+#if defined (__linux__)
+    struct timespec ts = { 0, 10 * 1000000 };           /* 10ms slices */
+
+    __sync_fetch_and_add (&np->waiters, 1);
+    if (np->seq == seq)
+	syscall (SYS_futex, &np->seq, FUTEX_WAIT, seq, &ts, NULL, 0);
+    __sync_fetch_and_sub (&np->waiters, 1);
+#else
+    if (np->seq == seq) {
+	usleep (*nap);
+	if (*nap < 1000)
+	    *nap <<= 1;
+    }
+#endif
+}
+
+static uint32 fabric_msec (void)
+{
+    struct timespec ts;
+
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+    return (uint32) ((ts.tv_sec * 1000) + (ts.tv_nsec / 1000000));
+}
+
+/* Map the segment file at path if it is at least sz bytes; its identity
+   goes to *sb */
+
+static FABHDR *fabric_map (const char *path, int flags, size_t sz, struct stat *sb)
+{
+    void *p;
+    int fd;
+
+    if ((fd = open (path, flags, 0600)) < 0)
+	return NULL;
+    if ((flags & O_CREAT) && (ftruncate (fd, (off_t) sz) < 0)) {
+	close (fd);
+	return NULL;
+    }
+    if ((fstat (fd, sb) != 0) || ((size_t) sb->st_size < sz)) {
+	close (fd);
+	errno = EAGAIN;
+	return NULL;
+    }
+    p = mmap (NULL, sz, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close (fd);
+    return (p == MAP_FAILED)? NULL: (FABHDR *) p;
+}
+
+/* Is hp, mapped from a file with identity sb, this job's segment? */
+
+static t_bool fabric_ours (FABHDR *hp, const char *path, struct stat *sb,
+    uint32 nnodes, uint32 job)
+{
+    struct stat now;
+
+    FAB_MB ();
+    return (hp->magic == FAB_MAGIC) && (hp->nnodes == nnodes) &&
+	((job == 0) || (hp->job == job)) &&
+	(hp->node[0].state != FAB_GONE) &&              /* node 0 left: stale */
+	(stat (path, &now) == 0) &&                     /* not replaced */
+	(now.st_dev == sb->st_dev) && (now.st_ino == sb->st_ino);
+}
+
+/* Quantum of the furthest running node, at least q */
+
+static t_uint64 fabric_front (t_uint64 q)
+{
+    uint32 i;
+
+    for (i = 0; i < fab_n; i++) {
+	if ((i != fab_self) && (fab_hdr->node[i].state == FAB_RUNNING) &&
+	    (fab_hdr->node[i].quantum > q))
+	    q = fab_hdr->node[i].quantum;
+    }
+    return q;
+}
+
+/* sim_instr start (run) and stop, through mem_run_hook */
+
+static void fabric_run (t_bool run)
+{
+    if (fab_hdr == NULL)
+	return;
+    if (run) {
+	FAB_MB ();
+	fab_hdr->node[fab_self].quantum = fabric_front (fab_hdr->node[fab_self].quantum);
+	FAB_MB ();
+	fab_hdr->node[fab_self].state = FAB_RUNNING;
+    }
+    else fab_hdr->node[fab_self].state = FAB_STOPPED;
+    fabric_post ();
+}
+
+/* Attach this process as node 'node' of an 'nnodes' job */
+
+t_stat fabric_attach (char *path, uint32 node, uint32 nnodes, uint32 job)
+{
+    struct stat sb;
+    size_t sz;
+    FABHDR *hp;
+    int ms;
+
+    if ((nnodes < 2) || (nnodes > FAB_NODES_MAX) || (node >= nnodes))
+	return SCPE_ARG;
+    if (strlen (path) >= sizeof (fab_path))
+	return SCPE_ARG;
+    fabric_detach ();
+    sz = fabric_size (nnodes);
+    if (node == 0) {                                    /* creator */
+	unlink (path);
+	if ((hp = fabric_map (path, O_RDWR | O_CREAT | O_EXCL, sz, &sb)) == NULL) {
+	    fprintf (stderr, "%%Error: FABRIC: can't create %s: %s\n", path, strerror (errno));
+	    return SCPE_OPENERR;
+	}
+	hp->nnodes = nnodes;                            /* new file is zero */
+	hp->job = job;
+	FAB_MB ();
+	hp->magic = FAB_MAGIC;
+    }
+    else {                                              /* wait for node 0 */
+	for (ms = 0; ; ms += 10) {
+	    if ((hp = fabric_map (path, O_RDWR, sz, &sb)) != NULL) {
+		if (fabric_ours (hp, path, &sb, nnodes, job))
+		    break;
+		munmap ((void *) hp, sz);               /* old or not yet */
+	    }
+	    if (ms >= FAB_WAIT_MS) {
+		fprintf (stderr, "%%Error: FABRIC: no %d node fabric for job %d at %s\n",
+			 nnodes, job, path);
+		return SCPE_OPENERR;
+	    }
+	    usleep (10000);
+	}
+    }
+    fab_hdr = hp;
+    fab_job = job;
+    fab_ring = (FABRING *) (fab_hdr + 1);
+    fab_size = sz;
+    fab_self = node;
+    fab_n = nnodes;
+    fab_next = 0;
+    strcpy (fab_path, path);
+    if (!fab_atexit) {                                  /* don't hold others up */
+	atexit (fabric_detach);
+	fab_atexit = TRUE;
+    }
+    memset (fab_skip, 0, sizeof (fab_skip));
+    fab_hdr->node[node].quantum = 0;
+    FAB_MB ();
+    fab_hdr->node[node].state = FAB_STOPPED;            /* until sim_instr */
+    fabric_post ();
+    mem_run_hook = &fabric_run;
+    cmod_fork_hook = &fabric_forget;
+    return SCPE_OK;
+}
+
+void fabric_detach (void)
+{
+    if (fab_hdr == NULL)
+	return;
+    fab_hdr->node[fab_self].state = FAB_GONE;
+    fabric_post ();
+    fabric_forget ();
+}
+
+/* Unmap the segment without telling the other nodes: a forked sample
+   worker must not send, receive or sync on its parent's links, nor mark
+   the parent's node gone. */
+
+void fabric_forget (void)
+{
+    if (fab_hdr == NULL)
+	return;
+    if (mem_run_hook == &fabric_run)
+	mem_run_hook = NULL;
+    if (cmod_fork_hook == &fabric_forget)
+	cmod_fork_hook = NULL;
+    munmap ((void *) fab_hdr, fab_size);
+    fab_hdr = NULL;
+    fab_ring = NULL;
+    fab_n = 0;
+}
+
+t_bool fabric_active (void)
+{
+    return (fab_hdr != NULL);
+}
+
+uint32 fabric_node (void)
+{
+    return fab_self;
+}
+
+uint32 fabric_nnodes (void)
+{
+    return fab_n;
+}
+
+/* Send a packet to node dst.  Returns 0, or -1 if the link is full (the
+   caller retries on a later poll, as a busy fabric port would) or the
+   arguments are bad. */
+
+int fabric_send (uint32 dst, const void *pkt, uint32 len)
+{
+    FABRING *rp;
+    FABPKT *sp;
+    uint32 tail;
+
+    if ((fab_hdr == NULL) || (dst >= fab_n) || (dst == fab_self) || (len > FAB_PKTMAX))
+	return -1;
+    rp = FAB_LINK (fab_self, dst);
+    tail = rp->tail;
+    if ((tail - rp->head) >= FAB_RING) {
+	fab_full++;
+	return -1;
+    }
+    sp = &rp->slot[tail % FAB_RING];
+    sp->len = len;
+    sp->src = fab_self;
+    memcpy (sp->data, pkt, len);
+    FAB_MB ();                                          /* data before index */
+    rp->tail = tail + 1;
+    fab_sent++;
+    return 0;
+}
+
+/* Receive the next packet from any node, polling links round-robin so no
+   sender is starved.  Returns its length (the source in *src), or 0 if
+   nothing is waiting. */
+
+int fabric_recv (uint32 *src, void *pkt, uint32 max)
+{
+    FABRING *rp;
+    FABPKT *sp;
+    uint32 i, s, head, len;
+
+    if (fab_hdr == NULL)
+	return 0;
+    for (i = 0; i < fab_n; i++) {
+	s = (fab_next + i) % fab_n;
+	if (s == fab_self)
+	    continue;
+	rp = FAB_LINK (s, fab_self);
+	head = rp->head;
+	if (head == rp->tail)
+	    continue;
+	FAB_MB ();                                      /* index before data */
+	sp = &rp->slot[head % FAB_RING];
+	len = (sp->len < max)? sp->len: max;
+	memcpy (pkt, sp->data, len);
+	if (src)
+	    *src = s;
+	FAB_MB ();                                      /* data before index */
+	rp->head = head + 1;
+	fab_next = s + 1;
+	fab_rcvd++;
+	return (int) len;
+    }
+    return 0;
+}
+
+/* Is a packet waiting on any link into this node? */
+
+t_bool fabric_pending (void)
+{
+    FABRING *rp;
+    uint32 s;
+
+    if (fab_hdr == NULL)
+	return FALSE;
+    for (s = 0; s < fab_n; s++) {
+	rp = FAB_LINK (s, fab_self);
+	if ((s != fab_self) && (rp->head != rp->tail))
+	    return TRUE;
+    }
+    return FALSE;
+}
+
+/* End of a quantum: wait until every running node has caught up.
+   Returns SCPE_STOP if the stop key was typed while waiting. */
+
+#define FAB_BEHIND(i,q) ((fab_hdr->node[i].state == FAB_RUNNING) && \
+			 (fab_hdr->node[i].quantum < (q)))
+
+t_stat fabric_sync (void)
+{
+    t_uint64 q;
+    uint32 i, n, seq, nap, t0, tpoll, now;
+    t_bool waited = FALSE;
+
+    if (fab_hdr == NULL)
+	return SCPE_OK;
+    q = fab_hdr->node[fab_self].quantum + 1;
+    FAB_MB ();
+    fab_hdr->node[fab_self].quantum = q;
+    fabric_post ();
+    for (i = 0; i < fab_n; i++) {
+	if (fab_skip[i]) {                              /* caught up yet? */
+	    if (FAB_BEHIND (i, q))
+		continue;
+	    fab_skip[i] = FALSE;
+	}
+	for (n = 0, nap = FAB_NAP_US, t0 = tpoll = 0; ; n++) {
+	    seq = fab_hdr->node[i].seq;                 /* before the test */
+	    FAB_MB ();
+	    if (!FAB_BEHIND (i, q))
+		break;
+	    waited = TRUE;
+	    if (n < FAB_SPINS)
+		continue;
+	    if (t0 == 0)
+		t0 = tpoll = fabric_msec ();
+	    fabric_wait (i, seq, &nap);
+	    now = fabric_msec ();
+	    if ((now - tpoll) >= FAB_POLL_MS) {
+		tpoll = now;
+		if (sim_poll_kbd () == SCPE_STOP)       /* other keys are lost */
+		    return SCPE_STOP;
+		if ((now - t0) >= FAB_SYNC_MS) {
+		    fprintf (stderr, "%%Warning: FABRIC: node %d not responding, not waiting for it\n", i);
+		    fab_skip[i] = TRUE;
+		    break;
+		}
+	    }
+	}
+    }
+    FAB_MB ();
+    if (waited)
+	fab_waits++;
+    return SCPE_OK;
+}
+
+#else /* _WIN32 */
+
+t_uint64 fab_sent = 0, fab_rcvd = 0, fab_full = 0, fab_waits = 0;
+
+t_stat fabric_attach (char *path, uint32 node, uint32 nnodes, uint32 job)
+{
+    return SCPE_NOFNC;
+}
+
+void fabric_detach (void) {}
+void fabric_forget (void) {}
+t_bool fabric_active (void) { return FALSE; }
+uint32 fabric_node (void) { return 0; }
+uint32 fabric_nnodes (void) { return 0; }
+int fabric_send (uint32 dst, const void *pkt, uint32 len) { return -1; }
+int fabric_recv (uint32 *src, void *pkt, uint32 max) { return 0; }
+t_stat fabric_sync (void) { return SCPE_OK; }
+t_bool fabric_pending (void) { return FALSE; }
+
+#endif
+
+/* SET <dev> FABRIC=node,nnodes,path / NOFABRIC, SHOW <dev> FABRIC */
+
+t_stat fabric_set (UNIT *uptr, int32 val, char *cptr, void *desc)
+{
+    char *ep;
+    unsigned long node, nnodes, job = 0;
+
+    if (val) {                                          /* NOFABRIC */
+	if (cptr != NULL)
+	    return SCPE_ARG;
+	fabric_detach ();
+	return SCPE_OK;
+    }
+    if ((cptr == NULL) || (*cptr == 0))
+	return SCPE_ARG;
+    node = strtoul (cptr, &ep, 10);
+    if ((ep == cptr) || (*ep++ != ','))
+	return SCPE_ARG;
+    cptr = ep;
+    nnodes = strtoul (cptr, &ep, 10);
+    if ((ep == cptr) || (*ep++ != ',') || (*ep == 0))
+	return SCPE_ARG;
+    cptr = ep;
+    if ((*cptr >= '0') && (*cptr <= '9')) {             /* job number? */
+	job = strtoul (cptr, &ep, 10);
+	if ((*ep++ != ',') || (*ep == 0))
+	    return SCPE_ARG;
+    }
+    return fabric_attach (ep, (uint32) node, (uint32) nnodes, (uint32) job);
+}
+
+t_stat fabric_show (FILE *st, UNIT *uptr, int32 val, void *desc)
+{
+    if (!fabric_active ()) {
+	fprintf (st, "no fabric");
+	return SCPE_OK;
+    }
+    fprintf (st, "fabric node %d of %d on %s", fabric_node (), fabric_nnodes (), fab_path);
+    if (fab_job)
+	fprintf (st, ", job %d", fab_job);
+    fprintf (st, ", sent=%lld rcvd=%lld full=%lld waits=%lld",
+	     fab_sent, fab_rcvd, fab_full, fab_waits);
+    return SCPE_OK;
+}
@@ -0,0 +1,31 @@
+#ifndef __SC1_FABRIC_H__
+#define __SC1_FABRIC_H__
+
+/* Shared-memory fabric links between SC1 nodes on one host
+
+   Each node is a simulator process; all nodes of a job map the same
+   segment, which holds one single-producer/single-consumer packet ring
+   per ordered node pair and one quantum counter per node.  See
+   sc1_fabric.c.
+*/
+
+#define FAB_NODES_MAX     64                            /* nodes per segment */
+#define FAB_RING          64                            /* packets per link */
+#define FAB_PKTMAX        128                           /* bytes per packet */
+
+t_stat fabric_attach (char *path, uint32 node, uint32 nnodes, uint32 job);
+void fabric_detach (void);
+void fabric_forget (void);
+t_bool fabric_active (void);
+uint32 fabric_node (void);
+uint32 fabric_nnodes (void);
+int fabric_send (uint32 dst, const void *pkt, uint32 len);
+int fabric_recv (uint32 *src, void *pkt, uint32 max);
+t_stat fabric_sync (void);
+t_bool fabric_pending (void);
+t_stat fabric_set (UNIT *uptr, int32 val, char *cptr, void *desc);
+t_stat fabric_show (FILE *st, UNIT *uptr, int32 val, void *desc);
+
+extern t_uint64 fab_sent, fab_rcvd, fab_full, fab_waits;
+
+#endif /* guard */
@@ -49,6 +49,7 @@ static t_stat gdb_reset(DEVICE *dptr)
 #include <stdlib.h>
 #include <string.h>
 #include <signal.h>
+#include <errno.h>
 #include <sys/poll.h>
 #include <sys/types.h>
 #include <sys/socket.h>
@@ -86,10 +87,38 @@ static t_stat gdb_attach( UNIT *uptr, char *cptr );
 static t_stat gdb_detach( UNIT *uptr );
 static t_stat gdb_rcv_svc( UNIT *uptr );
 static void handle_exception(int cpu);
-static void putDebugChar(char ch);     /* write a single character      */
-static char getDebugChar();      /* read and return a single char */
-static unsigned char * getpacket(void);
-static void putpacket(unsigned char * buffer);
+static int handle_packet(char *ptr, int len);
+static void gdb_poll(void);
+static void gdb_hold(int cpu, int hold);
+static void gdb_hangup(void);
+static void putDebugChar(char ch);     /* queue a single character      */
+static int getDebugChar(void);         /* read and return a single char */
+static void flushDebugChars(void);     /* write the queued characters   */
+static unsigned char * getpacket(int *len);
+static void putpacket(unsigned char * buffer, int len);
+static void putnotify(unsigned char * buffer);
+
+/* Stub state
+
+   Each enabled core is a gdb thread, numbered core + 1 (0 means "any").
+   In all-stop mode (the default) a stop on any core freezes the whole
+   simulation inside handle_exception until gdb continues.  After
+   QNonStop:1 only the stopped core is held (EVT_GDB): the others keep
+   running, the stop is reported as a %Stop notification, and packets
+   are serviced from the poll routine without blocking the simulator.
+*/
+
+static int gdb_noack = 0;                               /* QStartNoAckMode */
+static int gdb_nonstop = 0;                             /* QNonStop:1 */
+static int gdb_gthread = 0;                             /* Hg core */
+static int gdb_cthread = -1;                            /* Hc core, -1 = all */
+static uint32 gdb_held = 0;                             /* held cores */
+static uint32 gdb_pend = 0;                             /* unreported stops */
+static int gdb_notified = 0;                            /* %Stop in flight */
+static int gdb_sig[NUM_CORES];                          /* stop signal */
+static uint32 gdb_pkt_in = 0;                           /* packets received */
+static uint32 gdb_pkt_out = 0;                          /* packets sent */
+static t_uint64 gdb_mem_bytes = 0;                      /* memory bytes moved */
 
 /* SIMH data definitions */
 
@@ -97,10 +126,19 @@ UNIT gdb_unit[] = {
         { UDATA(&gdb_rcv_svc, UNIT_ATTABLE, 0) },
 };
 
+REG gdb_reg[] = {
+    { DRDATA(pkt_in, gdb_pkt_in, 32), REG_RO },
+    { DRDATA(pkt_out, gdb_pkt_out, 32), REG_RO },
+    { DRDATA(mem_bytes, gdb_mem_bytes, 64), REG_RO },
+    { FLDATA(nonstop, gdb_nonstop, 0), REG_RO },
+    { HRDATA(held, gdb_held, NUM_CORES), REG_RO },
+    { NULL }
+};
+
 DEVICE gdb_dev = {
     "GDB",              /* name */
     gdb_unit,           /* units */
-    NULL,               /* registers */
+    gdb_reg,            /* registers */
     NULL,               /* modifiers */
     1,                  /* #units */
     16,                 /* address radix */
@@ -121,6 +159,7 @@ DEVICE gdb_dev = {
 /* SIMH external declarations */
 
 extern CORECTX *cpu_ctx[NUM_CORES];
+extern UNIT mem_unit;
 
 extern t_uint64 fp_getcr (CORECTX *ctx, uint32 rn);
 
@@ -148,6 +187,61 @@ if (!xlate_va (ctx, va, VA_CON, &pa, &catr)) return FALSE;
 return CALL_WRITEPB (ctx, pa, val, catr);
 }
 
+/* Bulk console access, one translation per page
+
+   A virtual range is split at page boundaries; each piece is translated
+   once and then moved with mem_dma_read/mem_dma_write when it lies in
+   main memory, or a byte at a time through the physical routines when
+   it does not (I/O space, ROM, SIMH_CPUSIMH).  Returns the number of
+   bytes moved before the first translation or access failure.
+*/
+
+static int gdb_read_mem (CORECTX *ctx, t_uint64 va, unsigned char *buf, int len)
+{
+t_uint64 pa, val;
+uint32 catr;
+int done, i, n;
+
+for (done = 0; done < len; done = done + n) {
+    n = (int) ((VA_M_OFF + 1) - (va & VA_M_OFF));   /* rest of page */
+    if (n > (len - done)) n = len - done;
+    if (Q_MD_U32) va = SEXT_W_D (va);
+    if (!xlate_va (ctx, va, VA_CON, &pa, &catr)) break;
+    if (!mem_dma_read (pa, buf + done, n)) {            /* not plain memory? */
+        for (i = 0; i < n; i++) {
+            if (!CALL_READPB (ctx, pa + i, &val, catr)) return done + i;
+            buf[done + i] = (unsigned char) val;
+            }
+        }
+    va = va + n;
+    }
+gdb_mem_bytes = gdb_mem_bytes + done;
+return done;
+}
+
+static int gdb_write_mem (CORECTX *ctx, t_uint64 va, unsigned char *buf, int len)
+{
+t_uint64 pa;
+uint32 catr;
+int done, i, n;
+
+for (done = 0; done < len; done = done + n) {
+    n = (int) ((VA_M_OFF + 1) - (va & VA_M_OFF));   /* rest of page */
+    if (n > (len - done)) n = len - done;
+    if (Q_MD_U32) va = SEXT_W_D (va);
+    if (!xlate_va (ctx, va, VA_CON, &pa, &catr)) break;
+    if (!mem_dma_write (pa, buf + done, n)) {           /* not plain memory? */
+        for (i = 0; i < n; i++) {
+            if (!CALL_WRITEPB (ctx, pa + i, buf[done + i], catr))
+                return done + i;
+            }
+        }
+    va = va + n;
+    }
+gdb_mem_bytes = gdb_mem_bytes + done;
+return done;
+}
+
 static t_stat gdb_reset(DEVICE *dptr)
 {
     sim_activate(dptr->units, GDB_POLL_INTVL);
@@ -180,6 +274,9 @@ static t_stat gdb_detach( UNIT *uptr )
 {
     struct simple_socket_priv *p = &gdb_socket_priv;
 
+    if (p->state == SIMPSOCK_IO) {
+        gdb_hangup();
+    }
     p->state = SIMPSOCK_OFF;
     printf("gdb_detach: detached\r\n");
 
@@ -193,6 +290,55 @@ static t_stat gdb_rcv_svc( UNIT *uptr )
     return gdb_stub(0);
 }
 
+/* Is core cpu a thread gdb can see? */
+
+static int gdb_core_ok(int cpu)
+{
+    char name[8];
+    DEVICE *dptr;
+
+    if ((cpu < 0) || (cpu >= NUM_CORES) || (cpu_ctx[cpu] == NULL)) {
+        return 0;
+    }
+    sprintf(name, "CPU%d", cpu);
+    dptr = find_dev(name);
+    return (dptr != NULL) && !(dptr->flags & DEV_DIS);
+}
+
+/* Hold or release one core (non-stop mode) */
+
+static void gdb_hold(int cpu, int hold)
+{
+    if (hold) {
+        cpu_ctx[cpu]->events |= EVT_GDB;
+        gdb_held |= (1u << cpu);
+    } else {
+        cpu_ctx[cpu]->events &= ~EVT_GDB;
+        gdb_held &= ~(1u << cpu);
+        gdb_pend &= ~(1u << cpu);
+    }
+}
+
+/* Connection lost or killed: drop it and let every core run */
+
+static void gdb_hangup(void)
+{
+    struct simple_socket_priv *p = &gdb_socket_priv;
+    int i;
+
+    close(p->newsockfd);
+    p->state = SIMPSOCK_ATTACH;
+    for (i = 0; i < NUM_CORES; i++) {
+        if (gdb_held & (1u << i)) gdb_hold(i, 0);
+    }
+    gdb_noack = 0;
+    gdb_nonstop = 0;
+    gdb_pend = 0;
+    gdb_notified = 0;
+    gdb_gthread = 0;
+    gdb_cthread = -1;
+}
+
 t_stat gdb_stub(int cpu)
 {
     struct simple_socket_priv *p = &gdb_socket_priv;
@@ -201,16 +347,34 @@ t_stat gdb_stub(int cpu)
 
     if (p->state != SIMPSOCK_IO) {
         do_simple_socket(p, SIMPSOCK_INIT, NULL, NULL);
+        first_time = 1;
     }
 
-    if (p->state == SIMPSOCK_IO) {
+    if (p->state != SIMPSOCK_IO) {
+        return SCPE_OK;
+    }
+
+    if (first_time) {
+        first_time = 0;
+        handle_exception(cpu);
+    } else if ((cpu_ctx[cpu]->traps & TRAP_GEN) &&
+               (cpu_ctx[cpu]->traps & TRAP_BREAK)) {
+        if (gdb_nonstop) {
+            /* Park this core only and tell gdb asynchronously */
+            gdb_hold(cpu, 1);
+            gdb_sig[cpu] = SIGTRAP;
+            gdb_pend |= (1u << cpu);
+            gdb_poll();
+        } else {
+            handle_exception(cpu);
+        }
+    } else {
         pfd.revents = 0;
         pfd.events = POLLIN | POLLPRI;
         pfd.fd = p->newsockfd;
-        if ((first_time) || (poll(&pfd, 1, 0)) ||
-            ((cpu_ctx[cpu]->traps & TRAP_GEN) && 
-             (cpu_ctx[cpu]->traps & TRAP_BREAK))) {
-            first_time=0;
+        if (gdb_nonstop) {
+            gdb_poll();
+        } else if (poll(&pfd, 1, 0) > 0) {
             handle_exception(cpu);
         }
     }
@@ -225,25 +389,89 @@ t_stat gdb_stub(int cpu)
  *
  */
 
-static void putDebugChar(char ch)
-{
-    int io_status;
+/* Socket buffers
+
+   Input is read from the socket in blocks and handed out a character
+   at a time; output is collected and written once per packet, so a
+   reply costs one system call instead of one per character.
+*/
 
-    do_simple_socket(&gdb_socket_priv, SIMPSOCK_BLOCKING_WRITE, &ch, &io_status);
+static char gdb_ibuf[BUFMAX];
+static int gdb_ipos = 0, gdb_ilen = 0;
+static char gdb_obuf[2 * BUFMAX + 8];
+static int gdb_olen = 0;
+
+/* Refill the input buffer; wait == 0 returns 0 instead of blocking */
+
+static int fillDebugChars(int wait)
+{
+    struct simple_socket_priv *p = &gdb_socket_priv;
+    struct pollfd pfd;
+    int n;
+
+    while (p->state == SIMPSOCK_IO) {
+        n = read(p->newsockfd, gdb_ibuf, sizeof(gdb_ibuf));
+        if (n > 0) {
+            gdb_ipos = 0;
+            gdb_ilen = n;
+            return n;
+        }
+        if ((n == 0) || ((errno != EAGAIN) && (errno != EINTR))) {
+            gdb_hangup();                               /* gdb went away */
+            break;
+        }
+        if (!wait) {
+            return 0;
+        }
+        pfd.fd = p->newsockfd;
+        pfd.events = POLLIN | POLLPRI;
+        pfd.revents = 0;
+        poll(&pfd, 1, -1);
+    }
+    return -1;
 }
 
-static char getDebugChar()
+static int getDebugChar(void)
 {
-    char ch;
-    int io_status;
+    if ((gdb_ipos >= gdb_ilen) && (fillDebugChars(1) <= 0)) {
+        return -1;
+    }
+    return (unsigned char) gdb_ibuf[gdb_ipos++];
+}
 
-    do_simple_socket(&gdb_socket_priv, SIMPSOCK_BLOCKING_READ, &ch, &io_status);
+static int readyDebugChar(void)
+{
+    return (gdb_ipos < gdb_ilen) || (fillDebugChars(0) > 0);
+}
 
-    if (io_status == 0) {
-        return '\0';
+static void flushDebugChars(void)
+{
+    struct simple_socket_priv *p = &gdb_socket_priv;
+    struct pollfd pfd;
+    int n, done = 0;
+
+    while ((done < gdb_olen) && (p->state == SIMPSOCK_IO)) {
+        n = write(p->newsockfd, gdb_obuf + done, gdb_olen - done);
+        if (n > 0) {
+            done += n;
+        } else if ((n < 0) && ((errno == EAGAIN) || (errno == EINTR))) {
+            pfd.fd = p->newsockfd;
+            pfd.events = POLLOUT;
+            pfd.revents = 0;
+            poll(&pfd, 1, -1);
+        } else {
+            gdb_hangup();
+        }
     }
+    gdb_olen = 0;
+}
 
-    return ch;
+static void putDebugChar(char ch)
+{
+    if (gdb_olen >= (int) sizeof(gdb_obuf)) {
+        flushDebugChars();
+    }
+    gdb_obuf[gdb_olen++] = ch;
 }
 
 
@@ -279,20 +507,24 @@ hex (char ch)
   return -1;
 }
 
-static char remcomInBuffer[BUFMAX];
-static char remcomOutBuffer[BUFMAX];
+static char remcomInBuffer[BUFMAX + 1];
+static char remcomOutBuffer[2 * BUFMAX + 8];
+static unsigned char remcomMemBuffer[BUFMAX];
 
-/* scan for the sequence $<data>#<checksum>     */
+/* scan for the sequence $<data>#<checksum>
+
+   The payload may be binary (X packets), so its length is returned in
+   *len rather than relying on the terminating null.  */
 
 static unsigned char *
-getpacket (void)
+getpacket (int *len)
 {
     struct simple_socket_priv *p = &gdb_socket_priv;
     unsigned char * buffer = (unsigned char *)remcomInBuffer;
-    char checksum;
-    char xmitcsum;
+    unsigned char checksum;
+    int xmitcsum;
     int count;
-    char ch;
+    int ch;
 
     while (1) {
         /* wait around for the start character, ignore all other characters */
@@ -309,6 +541,7 @@ retry:
         /* now, read until a # or end of buffer is found */
         while (count < BUFMAX) {
             ch = getDebugChar ();
+            if (p->state != SIMPSOCK_IO) return NULL;
             if (ch == '$')
                 goto retry;
             if (ch == '#')
@@ -324,56 +557,72 @@ retry:
             xmitcsum = hex (ch) << 4;
             ch = getDebugChar ();
             xmitcsum += hex (ch);
+            if (p->state != SIMPSOCK_IO) return NULL;
 
-            if (checksum != xmitcsum) {
+            if (gdb_noack) {
+                /* reliable transport, no acknowledgements */
+            } else if (checksum != xmitcsum) {
                 putDebugChar ('-');       /* failed checksum */
+                flushDebugChars ();
+                continue;
             } else {
                 putDebugChar ('+');       /* successful transfer */
-
-                /* if a sequence char is present, reply the sequence ID */
-                if (buffer[2] == ':') {
-                    putDebugChar (buffer[0]);
-                    putDebugChar (buffer[1]);
-
-                    memmove(buffer, buffer+3, BUFMAX-3);
-                }
-                //printf("getpacket: %s\r\n", buffer);
-                return buffer;
             }
+            gdb_pkt_in++;
+            *len = count;
+            return buffer;
         }
     }
 }
 
-static void putpacket(unsigned char * buffer)
+static void putpacket(unsigned char * buffer, int len)
 {
     struct simple_socket_priv *p = &gdb_socket_priv;
     unsigned char checksum;
     int count;
-    unsigned char ch;
-    
-    //printf("putpacket: %s\r\n", buffer);
+    int ch;
 
     /*  $<packet info>#<checksum>. */
     do {
         putDebugChar('$');
         checksum = 0;
-        count = 0;
 
-        while ((ch = buffer[count])) {
-            putDebugChar(ch);
-            checksum += ch;
-            count += 1;
+        for (count = 0; count < len; count++) {
+            putDebugChar(buffer[count]);
+            checksum += buffer[count];
         }
 
         putDebugChar('#');
         putDebugChar(hexchars[checksum >> 4]);
         putDebugChar(hexchars[checksum & 0xf]);
+        flushDebugChars();
+        gdb_pkt_out++;
 
+        if (gdb_noack) return;
         ch = getDebugChar();
         if (p->state != SIMPSOCK_IO) return;
     } while (ch != '+');
 }
 
+/* Asynchronous notification, %<data>#<checksum>, never acknowledged */
+
+static void putnotify(unsigned char * buffer)
+{
+    unsigned char checksum = 0;
+    int count;
+
+    putDebugChar('%');
+    for (count = 0; buffer[count]; count++) {
+        putDebugChar(buffer[count]);
+        checksum += buffer[count];
+    }
+    putDebugChar('#');
+    putDebugChar(hexchars[checksum >> 4]);
+    putDebugChar(hexchars[checksum & 0xf]);
+    flushDebugChars();
+    gdb_pkt_out++;
+}
+
 /* Indicate to caller of mem2hex or hex2mem that there has been an
    error.  */
 static volatile int mem_err = 0;
@@ -425,6 +674,26 @@ hex2mem (char *buf, char *mem, int count, int may_fault)
   return (char *) mem;
 }
 
+/* Undo the binary escapes of an X packet in place ('}' x ^ 0x20).
+ * Return the number of data bytes.
+ */
+
+static int
+bin2mem (char *buf, int count)
+{
+  int i, n;
+
+  for (i = n = 0; i < count; i++)
+    {
+      if ((buf[i] == '}') && (i + 1 < count))
+        buf[n++] = buf[++i] ^ 0x20;
+      else
+        buf[n++] = buf[i];
+    }
+
+  return n;
+}
+
 /*
  * While we find nice hex chars, build an int.
  * Return number of chars processed.
@@ -453,8 +722,64 @@ hexToInt(char **ptr, long *intValue)
   return (numChars);
 }
 
+/* Parse a thread id: -1 all, 0 any, n core n - 1.  Return FALSE if bad. */
+
+static int
+hexToThread(char **ptr, long *cpu)
+{
+  long tmp;
+
+  if ((*ptr)[0] == '-' && (*ptr)[1] == '1')
+    {
+      *ptr += 2;
+      *cpu = -1;
+      return 1;
+    }
+  if (!hexToInt(ptr, &tmp))
+    return 0;
+  *cpu = (tmp == 0)? 0: tmp - 1;
+  return (tmp == 0) || gdb_core_ok(*cpu);
+}
+
+/* Build a T05 stop reply for a core */
+
+static char *
+stop_reply (char *ptr, int cpu)
+{
+  int sigval = gdb_sig[cpu];
+
+  *ptr++ = 'T';
+  *ptr++ = hexchars[sigval >> 4];
+  *ptr++ = hexchars[sigval & 0xf];
+  ptr += sprintf (ptr, "thread:%x;", cpu + 1);
+
+  *ptr++ = hexchars[PC >> 4];
+  *ptr++ = hexchars[PC & 0xf];
+  *ptr++ = ':';
+  ptr = mem2hex((char *)&cpu_ctx[cpu]->last_PC, ptr, 8, 0); /* PC */
+  *ptr++ = ';';
+
+  /* We could send other registers here if we wanted to. Do we want to? */
+
+  *ptr = 0;
+  return ptr;
+}
+
+/* Lowest-numbered pending stop, or -1 */
+
+static int
+next_stop (void)
+{
+  int i;
+
+  for (i = 0; i < NUM_CORES; i++)
+    if (gdb_pend & (1u << i))
+      return i;
+  return -1;
+}
 
 /*
+ * All-stop: report the stop and serve packets until gdb resumes.
  * required commands: g, G, m, M, c, s
  */
 
@@ -462,311 +787,425 @@ static void
 handle_exception (int cpu)
 {
     struct simple_socket_priv *p = &gdb_socket_priv;
-    int sigval;
-    long addr, length;
-    long tmp, thread=cpu;
     char *ptr;
+    int len;
 
-    t_uint64 val;
-    int i, good;
-
-    sigval = SIGTRAP;
-    ptr = remcomOutBuffer;
+    gdb_gthread = cpu;
+    gdb_sig[cpu] = SIGTRAP;
+    len = stop_reply(remcomOutBuffer, cpu) - remcomOutBuffer;
+    putpacket((unsigned char *)remcomOutBuffer, len);
 
-    *ptr++ = 'T';
-    *ptr++ = hexchars[sigval >> 4];
-    *ptr++ = hexchars[sigval & 0xf];
+    while (1) {
+        if (p->state != SIMPSOCK_IO) return;
+        ptr = (char *)getpacket(&len);
+        if (ptr == NULL) return;
+        if (handle_packet(ptr, len)) return;    /* Continue execution */
+        if (gdb_nonstop) return;    /* every core now held; poll serves */
+    }
+}
 
-    strcpy(ptr,"thread");
-    ptr += 6;
-    *ptr++ = ':';
-    tmp = thread + 1;
-    ptr = mem2hex((char *) &tmp, ptr, 1, 1);
-    *ptr++ = ';';
+/*
+ * Non-stop: serve whatever packets have arrived, then report one
+ * pending stop if no notification is outstanding.  Never waits for
+ * gdb unless a packet is partially received.
+ */
 
-    *ptr++ = hexchars[PC >> 4];
-    *ptr++ = hexchars[PC & 0xf];
-    *ptr++ = ':';
-    ptr = mem2hex((char *)&cpu_ctx[thread]->last_PC, ptr, 8, 0); /* PC */
-    *ptr++ = ';';
+static void
+gdb_poll (void)
+{
+    struct simple_socket_priv *p = &gdb_socket_priv;
+    char *ptr;
+    int len, cpu;
 
-    /* We could send other registers here if we wanted to. Do we want to? */
+    while ((p->state == SIMPSOCK_IO) && readyDebugChar()) {
+        if (gdb_ibuf[gdb_ipos] != '$') {    /* stray ack or ^C */
+            gdb_ipos++;
+            continue;
+        }
+        ptr = (char *)getpacket(&len);
+        if (ptr == NULL) return;
+        handle_packet(ptr, len);
+    }
+    if ((p->state == SIMPSOCK_IO) && !gdb_notified &&
+        ((cpu = next_stop()) >= 0)) {
+        strcpy(remcomOutBuffer, "Stop:");
+        stop_reply(remcomOutBuffer + 5, cpu);
+        gdb_pend &= ~(1u << cpu);
+        gdb_notified = 1;
+        putnotify((unsigned char *)remcomOutBuffer);
+    }
+}
 
-    *ptr++ = 0;
+/* Apply one vCont action to a core (non-stop) or to everything */
 
-    putpacket((unsigned char *)remcomOutBuffer);
+static void
+vcont_action (char action, long cpu)
+{
+  int i;
 
-    while (1) {
-        if (p->state != SIMPSOCK_IO) return;
-        remcomOutBuffer[0] = 0;
-        ptr = (char *)getpacket();
-        switch (*ptr++)
+  for (i = 0; i < NUM_CORES; i++)
+    {
+      if (((cpu >= 0) && (i != cpu)) || !gdb_core_ok(i))
+        continue;
+      if (action == 't')
         {
-        case '?':
-            remcomOutBuffer[0] = 'S';
-            remcomOutBuffer[1] = hexchars[sigval >> 4];
-            remcomOutBuffer[2] = hexchars[sigval & 0xf];
-            remcomOutBuffer[3] = 0;
-            break;
+          if (!(gdb_held & (1u << i)))
+            {
+              gdb_hold(i, 1);
+              gdb_sig[i] = 0;
+              gdb_pend |= (1u << i);
+            }
+        }
+      else if (gdb_held & (1u << i))
+        gdb_hold(i, 0);
+    }
+}
+
+/*
+ * Execute one packet and send its reply.  Return 1 if execution
+ * should resume (all-stop), 0 otherwise.
+ */
+
+static int
+handle_packet (char *ptr, int len)
+{
+    struct simple_socket_priv *p = &gdb_socket_priv;
+    char *end = ptr + len;
+    long addr, length;
+    long tmp, thread;
+    int sigval = SIGTRAP;
+    t_uint64 val;
+    int i, n;
 
-        case 'd':               /* toggle debug flag */
+    remcomOutBuffer[0] = 0;
+    thread = gdb_gthread;
+    switch (*ptr++)
+    {
+    case '?':
+        if (gdb_nonstop) {
+            /* report every held core again, one per vStopped */
+            gdb_pend = gdb_held;
+            gdb_notified = 0;
+            if ((n = next_stop()) < 0) {
+                strcpy(remcomOutBuffer, "OK");
+            } else {
+                gdb_pend &= ~(1u << n);
+                gdb_notified = 1;
+                stop_reply(remcomOutBuffer, n);
+            }
             break;
+        }
+        remcomOutBuffer[0] = 'S';
+        remcomOutBuffer[1] = hexchars[sigval >> 4];
+        remcomOutBuffer[2] = hexchars[sigval & 0xf];
+        remcomOutBuffer[3] = 0;
+        break;
 
-        case 'g':               /* return the value of the CPU registers */
-            {
-            ptr = remcomOutBuffer;
-            i = 0;
-            //for (i=0; i<32; i++) {
-            //    printf("R[%d]: 0x%016lx\r\n", i, (long unsigned int)cpu_ctx[thread]->R[i]);
-            //}
-            ptr = mem2hex((char *)cpu_ctx[thread]->R, ptr, 32 * 8, 0); /* General Purpose */
+    case 'd':               /* toggle debug flag */
+        break;
 
-            //printf("SR 0x%016x\r\n", (unsigned int)cpu_ctx[thread]->cp0_sr);
-            ptr = mem2hex((char *)&cpu_ctx[thread]->cp0_sr, ptr, 4, 0); /* SR */
-            memset(ptr, '0', 4 * 2); /* Pad since gdb thinks it's 64-bits */
-            ptr += 4 * 2;
+    case 'g':               /* return the value of the CPU registers */
+        {
+        ptr = remcomOutBuffer;
+        ptr = mem2hex((char *)cpu_ctx[thread]->R, ptr, 32 * 8, 0); /* General Purpose */
 
-            //printf("mlo 0x%016lx\r\n", (long unsigned int)cpu_ctx[thread]->mlo);
-            ptr = mem2hex((char *)&cpu_ctx[thread]->mlo, ptr, 8, 0); /* LO */
+        ptr = mem2hex((char *)&cpu_ctx[thread]->cp0_sr, ptr, 4, 0); /* SR */
+        memset(ptr, '0', 4 * 2); /* Pad since gdb thinks it's 64-bits */
+        ptr += 4 * 2;
 
-            //printf("mhi 0x%016lx\r\n", (long unsigned int)cpu_ctx[thread]->mhi);
-            ptr = mem2hex((char *)&cpu_ctx[thread]->mhi, ptr, 8, 0); /* HI */
+        ptr = mem2hex((char *)&cpu_ctx[thread]->mlo, ptr, 8, 0); /* LO */
 
-            //printf("badva 0x%016lx\r\n", (long unsigned int)cpu_ctx[thread]->cp0_badva);
-            ptr = mem2hex((char *)&cpu_ctx[thread]->cp0_badva, ptr, 8, 0); /* BADVA */
+        ptr = mem2hex((char *)&cpu_ctx[thread]->mhi, ptr, 8, 0); /* HI */
 
-            //printf("cause 0x%08x\r\n", (unsigned int)cpu_ctx[thread]->cp0_cause);
-            ptr = mem2hex((char *)&cpu_ctx[thread]->cp0_cause, ptr, 4, 0); /* CAUSE */
-            memset(ptr, '0', 4 * 2); /* Pad since gdb thinks it's 64-bits */
-            ptr += 4 * 2;
+        ptr = mem2hex((char *)&cpu_ctx[thread]->cp0_badva, ptr, 8, 0); /* BADVA */
 
-            //printf("PC 0x%016lx\r\n", (long unsigned int)cpu_ctx[thread]->last_PC);
-            ptr = mem2hex((char *)&cpu_ctx[thread]->last_PC, ptr, 8, 0); /* PC */
+        ptr = mem2hex((char *)&cpu_ctx[thread]->cp0_cause, ptr, 4, 0); /* CAUSE */
+        memset(ptr, '0', 4 * 2); /* Pad since gdb thinks it's 64-bits */
+        ptr += 4 * 2;
 
-            //for (i=0; i<32; i++) {
-            //    printf("F[%d]: 0x%016lx\r\n", i, (long unsigned int)cpu_ctx[thread]->F[i]);
-            //}
-            ptr = mem2hex((char *)&cpu_ctx[thread]->F, ptr, 32 * 8, 0); /* Floating Point */
+        ptr = mem2hex((char *)&cpu_ctx[thread]->last_PC, ptr, 8, 0); /* PC */
 
-            /* TODO: This might not be quite right */
-            val = 0;
-            val = cpu_ctx[thread]->fpcr;
-            //printf("fsr 0x%08x\r\n", (unsigned int)val);
-            ptr = mem2hex((char *)&val, ptr, 8, 0); /* FSR */
+        ptr = mem2hex((char *)&cpu_ctx[thread]->F, ptr, 32 * 8, 0); /* Floating Point */
 
-            val = 0;
-            val = fp_getcr(cpu_ctx[thread], CP1_FIR);
-            //printf("fir 0x%08x\r\n", (unsigned int)val);
-            ptr = mem2hex((char *)&val, ptr, 8, 0); /* FIR */
+        /* TODO: This might not be quite right */
+        val = 0;
+        val = cpu_ctx[thread]->fpcr;
+        ptr = mem2hex((char *)&val, ptr, 8, 0); /* FSR */
 
-            /* TODO: FP is in the official list but gdb doesn't display it and
-             * what is it anyways? */
+        val = 0;
+        val = fp_getcr(cpu_ctx[thread], CP1_FIR);
+        ptr = mem2hex((char *)&val, ptr, 8, 0); /* FIR */
 
-            }
-            break;
+        /* TODO: FP is in the official list but gdb doesn't display it and
+         * what is it anyways? */
 
-        case 'G':          /* set the value of the CPU registers - return OK */
-            {
-            /* TODO: any registers we need to avoid touching? */
-
-            //for (i=0; i<32; i++) {
-            //    printf("before: R[%d]: 0x%016lx\r\n", i, (long unsigned int)cpu_ctx[thread]->R[i]);
-            //}
-            hex2mem(ptr, (char *)cpu_ctx[thread]->R, 32 * 8, 0); /* General Purpose */
-            //for (i=0; i<32; i++) {
-            //    printf("after: R[%d]: 0x%016lx\r\n", i, (long unsigned int)cpu_ctx[thread]->R[i]);
-            //}
-            ptr += 32 * 8 * 2;
-
-            //printf("before: SR 0x%016x\r\n", (unsigned int)cpu_ctx[thread]->cp0_sr);
-            hex2mem(ptr, (char *)&cpu_ctx[thread]->cp0_sr, 4, 0); /* SR */
-            //printf("after: SR 0x%016x\r\n", (unsigned int)cpu_ctx[thread]->cp0_sr);
-            ptr += 4 * 2 + 4 * 2; /* Pad since gdb thinks it's 64-bits */
-
-            //printf("before: mlo 0x%016lx\r\n", (long unsigned int)cpu_ctx[thread]->mlo);
-            hex2mem(ptr, (char *)&cpu_ctx[thread]->mlo, 8, 0); /* LO */
-            //printf("after: mlo 0x%016lx\r\n", (long unsigned int)cpu_ctx[thread]->mlo);
-            ptr += 8 * 2;
-
-            //printf("before: mhi 0x%016lx\r\n", (long unsigned int)cpu_ctx[thread]->mhi);
-            hex2mem(ptr, (char *)&cpu_ctx[thread]->mhi, 8, 0); /* HI */
-            //printf("after: mhi 0x%016lx\r\n", (long unsigned int)cpu_ctx[thread]->mhi);
-            ptr += 8 * 2;
-
-            //printf("before: badva 0x%016lx\r\n", (long unsigned int)cpu_ctx[thread]->cp0_badva);
-            hex2mem(ptr, (char *)&cpu_ctx[thread]->cp0_badva, 8, 0); /* BADVA */
-            //printf("after: badva 0x%016lx\r\n", (long unsigned int)cpu_ctx[thread]->cp0_badva);
-            ptr += 8 * 2;
-
-            //printf("before: cause 0x%08x\r\n", (unsigned int)cpu_ctx[thread]->cp0_cause);
-            hex2mem(ptr, (char *)&cpu_ctx[thread]->cp0_cause, 4, 0); /* CAUSE */
-            //printf("after: cause 0x%08x\r\n", (unsigned int)cpu_ctx[thread]->cp0_cause);
-            ptr += 4 * 2 + 4 * 2; /* Pad since gdb thinks it's 64-bits */
-
-            //printf("before: PC 0x%016lx\r\n", (long unsigned int)cpu_ctx[thread]->last_PC);
-            hex2mem(ptr, (char *)&cpu_ctx[thread]->last_PC, 8, 0); /* PC */
-            //printf("after: PC 0x%016lx\r\n", (long unsigned int)cpu_ctx[thread]->last_PC);
-            ptr += 8 * 2;
-
-            //for (i=0; i<32; i++) {
-            //    printf("before: F[%d]: 0x%016lx\r\n", i, (long unsigned int)cpu_ctx[thread]->F[i]);
-            //}
-            hex2mem(ptr, (char *)&cpu_ctx[thread]->F, 32 * 8, 0); /* Floating Point */
-            //for (i=0; i<32; i++) {
-            //    printf("after: F[%d]: 0x%016lx\r\n", i, (long unsigned int)cpu_ctx[thread]->F[i]);
-            //}
-            ptr += 32 * 8 * 2;
-
-
-            /* TODO: This might not be quite right */
-            val = 0;
-            val = cpu_ctx[thread]->fpcr;
-            //printf("before: fsr 0x%08x\r\n", (unsigned int)val);
-            hex2mem(ptr, (char *)&val, 8, 0); /* FSR */
-            //printf("after: fsr 0x%08x\r\n", (unsigned int)val);
-            ptr += 8 * 2;
-
-            /* FIR is static */
-            ptr += 8 * 2;
-    
-            strcpy(remcomOutBuffer,"OK");
-            }
-            break;
+        }
+        break;
 
-        case 'm':         /* mAA..AA,LLLL  Read LLLL bytes at address AA..AA */
-            /* Try to read %x,%x.  */
-    
-            if (hexToInt(&ptr, &addr)
-                && *ptr++ == ','
-                && hexToInt(&ptr, &length))
-            {
-                ptr = remcomOutBuffer;
-                for (i=0; i<length; i++) {
-                    if (gdb_ReadB(cpu_ctx[thread], addr+i, &val) == TRUE) {
-                        ptr = mem2hex((char *) &val, ptr, 1, 1);
-                    } else {
-                        strcpy (remcomOutBuffer, "E03");
-                        break;
-                    }
-                }
+    case 'G':          /* set the value of the CPU registers - return OK */
+        {
+        /* TODO: any registers we need to avoid touching? */
+
+        hex2mem(ptr, (char *)cpu_ctx[thread]->R, 32 * 8, 0); /* General Purpose */
+        ptr += 32 * 8 * 2;
+
+        hex2mem(ptr, (char *)&cpu_ctx[thread]->cp0_sr, 4, 0); /* SR */
+        ptr += 4 * 2 + 4 * 2; /* Pad since gdb thinks it's 64-bits */
+
+        hex2mem(ptr, (char *)&cpu_ctx[thread]->mlo, 8, 0); /* LO */
+        ptr += 8 * 2;
+
+        hex2mem(ptr, (char *)&cpu_ctx[thread]->mhi, 8, 0); /* HI */
+        ptr += 8 * 2;
+
+        hex2mem(ptr, (char *)&cpu_ctx[thread]->cp0_badva, 8, 0); /* BADVA */
+        ptr += 8 * 2;
+
+        hex2mem(ptr, (char *)&cpu_ctx[thread]->cp0_cause, 4, 0); /* CAUSE */
+        ptr += 4 * 2 + 4 * 2; /* Pad since gdb thinks it's 64-bits */
+
+        hex2mem(ptr, (char *)&cpu_ctx[thread]->last_PC, 8, 0); /* PC */
+        ptr += 8 * 2;
+
+        hex2mem(ptr, (char *)&cpu_ctx[thread]->F, 32 * 8, 0); /* Floating Point */
+        ptr += 32 * 8 * 2;
+
+        /* TODO: This might not be quite right */
+        val = 0;
+        val = cpu_ctx[thread]->fpcr;
+        hex2mem(ptr, (char *)&val, 8, 0); /* FSR */
+        ptr += 8 * 2;
+
+        /* FIR is static */
+        ptr += 8 * 2;
+
+        INTR_MARK(thread);      /* SR and CAUSE may have changed */
+        strcpy(remcomOutBuffer,"OK");
+        }
+        break;
+
+    case 'm':         /* mAA..AA,LLLL  Read LLLL bytes at address AA..AA */
+        /* Try to read %x,%x.  */
+
+        if (hexToInt(&ptr, &addr)
+            && *ptr++ == ','
+            && hexToInt(&ptr, &length))
+        {
+            if (length > BUFMAX / 2 - 4) length = BUFMAX / 2 - 4;
+            n = gdb_read_mem(cpu_ctx[thread], addr, remcomMemBuffer, length);
+            if (n == 0 && length != 0) {
+                strcpy (remcomOutBuffer, "E03");
             } else {
-                strcpy(remcomOutBuffer,"E01");
+                mem2hex((char *)remcomMemBuffer, remcomOutBuffer, n, 1);
             }
-            break;
+        } else {
+            strcpy(remcomOutBuffer,"E01");
+        }
+        break;
 
-        case 'M': /* MAA..AA,LLLL: Write LLLL bytes at address AA.AA return OK */
-            /* Try to read '%x,%x:'.  */
+    case 'M': /* MAA..AA,LLLL: Write LLLL bytes at address AA.AA return OK */
+    case 'X': /* XAA..AA,LLLL: Same, binary data */
+        /* Try to read '%x,%x:'.  */
 
-            if (hexToInt(&ptr, &addr)
-                && *ptr++ == ','
-                && hexToInt(&ptr, &length)
-                && *ptr++ == ':')
-            {
-                good = 1;
-                for (i=0; i<length; i++) {
-                    if (hex2mem(ptr+i*2, (char *)&val, 1, 1)) {
-                        if (gdb_WriteB(cpu_ctx[thread], addr+i, val) == FALSE) {
-                            good = 0;
-                            break;
-                        }
-                    } else {
-                        good = 0;
-                        break;
-                    }
-                }
-                if (good == 1) {
-                    strcpy(remcomOutBuffer, "OK");
-                } else {
-                    strcpy(remcomOutBuffer, "E03");
-                }
+        if (hexToInt(&ptr, &addr)
+            && *ptr++ == ','
+            && hexToInt(&ptr, &length)
+            && *ptr++ == ':')
+        {
+            if (remcomInBuffer[0] == 'X') {
+                n = bin2mem(ptr, end - ptr);
+                memcpy(remcomMemBuffer, ptr, (n < BUFMAX)? n: BUFMAX);
             } else {
+                n = (end - ptr) / 2;
+                if (n > BUFMAX) n = BUFMAX;
+                hex2mem(ptr, (char *)remcomMemBuffer, n, 1);
+            }
+            if (n < length) {
                 strcpy(remcomOutBuffer, "E02");
+            } else if (gdb_write_mem(cpu_ctx[thread], addr,
+                                     remcomMemBuffer, length) == length) {
+                strcpy(remcomOutBuffer, "OK");
+            } else {
+                strcpy(remcomOutBuffer, "E03");
             }
-            break;
-
-        case 'c':    /* cAA..AA    Continue at address AA..AA(optional) */
-            /* try to read optional parameter, pc unchanged if no parm */
+        } else {
+            strcpy(remcomOutBuffer, "E02");
+        }
+        break;
 
-            if (hexToInt(&ptr, &addr))
-            {
-                printf("continue at address unimplemented!\n");
-                break;
-                // TODO: Implement this properly 
-                //cpu_ctx[thread]->PC = addr;
-                //registers[PC] = addr;
-                //registers[NPC] = addr + 4;
-            }
+    case 'c':    /* cAA..AA    Continue at address AA..AA(optional) */
+        /* try to read optional parameter, pc unchanged if no parm */
 
-            /* 
-             * In simh, there is no need to flush the instruction cache. On
-             * a real system, we need to flush the instruction cache here, as
-             * we may have deposited a breakpoint, and the icache probably has
-             * no way of knowing that a data ref to some location may have
-             * changed something that is in the instruction cache.
-             */
+        if (hexToInt(&ptr, &addr))
+        {
+            printf("continue at address unimplemented!\n");
+            break;
+            // TODO: Implement this properly
+            //cpu_ctx[thread]->PC = addr;
+            //registers[PC] = addr;
+            //registers[NPC] = addr + 4;
+        }
 
-            /* flush_i_cache(); */
+        /*
+         * In simh, there is no need to flush the instruction cache. On
+         * a real system, we need to flush the instruction cache here, as
+         * we may have deposited a breakpoint, and the icache probably has
+         * no way of knowing that a data ref to some location may have
+         * changed something that is in the instruction cache.
+         */
 
-            return;  /* Continue execution */
+        /* flush_i_cache(); */
 
-        /* kill the program */
-        case 'k' :              /* do nothing */
-            close(p->newsockfd);
-            p->state = SIMPSOCK_ATTACH;
+        if (gdb_nonstop) {
+            vcont_action('c', gdb_cthread);
+            strcpy(remcomOutBuffer, "OK");
             break;
-
-        case 'q':    /* q....    General query operation */
-            switch (*ptr++) {
-            case 'C':
-                strcpy(remcomOutBuffer, "QC");
-                tmp = thread + 1;
-                mem2hex((char *) &tmp, remcomOutBuffer + 2, 1, 1);
-
-                break;
-            case 'f':
-                if (strncmp("ThreadInfo", ptr, 10) == 0) {
-                    /* Hardcoded to cpu list */
-                    strcpy(remcomOutBuffer, "m1,2,3,4,5,6l");
-                }
-            default:
-                break;
+        }
+        return 1;  /* Continue execution */
+
+    /* kill the program */
+    case 'k' :              /* do nothing */
+        gdb_hangup();
+        return 1;
+
+    case 'q':    /* q....    General query operation */
+        if (strncmp("Supported", ptr, 9) == 0) {
+            /* no memory map: with one, gdb refuses every address
+               outside it (KSEG0, XKPHYS, ROM, I/O) */
+            sprintf(remcomOutBuffer, "PacketSize=%x;QStartNoAckMode+;"
+                    "QNonStop+", BUFMAX);
+        } else if (strcmp("C", ptr) == 0) {
+            sprintf(remcomOutBuffer, "QC%x", gdb_gthread + 1);
+        } else if (strcmp("fThreadInfo", ptr) == 0) {
+            ptr = remcomOutBuffer;
+            *ptr++ = 'm';
+            for (i = 0; i < NUM_CORES; i++) {
+                if (gdb_core_ok(i))
+                    ptr += sprintf(ptr, "%x,", i + 1);
             }
-            break;
+            ptr[-1] = 0;
+        } else if (strcmp("sThreadInfo", ptr) == 0) {
+            strcpy(remcomOutBuffer, "l");
+        } else if (strncmp("ThreadExtraInfo,", ptr, 16) == 0) {
+            ptr += 16;
+            if (hexToThread(&ptr, &tmp) && (tmp >= 0)) {
+                char name[32];
+
+                sprintf(name, "CPU%ld%s", tmp,
+                        (gdb_held & (1u << tmp))? " (stopped)": "");
+                mem2hex(name, remcomOutBuffer, strlen(name), 0);
+            }
+        }
+        break;
 
-        case 'T':    /* T XX    Check if thread XX is running */
+    case 'Q':    /* Q....    General set operation */
+        if (strcmp("StartNoAckMode", ptr) == 0) {
+            putpacket((unsigned char *)"OK", 2);
+            gdb_noack = 1;
+            return 0;
+        } else if (strncmp("NonStop:", ptr, 8) == 0) {
+            gdb_nonstop = (ptr[8] == '1');
+            if (gdb_nonstop) {
+                vcont_action('t', -1);  /* all stopped now, as gdb assumes */
+                gdb_pend = 0;
+            } else {
+                vcont_action('c', -1);
+            }
             strcpy(remcomOutBuffer, "OK");
-            break;
+        }
+        break;
 
-        case 'H':    /* H c t    Set thread to t for operations c */
-            switch (*ptr++) {
-            case 'g':
-                if (hexToInt(&ptr, &tmp)) {
-                    /* 0 means 'any' so we number CPUs 1-6 */
-                    if (tmp == -1) {
-                        strcpy(remcomOutBuffer, "E01");
-                        break;
-                    } else if (tmp == 0) {
-                        thread = 0;
-                    } else {
-                        thread = tmp - 1;
+    case 'v':    /* v....    Multi-letter commands */
+        if (strcmp("Cont?", ptr) == 0) {
+            strcpy(remcomOutBuffer, "vCont;c;C;t");
+        } else if (strncmp("Cont;", ptr, 5) == 0) {
+            /* vCont;action[:thread];... first matching action wins */
+            uint32 done = 0;
+            int resume = 0;
+
+            ptr += 4;
+            while (*ptr == ';') {
+                char action = *++ptr;
+
+                tmp = -1;
+                while (*ptr && *ptr != ':' && *ptr != ';') ptr++;
+                if (*ptr == ':') {
+                    ptr++;
+                    if (!hexToThread(&ptr, &tmp)) {
+                        tmp = -2;
                     }
-                    strcpy(remcomOutBuffer, "OK");
                 }
-                break;
+                if (tmp == -2) continue;
+                if (!gdb_nonstop) {
+                    if (action != 't') resume = 1;
+                    continue;
+                }
+                for (i = 0; i < NUM_CORES; i++) {
+                    if (((tmp >= 0) && (i != tmp)) || (done & (1u << i)))
+                        continue;
+                    done |= (1u << i);
+                    vcont_action(action == 't'? 't': 'c', i);
+                }
+            }
+            if (resume) return 1;
+            strcpy(remcomOutBuffer, "OK");
+        } else if (strcmp("Stopped", ptr) == 0) {
+            /* ack one %Stop; send the next pending one or OK */
+            if ((n = next_stop()) < 0) {
+                gdb_notified = 0;
+                strcpy(remcomOutBuffer, "OK");
+            } else {
+                gdb_pend &= ~(1u << n);
+                stop_reply(remcomOutBuffer, n);
+            }
+        } else if (strncmp("Kill", ptr, 4) == 0) {
+            putpacket((unsigned char *)"OK", 2);
+            gdb_hangup();
+            return 1;
+        }
+        break;
 
-            case 'c':
-                /* Not supported, can't run just one CPU */
-                break;
+    case 'T':    /* T XX    Check if thread XX is running */
+        if (hexToThread(&ptr, &tmp) && (tmp >= 0)) {
+            strcpy(remcomOutBuffer, "OK");
+        } else {
+            strcpy(remcomOutBuffer, "E01");
+        }
+        break;
 
-            default:
-                break;
+    case 'H':    /* H c t    Set thread to t for operations c */
+        switch (*ptr++) {
+        case 'g':
+            /* 0 means 'any' so we number CPUs from 1 */
+            if (hexToThread(&ptr, &tmp) && (tmp >= 0)) {
+                gdb_gthread = tmp;
+                strcpy(remcomOutBuffer, "OK");
+            } else {
+                strcpy(remcomOutBuffer, "E01");
+            }
+            break;
+
+        case 'c':
+            /* Only honored in non-stop mode; all-stop runs every CPU */
+            if (hexToThread(&ptr, &tmp)) {
+                gdb_cthread = tmp;
+                strcpy(remcomOutBuffer, "OK");
+            } else {
+                strcpy(remcomOutBuffer, "E01");
             }
             break;
-        }                       /* switch */
 
-        /* reply to the request */
-        putpacket((unsigned char *)remcomOutBuffer);
+        default:
+            break;
+        }
+        break;
+    }                       /* switch */
+
+    /* reply to the request */
+    if (p->state == SIMPSOCK_IO) {
+        putpacket((unsigned char *)remcomOutBuffer, strlen(remcomOutBuffer));
     }
+    return 0;
 }
 
 #endif
@@ -39,7 +39,7 @@
  */
 
 #define GDB_POLL_INTVL 10000
-#define BUFMAX 8192
+#define BUFMAX 16384                                    /* packet size; 'm' up to 8KB */
 
 extern UNIT gdb_unit[];
 extern DEVICE gdb_dev;
@@ -1,12 +1,58 @@
 #include "sc1_defs.h"
 #include "sc1_scdma.h"
 #include "sc1_cac.h"
+#include "sc1_fabric.h"
 #include <unistd.h>
 #include "sicortex/simdma.h"
 #include "simdma_internal.h"
 
 #define SCDMA_POLL_INTVL 1000
 
+/* Doorbell scheduling
+
+   The engine (unit 0) no longer polls at a fixed interval.  A guest write
+   to the SCDMA window rings the doorbell, which runs simdma_progress
+   after SCDMA_KICK_INTVL instructions.  While progress keeps moving data
+   the engine reruns every SCDMA_BUSY_INTVL; once it has been idle, the
+   interval doubles on each idle pass up to SCDMA_POLL_INTVL.  After
+   SCDMA_IDLE_POLLS idle passes it goes dormant until the next doorbell.
+
+   Packets from other nodes have no doorbell.  With a fabric attached,
+   unit 1 looks at the fabric links every SCDMA_FAB_POLL instructions
+   and kicks the engine if a packet is waiting; every SCDMA_POLL_INTVL
+   it also synchronises with the other nodes.  Looking is a read of the
+   ring indices, so a dormant engine costs nothing and a packet waits at
+   most SCDMA_FAB_POLL, not a whole quantum.  Without a fabric, simdma's
+   own socket transport can deliver at any time, so the idle engine keeps
+   polling at SCDMA_POLL_INTVL instead of going dormant.  A pass in which
+   simdma_net_send was refused (the link was full) counts as busy, so
+   the engine stays awake to retry the send.
+
+   Packets leave through simdma_net_send, which simdma's route stage
+   calls for a destination node other than this one; they go out on the
+   fabric link to that node.  Packets that arrive are handed to simdma
+   (simdma_net_input) at the start of each engine pass.  A packet simdma
+   cannot take yet is held and offered again on the next pass, so the
+   link backs up instead of dropping it.  A simdma built without network
+   input gets the weak simdma_net_input below, which drops what arrives
+   and counts it (fab_dropped).
+
+   A queue is one SCDMA_QPAGE page of the register window (one per DMA
+   context).  The doorbells rung, and the latency from the first
+   unserviced doorbell to the progress pass that serviced it, are kept
+   per queue.  Bytes moved are kept for the whole engine and per queue.
+   simdma does not say which queue a transfer is for, so each pass's
+   bytes are shared equally among the queues that have rung since the
+   engine was last idle (bytes moved when none has, such as packets from
+   other nodes, count for the engine only).
+*/
+
+#define SCDMA_KICK_INTVL 1
+#define SCDMA_BUSY_INTVL 20
+#define SCDMA_IDLE_POLLS 8
+#define SCDMA_FAB_POLL   100                            /* fabric look interval */
+#define SCDMA_QPAGE      12                             /* log2 queue page */
+#define SCDMA_NQ         16                             /* queues tracked */
 
 /* Declarations */
 
@@ -15,6 +61,32 @@ t_bool scdma_wr( t_uint64 pa, t_uint64 val, uint32 lnt );
 t_stat scdma_reset( DEVICE *dptr );
 
 t_stat scdma_rcv_svc( UNIT *uptr );
+t_stat scdma_fab_svc( UNIT *uptr );
+static t_stat scdma_set_fabric( UNIT *uptr, int32 val, char *cptr, void *desc );
+static void scdma_kick( t_uint64 pa );
+static void scdma_fab_input( void );
+__WEAK int simdma_net_input( uint32_t src, const void *pkt, int len );
+
+static uint32 scdma_idle = 0;                           /* idle passes */
+static uint32 scdma_intvl = SCDMA_BUSY_INTVL;           /* current interval */
+static t_uint64 scdma_passes = 0;                       /* progress passes */
+static t_uint64 scdma_dormant = 0;                      /* times gone dormant */
+static uint32 scdma_fab_left = 0;                       /* looks to next sync */
+static uint32 scdma_q_act = 0;                          /* queues rung, not idle */
+static t_uint64 scdma_tx_refused = 0;                   /* sends refused */
+static t_uint64 scdma_rbytes = 0;                       /* bytes read from mem */
+static t_uint64 scdma_wbytes = 0;                       /* bytes written to mem */
+static t_uint64 scdma_q_db[SCDMA_NQ];                   /* doorbells */
+static t_uint64 scdma_q_svc[SCDMA_NQ];                  /* doorbell batches serviced */
+static t_uint64 scdma_q_lat[SCDMA_NQ];                  /* total latency */
+static t_uint64 scdma_q_max[SCDMA_NQ];                  /* worst latency */
+static t_uint64 scdma_q_bytes[SCDMA_NQ];                /* bytes moved */
+static double scdma_q_t0[SCDMA_NQ];                     /* first pending doorbell */
+static uint32_t scdma_rx_pkt[FAB_PKTMAX / 4];           /* held fabric packet */
+static int scdma_rx_len = 0;                            /* its length, 0 = none */
+static uint32 scdma_rx_src = 0;                         /* its source node */
+static t_uint64 scdma_rx_held = 0;                      /* times simdma was busy */
+static t_uint64 scdma_rx_drop = 0;                      /* dropped, no net input */
 
 extern CORECTX *cpu_ctx[NUM_CORES];
 
@@ -30,6 +102,7 @@ DIB scdma_dib = { SCDMABASE, SCDMAEND, &scdma_rd, &scdma_wr, 0 };
 
 UNIT scdma_unit[] = { 
     { UDATA(&scdma_rcv_svc, 0, SCDMASIZE) },
+    { UDATA(&scdma_fab_svc, 0, 0) },
 };
 
 REG scdma_reg[] =
@@ -43,16 +116,45 @@ REG scdma_reg[] =
     { HRDATA(packet_for_disabled_process, simdma_context.packet_for_disabled_process, 64) },
     { HRDATA(bad_routeindex, simdma_context.bad_routeindex, 64) },
     { HRDATA(bad_command, simdma_context.bad_command, 64) },
+    { DRDATA(fab_sent, fab_sent, 64), REG_RO },
+    { DRDATA(fab_rcvd, fab_rcvd, 64), REG_RO },
+    { DRDATA(fab_full, fab_full, 64), REG_RO },
+    { DRDATA(fab_waits, fab_waits, 64), REG_RO },
+    { DRDATA(fab_held, scdma_rx_held, 64), REG_RO },
+    { DRDATA(fab_dropped, scdma_rx_drop, 64), REG_RO },
+    { DRDATA(tx_refused, scdma_tx_refused, 64), REG_RO },
+    { DRDATA(passes, scdma_passes, 64), REG_RO },
+    { DRDATA(dormant, scdma_dormant, 64), REG_RO },
+    { DRDATA(intvl, scdma_intvl, 32), REG_RO },
+    { DRDATA(rd_bytes, scdma_rbytes, 64), REG_RO },
+    { DRDATA(wr_bytes, scdma_wbytes, 64), REG_RO },
+    { BRDATA(q_doorbells, scdma_q_db, 10, 64, SCDMA_NQ), REG_RO },
+    { BRDATA(q_serviced, scdma_q_svc, 10, 64, SCDMA_NQ), REG_RO },
+    { BRDATA(q_latency, scdma_q_lat, 10, 64, SCDMA_NQ), REG_RO },
+    { BRDATA(q_maxlat, scdma_q_max, 10, 64, SCDMA_NQ), REG_RO },
+    { BRDATA(q_bytes, scdma_q_bytes, 10, 64, SCDMA_NQ), REG_RO },
     { NULL }
 };
 
+/* SET SCDMA FABRIC=node,nnodes[,job],path links this node to the other
+   nodes of a job running on the same host through a shared-memory segment
+   (see sc1_fabric.c); the fabric quantum is SCDMA_POLL_INTVL. */
+
+MTAB scdma_mod[] = {
+    { MTAB_XTD|MTAB_VDV, 0, "FABRIC", "FABRIC",
+      &scdma_set_fabric, &fabric_show },
+    { MTAB_XTD|MTAB_VDV|MTAB_NMO, 1, NULL, "NOFABRIC",
+      &scdma_set_fabric, NULL },
+    { 0 }
+};
+
 
 DEVICE scdma_dev = {
     "SCDMA",            /* name */
     scdma_unit,         /* units */
     scdma_reg,          /* registers */
-    NULL,               /* modifiers */
-    1,                  /* #units */
+    scdma_mod,          /* modifiers */
+    2,                  /* #units */
     16,                 /* address radix */
     64,                 /* address width */
     8,                  /* addr increment */
@@ -111,6 +213,7 @@ scdma_wr(t_uint64 pa, t_uint64 val, uint32 lnt)
     pa <<= 2;
 
     if( simdma_io_write( pa, (uint32_t *) vp, len ) == SIMDMA_SUCCESS ) {
+        scdma_kick( pa );
         return TRUE;
     }
 
@@ -124,11 +227,41 @@ scdma_wr(t_uint64 pa, t_uint64 val, uint32 lnt)
 t_stat
 scdma_reset(DEVICE *dptr)
 {
+  int i;
+
   simdma_initialize();
-  sim_activate(dptr->units, SCDMA_POLL_INTVL);
+  for (i = 0; i < SCDMA_NQ; i++) scdma_q_t0[i] = -1;
+  sim_cancel(&dptr->units[0]);
+  sim_cancel(&dptr->units[1]);
+  scdma_idle = 0;
+  scdma_q_act = 0;
+  scdma_rx_len = 0;
+  scdma_intvl = SCDMA_POLL_INTVL;                       /* one pass to start */
+  sim_activate(&dptr->units[0], scdma_intvl);
+  scdma_fab_left = SCDMA_POLL_INTVL / SCDMA_FAB_POLL;
+  if (fabric_active()) sim_activate(&dptr->units[1], SCDMA_FAB_POLL);
   return SCPE_OK;
 }
 
+/*
+ *      SCDMA doorbell: queue pa has new work, run the engine now
+ */
+
+static void
+scdma_kick( t_uint64 pa )
+{
+    uint32 q = (uint32) ((pa - SCDMABASE) >> SCDMA_QPAGE) % SCDMA_NQ;
+    UNIT *uptr = &scdma_unit[0];
+
+    scdma_q_db[q]++;
+    scdma_q_act |= 1u << q;
+    if (scdma_q_t0[q] < 0) scdma_q_t0[q] = sim_gtime();
+    scdma_idle = 0;
+    scdma_intvl = SCDMA_BUSY_INTVL;
+    if (sim_is_active(uptr) > SCDMA_KICK_INTVL + 1) sim_cancel(uptr);
+    if (!sim_is_active(uptr)) sim_activate(uptr, SCDMA_KICK_INTVL);
+}
+
 /*
  *      SCDMA Recieve service
  */
@@ -136,12 +269,113 @@ scdma_reset(DEVICE *dptr)
 t_stat
 scdma_rcv_svc( UNIT *uptr )
 {
+    t_uint64 moved = scdma_rbytes + scdma_wbytes;
+    t_uint64 ios = simdma_context.io_write_count + simdma_context.io_read_count;
+    t_uint64 refused = scdma_tx_refused;
+    t_uint64 lat, n;
+    double now = sim_gtime();
+    int i, j, na;
+
+    for (i = 0; i < SCDMA_NQ; i++) {                    /* doorbells answered */
+	if (scdma_q_t0[i] < 0) continue;
+	lat = (t_uint64) (now - scdma_q_t0[i]);
+	scdma_q_svc[i]++;
+	scdma_q_lat[i] += lat;
+	if (lat > scdma_q_max[i]) scdma_q_max[i] = lat;
+	scdma_q_t0[i] = -1;
+    }
+    scdma_fab_input();
     simdma_progress();
+    scdma_passes++;
+
+    n = scdma_rbytes + scdma_wbytes - moved;            /* share out bytes */
+    for (i = 0, na = 0; i < SCDMA_NQ; i++)
+	if (scdma_q_act & (1u << i)) na++;
+    for (i = 0, j = 0; n && na && i < SCDMA_NQ; i++) {
+	if (scdma_q_act & (1u << i)) {
+	    scdma_q_bytes[i] += n / na + ((t_uint64) j < n % na);
+	    j++;
+	}
+    }
 
-    sim_activate(uptr, SCDMA_POLL_INTVL);
+    if (n || (simdma_context.io_write_count + simdma_context.io_read_count != ios) ||
+	(scdma_tx_refused != refused) ||                /* send to retry */
+	scdma_rx_len || fabric_pending()) {             /* busy */
+	scdma_idle = 0;
+	scdma_intvl = SCDMA_BUSY_INTVL;
+    }
+    else if (++scdma_idle >= SCDMA_IDLE_POLLS) {        /* idle */
+	scdma_q_act = 0;
+	if (fabric_active()) {                          /* doorbell or unit 1 */
+	    scdma_dormant++;                            /* wakes us */
+	    return SCPE_OK;
+	}
+	scdma_intvl = SCDMA_POLL_INTVL;                 /* socket transport */
+    }
+    else if (scdma_intvl < SCDMA_POLL_INTVL) {          /* back off */
+	scdma_intvl <<= 1;
+	if (scdma_intvl > SCDMA_POLL_INTVL) scdma_intvl = SCDMA_POLL_INTVL;
+    }
+    sim_activate(uptr, scdma_intvl);
     return SCPE_OK;
 }
 
+/*
+ *      SCDMA fabric service: look at the links, sync each quantum
+ */
+
+t_stat
+scdma_fab_svc( UNIT *uptr )
+{
+    UNIT *eptr = &scdma_unit[0];
+    t_stat r;
+
+    if (!fabric_active()) return SCPE_OK;
+    sim_activate(uptr, SCDMA_FAB_POLL);
+    if (scdma_fab_left == 0) {                          /* end of quantum */
+	scdma_fab_left = SCDMA_POLL_INTVL / SCDMA_FAB_POLL;
+	if ((r = fabric_sync()) != SCPE_OK) return r;   /* stop key */
+    }
+    scdma_fab_left--;
+    if (fabric_pending()) {                             /* packet arrived */
+	scdma_idle = 0;
+	scdma_intvl = SCDMA_BUSY_INTVL;
+	if (sim_is_active(eptr) > SCDMA_KICK_INTVL + 1) sim_cancel(eptr);
+	if (!sim_is_active(eptr)) sim_activate(eptr, SCDMA_KICK_INTVL);
+    }
+    return SCPE_OK;
+}
+
+/*
+ *      SCDMA fabric input: hand arrived packets to simdma
+ */
+
+static void
+scdma_fab_input( void )
+{
+    for (;;) {
+	if (scdma_rx_len == 0 &&
+	    (scdma_rx_len = fabric_recv(&scdma_rx_src, scdma_rx_pkt, FAB_PKTMAX)) == 0)
+	    return;                                     /* links empty */
+	if (simdma_net_input(scdma_rx_src, scdma_rx_pkt, scdma_rx_len) != SIMDMA_SUCCESS) {
+	    scdma_rx_held++;                            /* full, retry next pass */
+	    return;
+	}
+	scdma_rx_len = 0;
+    }
+}
+
+static t_stat
+scdma_set_fabric( UNIT *uptr, int32 val, char *cptr, void *desc )
+{
+    t_stat r = fabric_set(uptr, val, cptr, desc);
+
+    sim_cancel(&scdma_unit[1]);
+    scdma_fab_left = SCDMA_POLL_INTVL / SCDMA_FAB_POLL;
+    if (fabric_active()) sim_activate(&scdma_unit[1], SCDMA_FAB_POLL);
+    return r;
+}
+
 
 /*
  * For simdma to call to read/write the M array 
@@ -173,6 +407,12 @@ int simdma_phys_read(uint32_t *addr, uint32_t *data, int length)
     assert(((uintptr_t) addr & 3) == 0);
     assert(((uintptr_t) data & 3) == 0);
 
+    scdma_rbytes += length;
+
+    /* whole range in main memory: one bulk copy */
+    if (mem_dma_read((uintptr_t) addr, data, length))
+	return (SIMDMA_SUCCESS);
+
     if ((((uintptr_t) addr & 7) == 0)
 	&& (((uintptr_t) data & 7) == 0)
 	&& ((length & 7) == 0)) {
@@ -203,6 +443,12 @@ int simdma_phys_write(uint32_t *addr, uint32_t *data, int length)
     assert(((uintptr_t) addr & 3) == 0);
     assert(((uintptr_t) data & 3) == 0);
 
+    scdma_wbytes += length;
+
+    /* whole range in main memory: one bulk copy, reservations broken */
+    if (mem_dma_write((uintptr_t) addr, data, length))
+	return (SIMDMA_SUCCESS);
+
     if ((((uintptr_t) addr & 7) == 0)
 	&& (((uintptr_t) data & 7) == 0)
 	&& ((length & 7) == 0)) {
@@ -226,6 +472,34 @@ int simdma_phys_write(uint32_t *addr, uint32_t *data, int length)
 }
 
 
+/*
+ * For simdma's route stage: send a packet to another node.  Returns
+ * SIMDMA_SUCCESS, or -1 if there is no fabric or the link is full, in
+ * which case simdma keeps the packet and tries again on a later pass.
+ */
+
+int simdma_net_send(uint32_t dst, const void *pkt, int len)
+{
+    if (len < 0 || fabric_send(dst, pkt, (uint32) len) < 0) {
+	scdma_tx_refused++;                             /* engine stays awake */
+	return(-1);
+    }
+    return(SIMDMA_SUCCESS);
+}
+
+
+/*
+ * Default for a simdma that takes no packets from the network: drop
+ * them, so the links still drain.
+ */
+
+__WEAK int simdma_net_input(uint32_t src, const void *pkt, int len)
+{
+    scdma_rx_drop++;
+    return(SIMDMA_SUCCESS);
+}
+
+
 int simdma_cause_interrupt(uint64_t value)
 {
     cac_csw_int((value >> 12) & 15, (value >> 8) & 15, value & 0xff);
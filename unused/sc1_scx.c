@@ -27,6 +27,7 @@
 
 #include "sc1_defs.h"
 #include "sc1_scx.h"
+#include "sc1_stats.h"
 #include <assert.h>
 
 #define SCX_RATIO_DEFAULT	2000
@@ -36,6 +37,7 @@
 #ifdef SIMH_CPUSIMH
 extern void ScxStep(unsigned int);
 extern t_uint64 backdoorUntil;
+extern int simhMem;
 void setSimhMemModel (int newModel);
 int getSimhMemModel ();
 void setSimhRatio (uint64_t newRatio);
@@ -45,6 +47,49 @@ uint64_t getEpochCycles ();
 #endif
 
 extern t_uint64 total_count;
+extern FILE *sim_log;
+extern CORECTX *cpu_ctx[NUM_CORES];
+extern UNIT mem_unit;
+
+static t_uint64 scx_epochs = 0;                         /* epochs stepped */
+
+/* Adaptive epoch sizing
+
+   With AUTOTUNE set, the epoch length (model cycles per epoch) is
+   re-chosen at every epoch boundary from what the cores did during the
+   epoch just finished:
+
+	stall	core-instructions spent in EVT_STALL (per mille of total)
+	stallep	cores parked with EVT_STALL_EPOCH by simhLLStallCpu
+	llretry	LLs repeated to the same address (lock_set)
+	mmio	I/O accesses sent to the model
+
+   Any of these over its threshold means the cores and the model are
+   tightly coupled, and the epoch is halved.  After TGROW consecutive
+   quiet epochs it is doubled.  The length stays within [TMIN, TMAX].
+   Every decision, including keeping the length, is written with its
+   inputs to the tune log: SET SCX TUNELOG=file, else the console log,
+   else SCX_TUNE_DFLT in the current directory.  A run can be reproduced
+   by replaying the logged lengths.
+*/
+
+#define SCX_TUNE_DFLT   "scx_tune.log"                  /* default tune log */
+
+t_uint64 scx_fb_stall = 0;                              /* stalled core-insts */
+t_uint64 scx_fb_stallep = 0;                            /* LL epoch stalls */
+t_uint64 scx_fb_llretry = 0;                            /* LL retries */
+static t_uint64 scx_fb_mmio = 0;                        /* model I/O */
+
+static uint32 scx_tune = 0;                             /* autotune enabled */
+static uint32 scx_tmin = 8;                             /* min epoch cycles */
+static uint32 scx_tmax = 4096;                          /* max epoch cycles */
+static uint32 scx_tgrow = 4;                            /* quiet epochs to grow */
+static uint32 scx_tstall = 10;                          /* stall, per mille */
+static uint32 scx_tll = 64;                             /* LL retries/epoch */
+static uint32 scx_tmmio = 256;                          /* model I/O/epoch */
+static uint32 scx_quiet = 0;                            /* quiet epoch count */
+static t_uint64 scx_tune_chg = 0;                       /* changes made */
+static FILE *scx_tune_log = NULL;                       /* decision log */
 
 /* Declarations */
 
@@ -52,6 +97,7 @@ static t_bool scx_rd( t_uint64 pa, t_uint64 *val, uint32 unit );
 static t_bool scx_wr( t_uint64 pa, t_uint64 val, uint32 unit );
 static t_stat scx_reset( DEVICE *dptr );
 static t_stat scx_rcv_svc (UNIT *uptr);
+static t_stat scx_set_tunelog (UNIT *uptr, int32 val, char *cptr, void *desc);
 
 
 DIB scx_dib = { SCX_BASE, SCX_END, &scx_rd, &scx_wr, 0 };
@@ -61,14 +107,31 @@ UNIT scx_unit[] = {
 };
 
 REG scx_reg[] = {
- { NULL }
+    { DRDATA (EPOCHS, scx_epochs, 64), REG_RO },
+    { FLDATA (AUTOTUNE, scx_tune, 0) },
+    { DRDATA (TMIN, scx_tmin, 32) },
+    { DRDATA (TMAX, scx_tmax, 32) },
+    { DRDATA (TGROW, scx_tgrow, 16) },
+    { DRDATA (TSTALL, scx_tstall, 16) },
+    { DRDATA (TLL, scx_tll, 32) },
+    { DRDATA (TMMIO, scx_tmmio, 32) },
+    { DRDATA (TCHANGES, scx_tune_chg, 64) },
+    { NULL }
+};
+
+MTAB scx_mod[] = {
+    { MTAB_XTD|MTAB_VDV|MTAB_NMO, 0, NULL, "TUNELOG",
+      &scx_set_tunelog, NULL },
+    { MTAB_XTD|MTAB_VDV|MTAB_NMO, 1, NULL, "NOTUNELOG",
+      &scx_set_tunelog, NULL },
+    { 0 }
 };
 
 DEVICE scx_dev = {
     "SCX",              /* name */
     scx_unit,           /* units */
     scx_reg,            /* registers */
-    NULL,               /* modifiers */
+    scx_mod,            /* modifiers */
     1,                  /* #units */
     16,                 /* address radix */
     0,                  /* address width */
@@ -157,6 +220,89 @@ static t_bool scx_wr(t_uint64 pa, t_uint64 idata, uint32 unit)
     return TRUE;
 }
 
+#ifdef SIMH_CPUSIMH
+
+/* I/O accessors used by the CALL_xxx macros; they count model I/O for
+   the autotune */
+
+t_bool ScxTReadIO (CORECTX *ctx, t_uint64 pa, t_uint64 *val, uint32 lnt)
+{
+    scx_fb_mmio++;
+    return ScxReadIO (ctx, pa, val, lnt);
+}
+
+t_bool ScxTWriteIO (CORECTX *ctx, t_uint64 pa, t_uint64 dat, uint32 lnt)
+{
+    scx_fb_mmio++;
+    return ScxWriteIO (ctx, pa, dat, lnt);
+}
+
+/* Where tune decisions go; the default log is opened on first use */
+
+static FILE *scx_tune_sink (void)
+{
+    if (scx_tune_log)
+	return scx_tune_log;
+    if (sim_log)
+	return sim_log;
+    if ((scx_tune_log = fopen (SCX_TUNE_DFLT, "a")) == NULL) {
+	fprintf (stderr, "%%Error: SCX: cannot open %s, tune log to stderr\n", SCX_TUNE_DFLT);
+	scx_tune_log = stderr;
+    }
+    return scx_tune_log;
+}
+
+/* Pick the length of the next epoch; returns the (possibly new) length */
+
+static uint64_t scx_autotune (uint64_t cycles, uint64_t ratio)
+{
+    t_uint64 insts = ratio * cycles * NUM_CORES;
+    uint64_t ncyc = cycles;
+    const char *why = NULL;
+    const char *what;
+    FILE *lf;
+
+    if (scx_fb_stallep)
+	why = "stallep";
+    else if ((scx_fb_stall * 1000) > (insts * scx_tstall))
+	why = "stall";
+    else if (scx_fb_llretry > scx_tll)
+	why = "llretry";
+    else if (scx_fb_mmio > scx_tmmio)
+	why = "mmio";
+    if (why) {					/* coupled: shrink */
+	scx_quiet = 0;
+	ncyc = cycles >> 1;
+    }
+    else if (++scx_quiet >= scx_tgrow) {	/* independent: stretch */
+	scx_quiet = 0;
+	ncyc = cycles << 1;
+	why = "quiet";
+    }
+    else why = "steady";
+    if (ncyc < scx_tmin)
+	ncyc = scx_tmin;
+    if (ncyc > scx_tmax)
+	ncyc = scx_tmax;
+    if (ncyc < cycles)
+	what = "shrink";
+    else if (ncyc > cycles)
+	what = "grow";
+    else what = "keep";
+    if (ncyc != cycles) {
+	setEpochCycles (ncyc);
+	scx_tune_chg++;
+    }
+    if ((lf = scx_tune_sink ()) != NULL)
+	fprintf (lf, "SCX tune: epoch %llu count %llu cycles %llu -> %llu %s (%s: stall %llu/%llu stallep %llu llretry %llu mmio %llu quiet %u)\n",
+		 scx_epochs, total_count, (t_uint64) cycles, (t_uint64) ncyc, what, why,
+		 scx_fb_stall, insts, scx_fb_stallep, scx_fb_llretry, scx_fb_mmio, scx_quiet);
+    scx_fb_stall = scx_fb_stallep = scx_fb_llretry = scx_fb_mmio = 0;
+    return ncyc;
+}
+
+#endif
+
 static t_stat scx_reset(DEVICE *dptr)
 {
 #ifdef SIMH_CPUSIMH
@@ -173,18 +319,148 @@ t_stat scx_rcv_svc (UNIT *uptr)
     uint64_t cycles = getEpochCycles ();
     uint64_t ratio = getSimhRatio ();
     if (ratio && cycles) {
+	t_bool stalled = FALSE;
+	int cpu;
+
+	for (cpu=0; cpu<NUM_CORES; cpu++) {
+	    if (cpu_ctx[cpu]->events & EVT_STALL_EPOCH)
+		stalled = TRUE;
+	}
 	STATS_SCX_BEGIN_EPOCH(cycles);
 	ScxStep(cycles);
+	scx_epochs++;
 	STATS_SCX_END_EPOCH(cycles);
 
 	// clear the EVT_STALL_EPOCH bit for every cpu.
 	// This is part of the simhLLStallCpu feature.
-	for (int cpu=0; cpu<NUM_CORES; cpu++) {
-	    cpu_ctx[cpu]->events &= ~EVT_STALL_EPOCH;
+	if (stalled) {
+	    for (cpu=0; cpu<NUM_CORES; cpu++) {
+		cpu_ctx[cpu]->events &= ~EVT_STALL_EPOCH;
+	    }
 	}
     }
+    if (scx_tune && ratio && cycles)
+	cycles = scx_autotune (cycles, ratio);
     /* printf("\r\nSIMH : SCX : svc ratio %d total count %lld", ratio, total_count); */
     sim_activate(uptr, ratio * cycles);
 #endif
     return SCPE_OK;
 }
+
+/* SET SCX TUNELOG=file, SET SCX NOTUNELOG (back to the default) */
+
+static t_stat scx_set_tunelog (UNIT *uptr, int32 val, char *cptr, void *desc)
+{
+    if (scx_tune_log) {
+	if (scx_tune_log != stderr)
+	    fclose (scx_tune_log);
+	scx_tune_log = NULL;
+    }
+    if (val)
+	return (cptr == NULL)? SCPE_OK: SCPE_ARG;
+    if ((cptr == NULL) || (*cptr == 0))
+	return SCPE_ARG;
+    scx_tune_log = fopen (cptr, "a");
+    if (scx_tune_log == NULL)
+	return SCPE_OPENERR;
+    return SCPE_OK;
+}
+
+/* Stand-in for the System-C model
+
+   Compiled with SCX_STUB, this provides just enough of the SCX side to
+   run the simh cpu model under SIMH_CPUSIMH without System-C: ScxStep
+   only counts cycles and every access goes straight to the simh
+   devices.  It is meant for testing the epoch machinery above, e.g.
+   the autotune.
+*/
+
+#if defined (SIMH_CPUSIMH) && defined (SCX_STUB)
+
+t_uint64 backdoorUntil = 0;
+t_uint64 simhLLStallCpu = 0;
+int simhMem = 1;
+
+static int scx_stub_model = 0;
+static uint64_t scx_stub_ratio = SCX_RATIO_DEFAULT;
+static uint64_t scx_stub_cycles = SCX_CYCLES_DEFAULT;
+static volatile t_uint64 scx_stub_now = 0;              /* model cycles */
+
+void ScxStep (unsigned int cycles)
+{
+    scx_stub_now += cycles;
+}
+
+t_uint64 ScxGetCurrentSimTime ()
+{
+    return scx_stub_now;
+}
+
+void setSimhMemModel (int newModel) { scx_stub_model = newModel; }
+int getSimhMemModel () { return scx_stub_model; }
+void setSimhRatio (uint64_t newRatio) { scx_stub_ratio = newRatio; }
+uint64_t getSimhRatio () { return scx_stub_ratio; }
+void setEpochCycles (uint64_t newCycles) { scx_stub_cycles = newCycles; }
+uint64_t getEpochCycles () { return scx_stub_cycles; }
+
+t_bool ScxReadIO (CORECTX *ctx, t_uint64 pa, t_uint64 *val, uint32 lnt)
+{
+    return ReadIO (ctx, pa, val, lnt);
+}
+
+t_bool ScxReadPB (CORECTX *ctx, t_uint64 pa, t_uint64 *val, uint32 catr)
+{
+    return ReadPB (ctx, pa, val, catr);
+}
+
+t_bool ScxReadPH (CORECTX *ctx, t_uint64 pa, t_uint64 *val, uint32 catr)
+{
+    return ReadPH (ctx, pa, val, catr);
+}
+
+t_bool ScxReadPW (CORECTX *ctx, t_uint64 pa, t_uint64 *val, uint32 catr)
+{
+    return ReadPW (ctx, pa, val, catr);
+}
+
+t_bool ScxReadPD (CORECTX *ctx, t_uint64 pa, t_uint64 *val, uint32 catr)
+{
+    return ReadPD (ctx, pa, val, catr);
+}
+
+t_bool ScxReadPI (CORECTX *ctx, t_uint64 pa, t_uint64 *val, uint32 catr)
+{
+    return ReadPI (ctx, pa, val, catr);
+}
+
+t_bool ScxWriteIO (CORECTX *ctx, t_uint64 pa, t_uint64 dat, uint32 lnt)
+{
+    return WriteIO (ctx, pa, dat, lnt);
+}
+
+t_bool ScxWritePB (CORECTX *ctx, t_uint64 pa, t_uint64 dat, uint32 catr)
+{
+    return WritePB (ctx, pa, dat, catr);
+}
+
+t_bool ScxWritePH (CORECTX *ctx, t_uint64 pa, t_uint64 dat, uint32 catr)
+{
+    return WritePH (ctx, pa, dat, catr);
+}
+
+t_bool ScxWritePW (CORECTX *ctx, t_uint64 pa, t_uint64 dat, uint32 catr)
+{
+    return WritePW (ctx, pa, dat, catr);
+}
+
+t_bool ScxWritePD (CORECTX *ctx, t_uint64 pa, t_uint64 dat, uint32 catr)
+{
+    return WritePD (ctx, pa, dat, catr);
+}
+
+t_bool ScxLockTest (uint32 num)
+{
+    return lock_test (num);
+}
+
+#endif